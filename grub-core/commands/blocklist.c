@@ -46,26 +46,50 @@ grub_cmd_blocklist (grub_command_t cmd __attribute__ ((unused)),
   void NESTED_FUNC_ATTR read_blocklist (grub_disk_addr_t sector, unsigned offset,
 		       unsigned length)
     {
-      if (num_sectors > 0)
+      unsigned num;
+
+      /* A partial first sector.  */
+      if (offset != 0)
 	{
-	  if (start_sector + num_sectors == sector
-	      && offset == 0 && length == GRUB_DISK_SECTOR_SIZE)
+	  unsigned cl = GRUB_DISK_SECTOR_SIZE - offset;
+	  if (cl > length)
+	    cl = length;
+	  if (num_sectors > 0)
 	    {
-	      num_sectors++;
-	      return;
+	      print_blocklist (start_sector, num_sectors, 0, 0);
+	      num_sectors = 0;
 	    }
+	  print_blocklist (sector, 0, offset, cl);
+	  sector++;
+	  length -= cl;
+	}
 
-	  print_blocklist (start_sector, num_sectors, 0, 0);
-	  num_sectors = 0;
+      /* Whole sectors.  */
+      num = length >> GRUB_DISK_SECTOR_BITS;
+      if (num > 0)
+	{
+	  if (num_sectors > 0 && start_sector + num_sectors != sector)
+	    {
+	      print_blocklist (start_sector, num_sectors, 0, 0);
+	      num_sectors = 0;
+	    }
+	  if (num_sectors == 0)
+	    start_sector = sector;
+	  num_sectors += num;
+	  sector += num;
+	  length &= GRUB_DISK_SECTOR_SIZE - 1;
 	}
 
-      if (offset == 0 && length == GRUB_DISK_SECTOR_SIZE)
+      /* A partial last sector.  */
+      if (length > 0)
 	{
-	  start_sector = sector;
-	  num_sectors++;
+	  if (num_sectors > 0)
+	    {
+	      print_blocklist (start_sector, num_sectors, 0, 0);
+	      num_sectors = 0;
+	    }
+	  print_blocklist (sector, 0, 0, length);
 	}
-      else
-	print_blocklist (sector, 0, offset, length);
     }
 
   void NESTED_FUNC_ATTR print_blocklist (grub_disk_addr_t sector, unsigned num,
@@ -0,0 +1,306 @@
+/* boottrace.c - show and export the boot trace  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/disk.h>
+#include <grub/file.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/env.h>
+#include <grub/partition.h>
+#include <grub/extcmd.h>
+#include <grub/boottrace.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* The version of the text format written by --dump.  */
+#define BOOTTRACE_DUMP_VERSION	1
+
+static const struct grub_arg_option options[] =
+  {
+    {"dump", 'd', 0, N_("Print one record per line, for scripts."), 0, 0},
+    {"set", 's', 0, N_("Store the records in the variable VARNAME."),
+     N_("VARNAME"), ARG_TYPE_STRING},
+    {"file", 'f', 0, N_("Write the records over the existing file FILE."),
+     N_("FILE"), ARG_TYPE_STRING},
+    {"clear", 'c', 0, N_("Forget the spans recorded so far."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+enum options
+  {
+    BOOTTRACE_DUMP,
+    BOOTTRACE_SET,
+    BOOTTRACE_FILE,
+    BOOTTRACE_CLEAR
+  };
+
+/* Return the number of cycles per millisecond, measured over the whole
+   trace, or 0 if there is no cycle counter or the trace is too short to
+   tell.  */
+static grub_uint64_t
+ticks_per_ms (const struct grub_boottrace_span *spans, unsigned n)
+{
+  grub_uint64_t ms, tsc;
+  unsigned last;
+
+  for (last = n; last > 0 && spans[last - 1].open; last--)
+    ;
+  if (last == 0 || ! spans[0].start_tsc || ! spans[last - 1].end_tsc)
+    return 0;
+
+  ms = spans[last - 1].end_ms - spans[0].start_ms;
+  tsc = spans[last - 1].end_tsc - spans[0].start_tsc;
+  if (ms < 100)
+    return 0;
+  return grub_divmod64 (tsc, ms, 0);
+}
+
+/* Return the records in the --dump format, one per line, in a buffer to
+   be freed by the caller.  */
+static char *
+dump_spans (const struct grub_boottrace_span *spans, unsigned n,
+	    unsigned dropped)
+{
+  grub_size_t size, len;
+  char *buf;
+  unsigned i;
+
+  size = 64 + n * (GRUB_BOOTTRACE_ARG_SIZE + 128);
+  buf = grub_malloc (size);
+  if (! buf)
+    return 0;
+
+  len = grub_snprintf (buf, size, "boottrace %d %u %u %llu\n",
+		       BOOTTRACE_DUMP_VERSION, n, dropped,
+		       (unsigned long long) ticks_per_ms (spans, n));
+  for (i = 0; i < n; i++)
+    {
+      if (spans[i].open)
+	len += grub_snprintf (buf + len, size - len,
+			      "span %u %llu - %llu - %s %s\n",
+			      spans[i].depth,
+			      (unsigned long long) spans[i].start_ms,
+			      (unsigned long long) spans[i].start_tsc,
+			      spans[i].kind, spans[i].arg);
+      else
+	len += grub_snprintf (buf + len, size - len,
+			      "span %u %llu %llu %llu %llu %s %s\n",
+			      spans[i].depth,
+			      (unsigned long long) spans[i].start_ms,
+			      (unsigned long long) spans[i].end_ms,
+			      (unsigned long long) spans[i].start_tsc,
+			      (unsigned long long) spans[i].end_tsc,
+			      spans[i].kind, spans[i].arg);
+    }
+
+  return buf;
+}
+
+static void
+print_spans (const struct grub_boottrace_span *spans, unsigned n,
+	     unsigned dropped)
+{
+  grub_uint64_t tpm, us;
+  unsigned i, j;
+
+  tpm = ticks_per_ms (spans, n);
+  grub_printf_ (N_("%u spans, %u dropped\n"), n, dropped);
+  for (i = 0; i < n; i++)
+    {
+      grub_printf ("%8llu ", (unsigned long long) spans[i].start_ms);
+      if (spans[i].open)
+	grub_printf ("%12s", "-");
+      else if (tpm)
+	{
+	  us = grub_divmod64 ((spans[i].end_tsc - spans[i].start_tsc) * 1000,
+			      tpm, 0);
+	  grub_printf ("%8llu.%03u", (unsigned long long) us / 1000,
+		       (unsigned) (us % 1000));
+	}
+      else
+	grub_printf ("%12llu",
+		     (unsigned long long) (spans[i].end_ms
+					   - spans[i].start_ms));
+      grub_printf (" ms ");
+      for (j = 0; j < spans[i].depth && j < 8; j++)
+	grub_printf ("  ");
+      grub_printf ("%s %s\n", spans[i].kind, spans[i].arg);
+    }
+}
+
+/* Write TEXT over the contents of the file FILENAME, which must exist and
+   be big enough, the way iotrace_save does.  The rest of the file is
+   filled with newlines.  */
+static grub_err_t
+write_file (const char *filename, const char *text)
+{
+  struct range
+  {
+    grub_disk_addr_t sector;
+    unsigned offset;
+    unsigned length;
+    struct range *next;
+  } *head = 0, **tail = &head, *r;
+  grub_file_t file;
+  grub_disk_t disk;
+  grub_disk_addr_t part_start;
+  grub_size_t size, total = 0, len, pos;
+  char *buf = 0, *scratch = 0;
+
+  auto void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
+					unsigned offset, unsigned length);
+  void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
+				   unsigned offset, unsigned length)
+    {
+      r = grub_malloc (sizeof (*r));
+      if (! r)
+	return;
+      r->sector = sector;
+      r->offset = offset;
+      r->length = length;
+      r->next = 0;
+      *tail = r;
+      tail = &r->next;
+      total += length;
+    }
+
+  grub_file_filter_disable_compression ();
+  file = grub_file_open (filename);
+  if (! file)
+    return grub_errno;
+
+  if (! file->device->disk)
+    {
+      grub_error (GRUB_ERR_BAD_DEVICE, "disk device required");
+      goto fail;
+    }
+  disk = file->device->disk;
+  part_start = grub_partition_get_start (disk->partition);
+
+  size = grub_file_size (file);
+  scratch = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (! scratch)
+    goto fail;
+
+  file->read_hook = read_hook;
+  while (grub_file_read (file, scratch,
+			 GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS) > 0)
+    ;
+  file->read_hook = 0;
+  if (grub_errno)
+    goto fail;
+
+  if (total != size)
+    {
+      /* Maybe sparse, unallocated sectors.  */
+      grub_error (GRUB_ERR_BAD_FILE_TYPE, "sparse file not allowed");
+      goto fail;
+    }
+
+  /* Keep as many whole lines as fit.  */
+  len = grub_strlen (text);
+  if (len > size)
+    {
+      len = size;
+      while (len > 0 && text[len - 1] != '\n')
+	len--;
+      grub_printf_ (N_("Only part of the trace fits in the file.\n"));
+    }
+
+  buf = grub_malloc (size);
+  if (! buf)
+    goto fail;
+  grub_memcpy (buf, text, len);
+  grub_memset (buf + len, '\n', size - len);
+
+  for (r = head, pos = 0; r; pos += r->length, r = r->next)
+    if (grub_disk_write (disk, r->sector - part_start, r->offset, r->length,
+			 buf + pos))
+      goto fail;
+
+ fail:
+  while (head)
+    {
+      r = head->next;
+      grub_free (head);
+      head = r;
+    }
+  grub_free (buf);
+  grub_free (scratch);
+  grub_file_close (file);
+
+  return grub_errno;
+}
+
+static grub_err_t
+grub_cmd_boottrace (grub_extcmd_context_t ctxt,
+		    int argc __attribute__ ((unused)),
+		    char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  const struct grub_boottrace_span *spans;
+  unsigned n, dropped;
+  char *text = 0;
+
+  spans = grub_boottrace_get (&n, &dropped);
+
+  if (state[BOOTTRACE_DUMP].set || state[BOOTTRACE_SET].set
+      || state[BOOTTRACE_FILE].set)
+    {
+      text = dump_spans (spans, n, dropped);
+      if (! text)
+	return grub_errno;
+    }
+
+  if (state[BOOTTRACE_DUMP].set)
+    grub_printf ("%s", text);
+  else if (! state[BOOTTRACE_SET].set && ! state[BOOTTRACE_FILE].set
+	   && ! state[BOOTTRACE_CLEAR].set)
+    print_spans (spans, n, dropped);
+
+  if (state[BOOTTRACE_SET].set)
+    grub_env_set (state[BOOTTRACE_SET].arg, text);
+  if (! grub_errno && state[BOOTTRACE_FILE].set)
+    write_file (state[BOOTTRACE_FILE].arg, text);
+  grub_free (text);
+  if (grub_errno)
+    return grub_errno;
+
+  if (state[BOOTTRACE_CLEAR].set)
+    grub_boottrace_clear ();
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(boottrace)
+{
+  cmd = grub_register_extcmd ("boottrace", grub_cmd_boottrace, 0,
+			      N_("[-d] [-s VARNAME] [-f FILE] [-c]"),
+			      N_("Show how long the phases of the boot took."),
+			      options);
+}
+
+GRUB_MOD_FINI(boottrace)
+{
+  grub_unregister_extcmd (cmd);
+}
@@ -0,0 +1,89 @@
+/* iostat.c - command to show disk I/O statistics  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/disk.h>
+#include <grub/misc.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const struct grub_arg_option options[] =
+  {
+    {"reset", 'r', 0, N_("Reset the counters after showing them."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static int
+print_stats (const char *name, const struct grub_disk_stats *stats)
+{
+  unsigned i;
+
+  grub_printf ("%s:\n", name);
+  grub_printf_ (N_("  %llu reads, %llu bytes, %llu ms in the driver\n"),
+		(unsigned long long) stats->reads,
+		(unsigned long long) stats->bytes_read,
+		(unsigned long long) stats->read_time);
+  grub_printf_ (N_("  cache: %llu hits, %llu misses, %llu evictions\n"),
+		(unsigned long long) stats->cache_hits,
+		(unsigned long long) stats->cache_misses,
+		(unsigned long long) stats->evictions);
+
+  grub_printf ("  %s", _("latency:"));
+  for (i = 0; i < GRUB_DISK_STATS_LATENCY_BUCKETS; i++)
+    {
+      if (i == GRUB_DISK_STATS_LATENCY_BUCKETS - 1)
+	grub_printf (" >=%ums:", 1U << (i - 1));
+      else
+	grub_printf (" <%ums:", 1U << i);
+      grub_printf ("%llu", (unsigned long long) stats->latency[i]);
+    }
+  grub_printf ("\n");
+
+  return 0;
+}
+
+static grub_err_t
+grub_cmd_iostat (grub_extcmd_context_t ctxt,
+		 int argc __attribute__ ((unused)),
+		 char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+
+  grub_disk_stats_iterate (print_stats);
+
+  if (state[0].set)
+    grub_disk_stats_reset ();
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(iostat)
+{
+  cmd = grub_register_extcmd ("iostat", grub_cmd_iostat, 0, "[-r]",
+			      N_("Show disk I/O statistics."), options);
+}
+
+GRUB_MOD_FINI(iostat)
+{
+  grub_unregister_extcmd (cmd);
+}
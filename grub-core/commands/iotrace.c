@@ -0,0 +1,287 @@
+/* iotrace.c - record the disk reads into a trace  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/disk.h>
+#include <grub/file.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/time.h>
+#include <grub/partition.h>
+#include <grub/command.h>
+#include <grub/extcmd.h>
+#include <grub/iotrace.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define DEFAULT_RECORDS	65536
+#define MAX_DEVICES	64
+
+static struct grub_iotrace_record *records;
+static grub_uint32_t nrecords, max_records, dropped;
+static struct grub_iotrace_device devices[MAX_DEVICES];
+static grub_uint32_t ndevices;
+static grub_uint64_t start_time;
+
+static const struct grub_arg_option options[] =
+  {
+    {"records", 'n', 0, N_("Keep at most NUM records."), N_("NUM"),
+     ARG_TYPE_INT},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static void
+trace_hook (grub_disk_t disk, int type, int flags, grub_disk_addr_t sector,
+	    grub_off_t offset, grub_size_t size)
+{
+  struct grub_iotrace_record *rec;
+  grub_uint32_t dev;
+
+  for (dev = 0; dev < ndevices; dev++)
+    if (grub_strncmp (devices[dev].name, disk->name,
+		      GRUB_IOTRACE_NAME_SIZE) == 0)
+      break;
+
+  if (nrecords == max_records
+      || (dev == ndevices && ndevices == MAX_DEVICES))
+    {
+      dropped++;
+      return;
+    }
+
+  if (dev == ndevices)
+    {
+      grub_strncpy (devices[dev].name, disk->name, GRUB_IOTRACE_NAME_SIZE);
+      ndevices++;
+    }
+
+  rec = records + nrecords++;
+  rec->sector = grub_cpu_to_le64 (sector);
+  rec->size = grub_cpu_to_le32 (size);
+  rec->time = grub_cpu_to_le32 (grub_get_time_ms () - start_time);
+  rec->device = grub_cpu_to_le16 (dev);
+  rec->offset = grub_cpu_to_le16 (offset);
+  rec->type = type;
+  rec->flags = flags;
+  rec->reserved = 0;
+}
+
+static grub_err_t
+grub_cmd_iotrace_start (grub_extcmd_context_t ctxt,
+			int argc __attribute__ ((unused)),
+			char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  grub_uint32_t n = DEFAULT_RECORDS;
+
+  if (state[0].set)
+    n = grub_strtoul (state[0].arg, 0, 0);
+  if (grub_errno)
+    return grub_errno;
+  if (n == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid number of records"));
+
+  grub_disk_trace_hook = 0;
+  grub_free (records);
+  records = grub_malloc (n * sizeof (records[0]));
+  if (! records)
+    return grub_errno;
+
+  max_records = n;
+  nrecords = 0;
+  dropped = 0;
+  ndevices = 0;
+  grub_memset (devices, 0, sizeof (devices));
+  start_time = grub_get_time_ms ();
+  grub_disk_trace_hook = trace_hook;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_iotrace_stop (grub_command_t cmd __attribute__ ((unused)),
+		       int argc __attribute__ ((unused)),
+		       char **args __attribute__ ((unused)))
+{
+  grub_disk_trace_hook = 0;
+  grub_printf_ (N_("%u records, %u dropped\n"), nrecords, dropped);
+  return GRUB_ERR_NONE;
+}
+
+/* Write the trace over the contents of the file ARGS[0], which must exist
+   and be big enough, the same way save_env updates the environment block:
+   files can't be created or extended from GRUB.  */
+static grub_err_t
+grub_cmd_iotrace_save (grub_command_t cmd __attribute__ ((unused)),
+		       int argc, char **args)
+{
+  void (*hook) (grub_disk_t disk, int type, int flags,
+		grub_disk_addr_t sector, grub_off_t offset, grub_size_t size);
+  struct range
+  {
+    grub_disk_addr_t sector;
+    unsigned offset;
+    unsigned length;
+    struct range *next;
+  } *head = 0, **tail = &head, *r;
+  struct grub_iotrace_header header;
+  grub_file_t file = 0;
+  grub_disk_t disk;
+  grub_disk_addr_t part_start;
+  grub_size_t size, total = 0, fit, pos;
+  grub_uint32_t n;
+  char *buf = 0, *scratch = 0;
+
+  auto void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
+					unsigned offset, unsigned length);
+  void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
+				   unsigned offset, unsigned length)
+    {
+      r = grub_malloc (sizeof (*r));
+      if (! r)
+	return;
+      r->sector = sector;
+      r->offset = offset;
+      r->length = length;
+      r->next = 0;
+      *tail = r;
+      tail = &r->next;
+      total += length;
+    }
+
+  if (argc != 1)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+
+  if (! records)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no trace recorded");
+
+  /* Don't trace ourselves.  */
+  hook = grub_disk_trace_hook;
+  grub_disk_trace_hook = 0;
+
+  grub_file_filter_disable_compression ();
+  file = grub_file_open (args[0]);
+  if (! file)
+    goto fail;
+
+  if (! file->device->disk)
+    {
+      grub_error (GRUB_ERR_BAD_DEVICE, "disk device required");
+      goto fail;
+    }
+  disk = file->device->disk;
+  part_start = grub_partition_get_start (disk->partition);
+
+  size = grub_file_size (file);
+  scratch = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (! scratch)
+    goto fail;
+
+  file->read_hook = read_hook;
+  while (grub_file_read (file, scratch,
+			 GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS) > 0)
+    ;
+  file->read_hook = 0;
+  if (grub_errno)
+    goto fail;
+
+  if (total != size)
+    {
+      /* Maybe sparse, unallocated sectors.  */
+      grub_error (GRUB_ERR_BAD_FILE_TYPE, "sparse file not allowed");
+      goto fail;
+    }
+
+  /* Keep as many records as fit.  */
+  fit = sizeof (header) + ndevices * sizeof (devices[0]);
+  if (size < fit)
+    {
+      grub_error (GRUB_ERR_OUT_OF_RANGE, "file is too small");
+      goto fail;
+    }
+  n = nrecords;
+  if (n > (size - fit) / sizeof (records[0]))
+    n = (size - fit) / sizeof (records[0]);
+
+  buf = grub_zalloc (size);
+  if (! buf)
+    goto fail;
+
+  grub_memcpy (header.magic, GRUB_IOTRACE_MAGIC, sizeof (header.magic));
+  header.version = grub_cpu_to_le32 (GRUB_IOTRACE_VERSION);
+  header.ndevices = grub_cpu_to_le32 (ndevices);
+  header.nrecords = grub_cpu_to_le32 (n);
+  header.dropped = grub_cpu_to_le32 (dropped + nrecords - n);
+  grub_memcpy (buf, &header, sizeof (header));
+  grub_memcpy (buf + sizeof (header), devices,
+	       ndevices * sizeof (devices[0]));
+  grub_memcpy (buf + fit, records, n * sizeof (records[0]));
+
+  for (r = head, pos = 0; r; pos += r->length, r = r->next)
+    if (grub_disk_write (disk, r->sector - part_start, r->offset, r->length,
+			 buf + pos))
+      goto fail;
+
+  if (n < nrecords)
+    grub_printf_ (N_("Only %u of %u records fit in the file.\n"),
+		  n, nrecords);
+
+ fail:
+  while (head)
+    {
+      r = head->next;
+      grub_free (head);
+      head = r;
+    }
+  grub_free (buf);
+  grub_free (scratch);
+  if (file)
+    grub_file_close (file);
+  grub_disk_trace_hook = hook;
+
+  return grub_errno;
+}
+
+static grub_extcmd_t cmd_start;
+static grub_command_t cmd_stop, cmd_save;
+
+GRUB_MOD_INIT(iotrace)
+{
+  cmd_start = grub_register_extcmd ("iotrace_start", grub_cmd_iotrace_start,
+				    0, N_("[-n NUM]"),
+				    N_("Start recording the disk reads."),
+				    options);
+  cmd_stop = grub_register_command ("iotrace_stop", grub_cmd_iotrace_stop,
+				    0, N_("Stop recording the disk reads."));
+  cmd_save = grub_register_command ("iotrace_save", grub_cmd_iotrace_save,
+				    N_("FILE"),
+				    N_("Write the disk trace over an existing"
+				       " file."));
+}
+
+GRUB_MOD_FINI(iotrace)
+{
+  grub_disk_trace_hook = 0;
+  grub_free (records);
+  records = 0;
+  grub_unregister_extcmd (cmd_start);
+  grub_unregister_command (cmd_stop);
+  grub_unregister_command (cmd_save);
+}
@@ -292,12 +292,15 @@ grub_cmd_save_env (grub_extcmd_context_t ctxt, int argc, char **args)
   struct blocklist *head = 0;
   struct blocklist *tail = 0;
 
-  /* Store blocklists in a linked list.  */
+  /* Store blocklists in a linked list, one entry per sector.  */
+  auto void NESTED_FUNC_ATTR save_sector (grub_disk_addr_t sector,
+                                          unsigned offset,
+                                          unsigned length);
   auto void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
                                         unsigned offset,
                                         unsigned length);
-  void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
-                                   unsigned offset, unsigned length)
+  void NESTED_FUNC_ATTR save_sector (grub_disk_addr_t sector,
+                                     unsigned offset, unsigned length)
     {
       struct blocklist *block;
 
@@ -322,6 +325,12 @@ grub_cmd_save_env (grub_extcmd_context_t ctxt, int argc, char **args)
         head = block;
     }
 
+  void NESTED_FUNC_ATTR read_hook (grub_disk_addr_t sector,
+                                   unsigned offset, unsigned length)
+    {
+      grub_disk_read_hook_sectors (sector, offset, length, save_sector);
+    }
+
   if (! argc)
     return grub_error (GRUB_ERR_BAD_ARGUMENT, "no variable is specified");
 
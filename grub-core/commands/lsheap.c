@@ -0,0 +1,315 @@
+/* lsheap.c - command to show the heap usage  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define DEFAULT_SITES	10
+
+static const struct grub_arg_option options[] =
+  {
+    {"start", 's', 0, N_("Start recording the allocation sites."), 0, 0},
+    {"stop", 'S', 0, N_("Stop recording the allocation sites."), 0, 0},
+    {"reset", 'r', 0, N_("Reset the peak and the allocation counts."), 0, 0},
+    {"sites", 'n', 0, N_("Show the NUM sites using the most memory."),
+     N_("NUM"), ARG_TYPE_INT},
+    {"dump", 'd', 0, N_("Print one record per line, for scripts."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+enum options
+  {
+    LSHEAP_START,
+    LSHEAP_STOP,
+    LSHEAP_RESET,
+    LSHEAP_SITES,
+    LSHEAP_DUMP
+  };
+
+/* The state of the iteration over the sites.  */
+static grub_dl_t cur_mod;
+static grub_size_t mod_live, mod_blocks, mod_allocs;
+static const struct grub_mm_site **top;
+static unsigned ntop, max_top;
+static int dump;
+
+/* Return the module which the code at ADDR belongs to, or NULL for the
+   kernel, and set *OFFSET to the offset of ADDR in the module's segment,
+   or to ADDR itself for the kernel, which is linked at a fixed address.
+   The sites in unloaded modules can't be told from the kernel ones.  */
+static grub_dl_t
+site_owner (const void *addr, grub_addr_t *offset)
+{
+  grub_dl_t mod;
+
+  FOR_DL_MODULES (mod)
+  {
+    grub_dl_segment_t seg;
+
+    for (seg = mod->segment; seg; seg = seg->next)
+      if ((grub_addr_t) addr >= (grub_addr_t) seg->addr
+	  && (grub_addr_t) addr < (grub_addr_t) seg->addr + seg->size)
+	{
+	  *offset = (grub_addr_t) addr - (grub_addr_t) seg->addr;
+	  return mod;
+	}
+  }
+
+  *offset = (grub_addr_t) addr;
+  return 0;
+}
+
+static void
+print_site (const struct grub_mm_site *site)
+{
+  grub_dl_t mod;
+  grub_addr_t offset;
+  const char *name;
+
+  if (! site->addr)
+    {
+      if (dump)
+	grub_printf ("site - 0 ");
+      else
+	grub_printf ("  %-24s", _("unattributed"));
+    }
+  else
+    {
+      mod = site_owner (site->addr, &offset);
+      name = mod ? mod->name : "kernel";
+      if (dump)
+	grub_printf ("site %s 0x%llx ", name, (unsigned long long) offset);
+      else
+	{
+	  char buf[48];
+
+	  if (mod)
+	    grub_snprintf (buf, sizeof (buf), "%s+0x%llx", name,
+			   (unsigned long long) offset);
+	  else
+	    grub_snprintf (buf, sizeof (buf), "0x%llx",
+			   (unsigned long long) offset);
+	  grub_printf ("  %-24s", buf);
+	}
+    }
+
+  if (dump)
+    grub_printf ("%llu %llu %llu\n", (unsigned long long) site->live,
+		 (unsigned long long) site->blocks,
+		 (unsigned long long) site->allocs);
+  else
+    grub_printf_ (N_(" %llu bytes in %llu blocks, %llu allocations\n"),
+		  (unsigned long long) site->live,
+		  (unsigned long long) site->blocks,
+		  (unsigned long long) site->allocs);
+}
+
+/* Add up the sites of the module CUR_MOD, or of the kernel if it's NULL.  */
+static int
+sum_module (const struct grub_mm_site *site)
+{
+  grub_addr_t offset;
+
+  if (! site->addr)
+    return 0;
+  if (site_owner (site->addr, &offset) != cur_mod)
+    return 0;
+
+  mod_live += site->live;
+  mod_blocks += site->blocks;
+  mod_allocs += site->allocs;
+  return 0;
+}
+
+static void
+print_module (const char *name)
+{
+  if (! mod_allocs && ! mod_blocks)
+    return;
+
+  if (dump)
+    grub_printf ("module %s %llu %llu %llu\n", name,
+		 (unsigned long long) mod_live,
+		 (unsigned long long) mod_blocks,
+		 (unsigned long long) mod_allocs);
+  else
+    grub_printf_ (N_("  %-24s %llu bytes in %llu blocks, %llu allocations\n"),
+		  name, (unsigned long long) mod_live,
+		  (unsigned long long) mod_blocks,
+		  (unsigned long long) mod_allocs);
+}
+
+/* Keep the MAX_TOP sites with the most live bytes in TOP, sorted.  */
+static int
+collect_top (const struct grub_mm_site *site)
+{
+  unsigned i;
+
+  if (! site->blocks)
+    return 0;
+
+  if (ntop == max_top)
+    {
+      if (top[ntop - 1]->live >= site->live)
+	return 0;
+      ntop--;
+    }
+
+  for (i = ntop; i > 0 && top[i - 1]->live < site->live; i--)
+    top[i] = top[i - 1];
+  top[i] = site;
+  ntop++;
+
+  return 0;
+}
+
+static int
+print_each_site (const struct grub_mm_site *site)
+{
+  if (site->blocks || site->allocs)
+    print_site (site);
+  return 0;
+}
+
+static void
+print_size (const char *fmt, grub_size_t size)
+{
+  if (size < 1024)
+    grub_printf ("%s%llu B", fmt, (unsigned long long) size);
+  else if (size < 1024 * 1024)
+    grub_printf ("%s%llu KiB", fmt, (unsigned long long) size >> 10);
+  else
+    grub_printf ("%s%llu MiB", fmt, (unsigned long long) size >> 20);
+}
+
+static grub_err_t
+grub_cmd_lsheap (grub_extcmd_context_t ctxt,
+		 int argc __attribute__ ((unused)),
+		 char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  struct grub_mm_stats stats;
+  grub_dl_t mod;
+  unsigned i;
+
+  if (state[LSHEAP_STOP].set)
+    grub_mm_profile_stop ();
+  if (state[LSHEAP_START].set && grub_mm_profile_start ())
+    return grub_errno;
+
+  max_top = DEFAULT_SITES;
+  if (state[LSHEAP_SITES].set)
+    max_top = grub_strtoul (state[LSHEAP_SITES].arg, 0, 0);
+  if (grub_errno)
+    return grub_errno;
+  dump = state[LSHEAP_DUMP].set;
+
+  grub_mm_get_stats (&stats);
+
+  if (dump)
+    {
+      grub_printf ("heap %llu %llu %llu %llu %llu\n",
+		   (unsigned long long) stats.in_use,
+		   (unsigned long long) stats.peak,
+		   (unsigned long long) stats.free,
+		   (unsigned long long) stats.free_blocks,
+		   (unsigned long long) stats.largest_free);
+      for (i = 0; i < GRUB_MM_STATS_BUCKETS; i++)
+	grub_printf ("free %llu %llu\n",
+		     i ? (unsigned long long) 32 << i : 0ULL,
+		     (unsigned long long) stats.free_hist[i]);
+    }
+  else
+    {
+      grub_printf_ (N_("In use: %llu bytes, peak %llu bytes\n"),
+		    (unsigned long long) stats.in_use,
+		    (unsigned long long) stats.peak);
+      grub_printf_ (N_("Free: %llu bytes in %llu blocks, largest %llu bytes\n"),
+		    (unsigned long long) stats.free,
+		    (unsigned long long) stats.free_blocks,
+		    (unsigned long long) stats.largest_free);
+      grub_printf ("%s\n", _("Free blocks by size:"));
+      for (i = 0; i < GRUB_MM_STATS_BUCKETS; i++)
+	{
+	  if (! stats.free_hist[i])
+	    continue;
+	  print_size (i ? "  >= " : "  < ", i ? (grub_size_t) 32 << i : 64);
+	  grub_printf (": %llu\n", (unsigned long long) stats.free_hist[i]);
+	}
+      grub_printf ("%s %s\n", _("Heap profiler:"),
+		   stats.profiling ? _("running") : _("stopped"));
+    }
+
+  /* Per module.  */
+  if (! dump)
+    grub_printf ("%s\n", _("Modules:"));
+  cur_mod = 0;
+  mod_live = mod_blocks = mod_allocs = 0;
+  grub_mm_profile_iterate (sum_module);
+  print_module ("kernel");
+  FOR_DL_MODULES (mod)
+  {
+    cur_mod = mod;
+    mod_live = mod_blocks = mod_allocs = 0;
+    grub_mm_profile_iterate (sum_module);
+    print_module (mod->name);
+  }
+
+  /* Per call site.  */
+  if (dump)
+    grub_mm_profile_iterate (print_each_site);
+  else if (max_top)
+    {
+      top = grub_malloc (max_top * sizeof (top[0]));
+      if (! top)
+	return grub_errno;
+      ntop = 0;
+      grub_mm_profile_iterate (collect_top);
+      grub_printf ("%s\n", _("Sites:"));
+      for (i = 0; i < ntop; i++)
+	print_site (top[i]);
+      grub_free (top);
+      top = 0;
+    }
+
+  if (state[LSHEAP_RESET].set)
+    grub_mm_profile_reset ();
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(lsheap)
+{
+  cmd = grub_register_extcmd ("lsheap", grub_cmd_lsheap, 0,
+			      N_("[-s|-S] [-r] [-n NUM] [-d]"),
+			      N_("Show the heap usage and where it goes."),
+			      options);
+}
+
+GRUB_MOD_FINI(lsheap)
+{
+  grub_unregister_extcmd (cmd);
+}
@@ -0,0 +1,165 @@
+/* modbundle.c - load a bundle of modules with a single read  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/file.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/command.h>
+#include <grub/modbundle.h>
+#include <grub/boottrace.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Check that the bundle BUF of SIZE bytes is well-formed, so that nothing
+   gets loaded from a damaged one.  */
+static grub_err_t
+check_bundle (const char *buf, grub_size_t size)
+{
+  const struct grub_modbundle_header *header;
+  const struct grub_modbundle_entry *entries;
+  grub_uint32_t i, n, offset, len;
+
+  header = (const struct grub_modbundle_header *) buf;
+  if (size < sizeof (*header)
+      || grub_memcmp (header->magic, GRUB_MODBUNDLE_MAGIC,
+		      sizeof (header->magic)) != 0)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "not a module bundle");
+  if (grub_le_to_cpu32 (header->version) != GRUB_MODBUNDLE_VERSION)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE,
+		       "unsupported module bundle version");
+
+  n = grub_le_to_cpu32 (header->nmodules);
+  if (n > (size - sizeof (*header)) / sizeof (entries[0]))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "module bundle is truncated");
+
+  entries = (const struct grub_modbundle_entry *) (header + 1);
+  for (i = 0; i < n; i++)
+    {
+      offset = grub_le_to_cpu32 (entries[i].offset);
+      len = grub_le_to_cpu32 (entries[i].size);
+      if (offset % GRUB_MODBUNDLE_ALIGN != 0
+	  || offset > size || len > size - offset
+	  || grub_memchr (entries[i].name, 0,
+			  GRUB_MODBUNDLE_NAME_SIZE) == 0)
+	return grub_error (GRUB_ERR_BAD_FILE_TYPE,
+			   "invalid module bundle entry %u", i);
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Load the modules of the bundle FILENAME which aren't loaded yet.  The
+   bundle is read at once, and since every module comes after the ones it
+   depends on, grub_dl_load_core finds its dependencies already loaded
+   instead of opening their files.  */
+static grub_err_t
+load_bundle (const char *filename)
+{
+  const struct grub_modbundle_header *header;
+  const struct grub_modbundle_entry *entry;
+  grub_file_t file;
+  grub_ssize_t size;
+  grub_uint32_t i, n;
+  grub_dl_t mod;
+  char *buf;
+  int span;
+
+  file = grub_file_open (filename);
+  if (! file)
+    return grub_errno;
+
+  size = grub_file_size (file);
+  buf = grub_malloc (size);
+  if (! buf)
+    {
+      grub_file_close (file);
+      return grub_errno;
+    }
+
+  if (grub_file_read (file, buf, size) != size)
+    {
+      grub_file_close (file);
+      grub_free (buf);
+      if (! grub_errno)
+	grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+		    filename);
+      return grub_errno;
+    }
+
+  /* Like grub_dl_load_file, close it before the modules use the disks.  */
+  grub_file_close (file);
+
+  if (check_bundle (buf, size))
+    {
+      grub_free (buf);
+      return grub_errno;
+    }
+
+  header = (const struct grub_modbundle_header *) buf;
+  entry = (const struct grub_modbundle_entry *) (header + 1);
+  n = grub_le_to_cpu32 (header->nmodules);
+  for (i = 0; i < n; i++, entry++)
+    {
+      if (grub_dl_get (entry->name))
+	continue;
+
+      span = grub_boottrace_begin ("insmod", "%s", entry->name);
+      mod = grub_dl_load_core (buf + grub_le_to_cpu32 (entry->offset),
+			       grub_le_to_cpu32 (entry->size));
+      grub_boottrace_end (span);
+      if (! mod)
+	break;
+      mod->ref_count--;
+
+      if (grub_strcmp (mod->name, entry->name) != 0)
+	{
+	  grub_error (GRUB_ERR_BAD_MODULE, "mismatched names");
+	  break;
+	}
+    }
+
+  grub_free (buf);
+  return grub_errno;
+}
+
+static grub_err_t
+grub_cmd_load_bundle (grub_command_t cmd __attribute__ ((unused)),
+		      int argc, char **args)
+{
+  if (argc != 1)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+
+  return load_bundle (args[0]);
+}
+
+static grub_command_t cmd;
+
+GRUB_MOD_INIT(modbundle)
+{
+  cmd = grub_register_command ("load_bundle", grub_cmd_load_bundle,
+			       N_("FILE"),
+			       N_("Load the modules of a module bundle."));
+}
+
+GRUB_MOD_FINI(modbundle)
+{
+  grub_unregister_command (cmd);
+}
@@ -469,9 +469,19 @@ grub_diskfilter_close (grub_disk_t disk __attribute ((unused)))
   return;
 }
 
+/* Reads from the physical volumes of striped segments, queued so that all
+   those going to the same disk are handed to it in one vectored read.  */
+struct read_batch
+{
+  grub_disk_t *disks;
+  struct grub_disk_vec *vec;
+  unsigned count;
+  unsigned alloc;
+};
+
 static grub_err_t
 read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
-	 grub_size_t size, char *buf);
+	 grub_size_t size, char *buf, struct read_batch *batch);
 
 grub_err_t
 grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
@@ -492,21 +502,112 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
 
     }
   if (node->lv)
-    return read_lv (node->lv, sector + node->start, size, buf);
+    return read_lv (node->lv, sector + node->start, size, buf, 0);
   return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "unknown node '%s'", node->name);
 }
 
+/* Like grub_diskfilter_read_node, but queue reads from physical volumes
+   in BATCH if it isn't NULL.  */
+static grub_err_t
+read_node_batched (const struct grub_diskfilter_node *node,
+		   grub_disk_addr_t sector, grub_size_t size, char *buf,
+		   struct read_batch *batch)
+{
+  if (! batch)
+    return grub_diskfilter_read_node (node, sector, size, buf);
+
+  if (node->lv)
+    return read_lv (node->lv, sector + node->start, size, buf, batch);
+
+  if (! node->pv || ! node->pv->disk)
+    return grub_diskfilter_read_node (node, sector, size, buf);
+
+  if (batch->count == batch->alloc)
+    {
+      unsigned alloc = batch->alloc ? batch->alloc * 2 : 16;
+      grub_disk_t *disks;
+      struct grub_disk_vec *vec;
+
+      disks = grub_realloc (batch->disks, alloc * sizeof (disks[0]));
+      if (disks)
+	batch->disks = disks;
+      vec = disks ? grub_realloc (batch->vec, alloc * sizeof (vec[0])) : 0;
+      if (! vec)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return grub_diskfilter_read_node (node, sector, size, buf);
+	}
+      batch->vec = vec;
+      batch->alloc = alloc;
+    }
+
+  batch->disks[batch->count] = node->pv->disk;
+  batch->vec[batch->count].sector = (sector + node->start
+				     + node->pv->start_sector);
+  batch->vec[batch->count].offset = 0;
+  batch->vec[batch->count].size = size << GRUB_DISK_SECTOR_BITS;
+  batch->vec[batch->count].buf = buf;
+  batch->count++;
+  return GRUB_ERR_NONE;
+}
+
+/* Issue the reads queued in BATCH, one vectored read per disk, and free
+   it.  */
+static grub_err_t
+flush_batch (struct read_batch *batch)
+{
+  struct grub_disk_vec *vec;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned i, j, n;
+
+  vec = batch->count ? grub_malloc (batch->count * sizeof (vec[0])) : 0;
+
+  for (i = 0; i < batch->count && ! err; i++)
+    {
+      grub_disk_t disk = batch->disks[i];
+
+      if (! disk)
+	continue;
+
+      if (! vec)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  err = grub_disk_read_vec (disk, batch->vec + i, 1);
+	  continue;
+	}
+
+      for (j = i, n = 0; j < batch->count; j++)
+	if (batch->disks[j] == disk)
+	  {
+	    vec[n++] = batch->vec[j];
+	    batch->disks[j] = 0;
+	  }
+      err = grub_disk_read_vec (disk, vec, n);
+    }
+
+  grub_free (vec);
+  grub_free (batch->disks);
+  grub_free (batch->vec);
+  return err;
+}
+
+/* Read SIZE sectors at SECTOR of SEG.  Striped segments have no redundancy
+   to fall back on after a read error, so their reads may be queued in
+   BATCH.  */
 static grub_err_t
 read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
-	      grub_size_t size, char *buf)
+	      grub_size_t size, char *buf, struct read_batch *batch)
 {
   grub_err_t err;
+
+  if (seg->type != GRUB_DISKFILTER_STRIPED)
+    batch = 0;
+
   switch (seg->type)
     {
     case GRUB_DISKFILTER_STRIPED:
       if (seg->node_count == 1)
-	return grub_diskfilter_read_node (&seg->nodes[0],
-					  sector, size, buf);
+	return read_node_batched (&seg->nodes[0], sector, size, buf, batch);
     case GRUB_DISKFILTER_MIRROR:
     case GRUB_DISKFILTER_RAID10:
       {
@@ -564,11 +665,9 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 			|| grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
 		      grub_errno = GRUB_ERR_NONE;
 
-		    err = grub_diskfilter_read_node (&seg->nodes[k],
-						     read_sector
-						     + j * far_ofs + b,
-						     read_size,
-						     buf);
+		    err = read_node_batched (&seg->nodes[k],
+					     read_sector + j * far_ofs + b,
+					     read_size, buf, batch);
 		    if (! err)
 		      break;
 		    else if (err != GRUB_ERR_READ_ERROR
@@ -773,7 +872,7 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 
 static grub_err_t
 read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
-	 grub_size_t size, char *buf)
+	 grub_size_t size, char *buf, struct read_batch *batch)
 {
   if (!lv)
     return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "unknown volume");
@@ -807,7 +906,7 @@ read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
 	to_read = size;
 
       err = read_segment (seg, sector - seg->start_extent * vg->extent_size,
-			  to_read, buf);
+			  to_read, buf, batch);
       if (err)
 	return err;
 
@@ -822,7 +921,37 @@ static grub_err_t
 grub_diskfilter_read (grub_disk_t disk, grub_disk_addr_t sector,
 		      grub_size_t size, char *buf)
 {
-  return read_lv (disk->data, sector, size, buf);
+  struct read_batch batch = { 0, 0, 0, 0 };
+  grub_err_t err;
+
+  err = read_lv (disk->data, sector, size, buf, &batch);
+  if (err)
+    {
+      grub_free (batch.disks);
+      grub_free (batch.vec);
+      return err;
+    }
+  return flush_batch (&batch);
+}
+
+static grub_err_t
+grub_diskfilter_read_vec (grub_disk_t disk, struct grub_disk_vec *vec,
+			  unsigned nvec)
+{
+  struct read_batch batch = { 0, 0, 0, 0 };
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned i;
+
+  for (i = 0; i < nvec && ! err; i++)
+    err = read_lv (disk->data, vec[i].sector,
+		   vec[i].size >> GRUB_DISK_SECTOR_BITS, vec[i].buf, &batch);
+  if (err)
+    {
+      grub_free (batch.disks);
+      grub_free (batch.vec);
+      return err;
+    }
+  return flush_batch (&batch);
 }
 
 static grub_err_t
@@ -1192,6 +1321,7 @@ static struct grub_disk_dev grub_diskfilter_dev =
     .close = grub_diskfilter_close,
     .read = grub_diskfilter_read,
     .write = grub_diskfilter_write,
+    .read_vec = grub_diskfilter_read_vec,
 #ifdef GRUB_UTIL
     .memberlist = grub_diskfilter_memberlist,
     .raidname = grub_diskfilter_getname,
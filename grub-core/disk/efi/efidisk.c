@@ -558,6 +558,16 @@ grub_efidisk_read (struct grub_disk *disk, grub_disk_addr_t sector,
 		       (grub_efi_uint64_t) sector,
 		       (grub_efi_uintn_t) size << disk->log_sector_size,
 		       buf);
+  if (status == GRUB_EFI_MEDIA_CHANGED)
+    {
+      /* Whatever was cached came from the old medium.  The firmware has
+	 updated the media id by now, so try once more.  */
+      grub_disk_media_changed (disk);
+      status = efi_call_5 (bio->read_blocks, bio, bio->media->media_id,
+			   (grub_efi_uint64_t) sector,
+			   (grub_efi_uintn_t) size << disk->log_sector_size,
+			   buf);
+    }
   if (status != GRUB_EFI_SUCCESS)
     return grub_error (GRUB_ERR_READ_ERROR,
 		       N_("failure reading sector 0x%llx from `%s'"),
@@ -468,8 +468,15 @@ grub_biosdisk_rw (int cmd, grub_disk_t disk,
 	    return grub_error (GRUB_ERR_WRITE_ERROR, N_("cannot write to CD-ROM"));
 
 	  for (i = 0; i < GRUB_BIOSDISK_CDROM_RETRY_COUNT; i++)
-            if (! grub_biosdisk_rw_int13_extensions (0x42, data->drive, dap))
-	      break;
+	    {
+	      int ret;
+
+	      ret = grub_biosdisk_rw_int13_extensions (0x42, data->drive, dap);
+	      if (! ret)
+		break;
+	      if (ret == GRUB_BIOSDISK_STATUS_MEDIA_CHANGED)
+		grub_disk_media_changed (disk);
+	    }
 
 	  if (i == GRUB_BIOSDISK_CDROM_RETRY_COUNT)
 	    return grub_error (GRUB_ERR_READ_ERROR, N_("failure reading sector 0x%llx "
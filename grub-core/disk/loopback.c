@@ -31,6 +31,7 @@ struct grub_loopback
 {
   char *devname;
   grub_file_t file;
+  unsigned log_sector_size;
   struct grub_loopback *next;
 };
 
@@ -41,6 +42,8 @@ static const struct grub_arg_option options[] =
     /* TRANSLATORS: The disk is simply removed from the list of available ones,
        not wiped, avoid to scare user.  */
     {"delete", 'd', 0, N_("Delete the specified loopback drive."), 0, 0},
+    {"sector-size", 's', 0, N_("Use sectors of SIZE bytes."), N_("SIZE"),
+     ARG_TYPE_INT},
     {0, 0, 0, 0, 0, 0}
   };
 
@@ -64,6 +67,10 @@ delete_loopback (const char *name)
   /* Remove the device from the list.  */
   *prev = dev->next;
 
+  /* A later device may be allocated at the same address and so get the
+     same id: don't let it see the cached data of this one.  */
+  grub_disk_device_changed (GRUB_DISK_DEVICE_LOOPBACK_ID, (unsigned long) dev);
+
   grub_free (dev->devname);
   grub_file_close (dev->file);
   grub_free (dev);
@@ -79,6 +86,7 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
   grub_file_t file;
   struct grub_loopback *newdev;
   grub_err_t ret;
+  unsigned log_sector_size = GRUB_DISK_SECTOR_BITS;
 
   if (argc < 1)
     return grub_error (GRUB_ERR_BAD_ARGUMENT, "device name required");
@@ -90,6 +98,20 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
   if (argc < 2)
     return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
 
+  if (state[1].set)
+    {
+      unsigned long sector_size = grub_strtoul (state[1].arg, 0, 0);
+
+      if (grub_errno)
+	return grub_errno;
+      while ((1UL << log_sector_size) < sector_size
+	     && log_sector_size < GRUB_DISK_MAX_SECTOR_BITS)
+	log_sector_size++;
+      if ((1UL << log_sector_size) != sector_size)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "invalid sector size %lu", sector_size);
+    }
+
   file = grub_file_open (args[1]);
   if (! file)
     return grub_errno;
@@ -103,6 +125,11 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
     {
       grub_file_close (newdev->file);
       newdev->file = file;
+      newdev->log_sector_size = log_sector_size;
+      /* The id stays the same, so the cached data of the old file and
+	 the old sector size must be dropped.  */
+      grub_disk_device_changed (GRUB_DISK_DEVICE_LOOPBACK_ID,
+				(unsigned long) newdev);
 
       return 0;
     }
@@ -120,6 +147,7 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
     }
 
   newdev->file = file;
+  newdev->log_sector_size = log_sector_size;
 
   /* Add the new entry to the list.  */
   newdev->next = loopback_list;
@@ -161,10 +189,13 @@ grub_loopback_open (const char *name, grub_disk_t disk)
   if (! dev)
     return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "can't open device");
 
+  disk->log_sector_size = dev->log_sector_size;
+
   /* Use the filesize for the disk size, round up to a complete sector.  */
   if (dev->file->size != GRUB_FILE_SIZE_UNKNOWN)
-    disk->total_sectors = ((dev->file->size + GRUB_DISK_SECTOR_SIZE - 1)
-			   / GRUB_DISK_SECTOR_SIZE);
+    disk->total_sectors = ((dev->file->size
+			    + (1ULL << dev->log_sector_size) - 1)
+			   >> dev->log_sector_size);
   else
     disk->total_sectors = GRUB_DISK_SIZE_UNKNOWN;
   disk->id = (unsigned long) dev;
@@ -181,20 +212,20 @@ grub_loopback_read (grub_disk_t disk, grub_disk_addr_t sector,
   grub_file_t file = ((struct grub_loopback *) disk->data)->file;
   grub_off_t pos;
 
-  grub_file_seek (file, sector << GRUB_DISK_SECTOR_BITS);
+  grub_file_seek (file, sector << disk->log_sector_size);
 
-  grub_file_read (file, buf, size << GRUB_DISK_SECTOR_BITS);
+  grub_file_read (file, buf, size << disk->log_sector_size);
   if (grub_errno)
     return grub_errno;
 
   /* In case there is more data read than there is available, in case
-     of files that are not a multiple of GRUB_DISK_SECTOR_SIZE, fill
-     the rest with zeros.  */
-  pos = (sector + size) << GRUB_DISK_SECTOR_BITS;
+     of files that are not a multiple of the sector size, fill the rest
+     with zeros.  */
+  pos = (sector + size) << disk->log_sector_size;
   if (pos > file->size)
     {
       grub_size_t amount = pos - file->size;
-      grub_memset (buf + (size << GRUB_DISK_SECTOR_BITS) - amount, 0, amount);
+      grub_memset (buf + (size << disk->log_sector_size) - amount, 0, amount);
     }
 
   return 0;
@@ -225,7 +256,7 @@ static grub_extcmd_t cmd;
 GRUB_MOD_INIT(loopback)
 {
   cmd = grub_register_extcmd ("loopback", grub_cmd_loopback, 0,
-			      N_("[-d] DEVICENAME FILE."),
+			      N_("[-d] [-s SIZE] DEVICENAME FILE."),
 			      /* TRANSLATORS: The file itself is not destroyed
 				 or transformed into drive.  */
 			      N_("Make a virtual drive from a file."), options);
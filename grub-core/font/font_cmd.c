@@ -22,6 +22,7 @@
 #include <grub/misc.h>
 #include <grub/command.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 static grub_err_t
 loadfont_command (grub_command_t cmd __attribute__ ((unused)),
@@ -32,12 +33,19 @@ loadfont_command (grub_command_t cmd __attribute__ ((unused)),
     return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
 
   while (argc--)
-    if (grub_font_load (*args++) != 0)
-      {
-	if (!grub_errno)
-	  return grub_error (GRUB_ERR_BAD_FONT, "invalid font");
-	return grub_errno;
-      }
+    {
+      int span, err;
+
+      span = grub_boottrace_begin ("font", "%s", *args);
+      err = grub_font_load (*args++);
+      grub_boottrace_end (span);
+      if (err != 0)
+	{
+	  if (!grub_errno)
+	    return grub_error (GRUB_ERR_BAD_FONT, "invalid font");
+	  return grub_errno;
+	}
+    }
 
   return GRUB_ERR_NONE;
 }
@@ -676,9 +676,16 @@ grub_affs_mtime (grub_device_t device, grub_int32_t *t)
 }
 
 
+static const struct grub_fs_signature grub_affs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (0, "DOS"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_affs_fs =
   {
     .name = "affs",
+    .signatures = grub_affs_signatures,
     .dir = grub_affs_dir,
     .open = grub_affs_open,
     .read = grub_affs_read,
@@ -1078,12 +1078,23 @@ grub_bfs_uuid (grub_device_t device, char **uuid)
 }
 #endif
 
+static const struct grub_fs_signature grub_bfs_signatures[] =
+  {
+#ifdef MODE_AFS
+    GRUB_FS_SIGNATURE (1056, "1SFA"),
+#else
+    GRUB_FS_SIGNATURE (544, "1SFB"),
+#endif
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_bfs_fs = {
 #ifdef MODE_AFS
   .name = "afs",
 #else
   .name = "bfs",
 #endif
+  .signatures = grub_bfs_signatures,
   .dir = grub_bfs_dir,
   .open = grub_bfs_open,
   .read = grub_bfs_read,
@@ -27,7 +27,9 @@
 #include <grub/lib/crc.h>
 #include <grub/deflate.h>
 #include <minilzo.h>
+#include <zstd.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -85,6 +87,8 @@ struct grub_btrfs_device_desc
 {
   grub_device_t dev;
   grub_uint64_t id;
+  /* The generation of the disk when it was attached.  */
+  unsigned long generation;
 };
 
 struct grub_btrfs_data
@@ -236,6 +240,7 @@ struct grub_btrfs_extent_data
 #define GRUB_BTRFS_COMPRESSION_NONE 0
 #define GRUB_BTRFS_COMPRESSION_ZLIB 1
 #define GRUB_BTRFS_COMPRESSION_LZO  2
+#define GRUB_BTRFS_COMPRESSION_ZSTD 3
 
 #define GRUB_BTRFS_OBJECT_ID_CHUNK 0x100
 
@@ -246,7 +251,7 @@ static grub_disk_addr_t superblock_sectors[] = { 64 * 2, 64 * 1024 * 2,
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data,
 			 grub_disk_addr_t addr, void *buf, grub_size_t size,
-			 int recursion_depth);
+			 int recursion_depth, int pin);
 
 static grub_err_t
 read_sblock (grub_disk_t disk, struct grub_btrfs_superblock *sb)
@@ -357,12 +362,12 @@ next (struct grub_btrfs_data *data,
 				     * sizeof (node)
 				     + sizeof (struct btrfs_header)
 				     + desc->data[desc->depth - 1].addr,
-				     &node, sizeof (node), 0);
+				     &node, sizeof (node), 0, 1);
       if (err)
 	return -err;
 
       err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (node.addr),
-				     &head, sizeof (head), 0);
+				     &head, sizeof (head), 0, 1);
       if (err)
 	return -err;
 
@@ -373,7 +378,7 @@ next (struct grub_btrfs_data *data,
 				 * sizeof (leaf)
 				 + sizeof (struct btrfs_header)
 				 + desc->data[desc->depth - 1].addr, &leaf,
-				 sizeof (leaf), 0);
+				 sizeof (leaf), 0, 1);
   if (err)
     return -err;
   *outsize = grub_le_to_cpu32 (leaf.size);
@@ -423,7 +428,7 @@ lower_bound (struct grub_btrfs_data *data,
       depth++;
       /* FIXME: preread few nodes into buffer. */
       err = grub_btrfs_read_logical (data, addr, &head, sizeof (head),
-				     recursion_depth + 1);
+				     recursion_depth + 1, 1);
       if (err)
 	return err;
       addr += sizeof (head);
@@ -437,7 +442,7 @@ lower_bound (struct grub_btrfs_data *data,
 	    {
 	      err = grub_btrfs_read_logical (data, addr + i * sizeof (node),
 					     &node, sizeof (node),
-					     recursion_depth + 1);
+					     recursion_depth + 1, 1);
 	      if (err)
 		return err;
 
@@ -490,7 +495,7 @@ lower_bound (struct grub_btrfs_data *data,
 	  {
 	    err = grub_btrfs_read_logical (data, addr + i * sizeof (leaf),
 					   &leaf, sizeof (leaf),
-					   recursion_depth + 1);
+					   recursion_depth + 1, 1);
 	    if (err)
 	      return err;
 
@@ -612,12 +617,15 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
     }
   data->devices_attached[data->n_devices_attached - 1].id = id;
   data->devices_attached[data->n_devices_attached - 1].dev = dev_found;
+  data->devices_attached[data->n_devices_attached - 1].generation
+    = grub_disk_get_generation (dev_found->disk);
   return dev_found;
 }
 
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
-			 void *buf, grub_size_t size, int recursion_depth)
+			 void *buf, grub_size_t size, int recursion_depth,
+			 int pin)
 {
   while (size > 0)
     {
@@ -677,7 +685,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 
       challoc = 1;
       err = grub_btrfs_read_logical (data, chaddr, chunk, chsize,
-				     recursion_depth);
+				     recursion_depth, 1);
       if (err)
 	{
 	  grub_free (chunk);
@@ -817,9 +825,16 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		    continue;
 		  }
 
-		err = grub_disk_read (dev->disk, paddr >> GRUB_DISK_SECTOR_BITS,
-				      paddr & (GRUB_DISK_SECTOR_SIZE - 1),
-				      csize, buf);
+		if (pin)
+		  err = grub_disk_read_pinned (dev->disk,
+					       paddr >> GRUB_DISK_SECTOR_BITS,
+					       paddr & (GRUB_DISK_SECTOR_SIZE - 1),
+					       csize, buf);
+		else
+		  err = grub_disk_read (dev->disk,
+					paddr >> GRUB_DISK_SECTOR_BITS,
+					paddr & (GRUB_DISK_SECTOR_SIZE - 1),
+					csize, buf);
 		if (!err)
 		  break;
 		grub_errno = GRUB_ERR_NONE;
@@ -839,11 +854,14 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
   return GRUB_ERR_NONE;
 }
 
+static struct grub_fs grub_btrfs_fs;
+
 static struct grub_btrfs_data *
 grub_btrfs_mount (grub_device_t dev)
 {
   struct grub_btrfs_data *data;
   grub_err_t err;
+  int span;
 
   if (!dev->disk)
     {
@@ -851,11 +869,38 @@ grub_btrfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  /* The extent cache stays valid too, unless another member device has
+     changed since.  The mount cache only checks the device 0.  */
+  data = grub_fs_mount_cache_get (&grub_btrfs_fs, dev->disk);
+  if (data)
+    {
+      unsigned i;
+
+      data->devices_attached[0].dev = dev;
+      for (i = 1; i < data->n_devices_attached; i++)
+	if (grub_disk_get_generation (data->devices_attached[i].dev->disk)
+	    != data->devices_attached[i].generation)
+	  break;
+      if (i < data->n_devices_attached)
+	{
+	  grub_dprintf ("btrfs", "member device changed, detaching\n");
+	  for (i = 1; i < data->n_devices_attached; i++)
+	    grub_device_close (data->devices_attached[i].dev);
+	  data->n_devices_attached = 1;
+	  grub_free (data->extent);
+	  data->extent = 0;
+	}
+      return data;
+    }
+
   data = grub_zalloc (sizeof (*data));
   if (!data)
     return NULL;
 
+  span = grub_boottrace_begin ("mount", "%s %s", grub_btrfs_fs.name,
+			       dev->disk->name);
   err = read_sblock (dev->disk, &data->sblock);
+  grub_boottrace_end (span);
   if (err)
     {
       grub_free (data);
@@ -873,6 +918,9 @@ grub_btrfs_mount (grub_device_t dev)
   data->n_devices_attached = 1;
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
+  data->devices_attached[0].generation = grub_disk_get_generation (dev->disk);
+
+  grub_fs_mount_cache_add (&grub_btrfs_fs, dev->disk, data);
 
   return data;
 }
@@ -880,6 +928,15 @@ grub_btrfs_mount (grub_device_t dev)
 static void
 grub_btrfs_unmount (struct grub_btrfs_data *data)
 {
+  grub_fs_mount_cache_put (&grub_btrfs_fs, data);
+}
+
+/* Free DATA for good, once it leaves the mount cache.  The other member
+   devices stay open as long as DATA is cached.  */
+static void
+grub_btrfs_free (void *ptr)
+{
+  struct grub_btrfs_data *data = ptr;
   unsigned i;
   /* The device 0 is closed one layer upper.  */
   for (i = 1; i < data->n_devices_attached; i++)
@@ -911,7 +968,7 @@ grub_btrfs_read_inode (struct grub_btrfs_data *data,
       || key_out.type != GRUB_BTRFS_ITEM_TYPE_INODE_ITEM)
     return grub_error (GRUB_ERR_BAD_FS, "inode not found");
 
-  return grub_btrfs_read_logical (data, elemaddr, inode, sizeof (*inode), 0);
+  return grub_btrfs_read_logical (data, elemaddr, inode, sizeof (*inode), 0, 1);
 }
 
 static grub_ssize_t
@@ -998,6 +1055,68 @@ grub_btrfs_lzo_decompress(char *ibuf, grub_size_t isize, grub_off_t off,
   return ret;
 }
 
+/* A compressed extent holds a single zstd frame.  Its compressed size is
+   rounded up to a sector, so decompress with the streaming API, which
+   stops at the end of the frame.  */
+static grub_ssize_t
+grub_btrfs_zstd_decompress (char *ibuf, grub_size_t isize, grub_off_t off,
+			    char *obuf, grub_size_t osize)
+{
+  ZSTD_DStream *dstream;
+  ZSTD_inBuffer input;
+  ZSTD_outBuffer output;
+  char *tmp = 0;
+  grub_ssize_t ret = -1;
+
+  /* Decompress the data before OFF too, in a temporary buffer.  */
+  if (off)
+    {
+      tmp = grub_malloc (off + osize);
+      if (!tmp)
+	return -1;
+    }
+
+  dstream = ZSTD_createDStream ();
+  if (!dstream)
+    {
+      grub_free (tmp);
+      return -1;
+    }
+
+  input.src = ibuf;
+  input.size = isize;
+  input.pos = 0;
+  output.dst = tmp ? tmp : obuf;
+  output.size = off + osize;
+  output.pos = 0;
+
+  while (output.pos < output.size)
+    {
+      grub_size_t zret;
+
+      zret = ZSTD_decompressStream (dstream, &output, &input);
+      if (ZSTD_isError (zret))
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "zstd data corrupted: %s",
+		      ZSTD_getErrorName (zret));
+	  goto fail;
+	}
+      if (zret == 0 || input.pos == input.size)
+	break;
+    }
+
+  ret = 0;
+  if (output.pos > off)
+    ret = output.pos - off;
+  if (tmp)
+    grub_memcpy (obuf, tmp + off, ret);
+
+fail:
+  ZSTD_freeDStream (dstream);
+  grub_free (tmp);
+  return ret;
+}
+
 static grub_ssize_t
 grub_btrfs_extent_read (struct grub_btrfs_data *data,
 			grub_uint64_t ino, grub_uint64_t tree,
@@ -1045,7 +1164,7 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 	    return grub_errno;
 
 	  err = grub_btrfs_read_logical (data, elemaddr, data->extent,
-					 elemsize, 0);
+					 elemsize, 0, 1);
 	  if (err)
 	    return err;
 
@@ -1080,7 +1199,8 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 
       if (data->extent->compression != GRUB_BTRFS_COMPRESSION_NONE
 	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_ZLIB
-	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_LZO)
+	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_LZO
+	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_ZSTD)
 	{
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		      "compression type 0x%x not supported",
@@ -1115,6 +1235,15 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		  != (grub_ssize_t) csize)
 		return -1;
 	    }
+	  else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
+	    {
+	      if (grub_btrfs_zstd_decompress (data->extent->inl, data->extsize -
+					     ((grub_uint8_t *) data->extent->inl
+					      - (grub_uint8_t *) data->extent),
+					     extoff, buf, csize)
+		  != (grub_ssize_t) csize)
+		return -1;
+	    }
 	  else
 	    grub_memcpy (buf, data->extent->inl + extoff, csize);
 	  break;
@@ -1137,7 +1266,7 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		return -1;
 	      err = grub_btrfs_read_logical (data,
 					     grub_le_to_cpu64 (data->extent->laddr),
-					     tmp, zsize, 0);
+					     tmp, zsize, 0, 0);
 	      if (err)
 		{
 		  grub_free (tmp);
@@ -1152,6 +1281,10 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		ret = grub_btrfs_lzo_decompress (tmp, zsize, extoff
 				    + grub_le_to_cpu64 (data->extent->offset),
 				    buf, csize);
+	      else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
+		ret = grub_btrfs_zstd_decompress (tmp, zsize, extoff
+				    + grub_le_to_cpu64 (data->extent->offset),
+				    buf, csize);
 	      else
 		ret = -1;
 
@@ -1165,7 +1298,7 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 	  err = grub_btrfs_read_logical (data,
 					 grub_le_to_cpu64 (data->extent->laddr)
 					 + grub_le_to_cpu64 (data->extent->offset)
-					 + extoff, buf, csize, 0);
+					 + extoff, buf, csize, 0, 0);
 	  if (err)
 	    return -1;
 	  break;
@@ -1314,7 +1447,7 @@ find_path (struct grub_btrfs_data *data,
 	    }
 	}
 
-      err = grub_btrfs_read_logical (data, elemaddr, direl, elemsize, 0);
+      err = grub_btrfs_read_logical (data, elemaddr, direl, elemsize, 0, 1);
       if (err)
 	{
 	  grub_free (direl);
@@ -1432,7 +1565,7 @@ find_path (struct grub_btrfs_data *data,
 		return err;
 	      }
 	    err = grub_btrfs_read_logical (data, elemaddr, &ri,
-					   sizeof (ri), 0);
+					   sizeof (ri), 0, 1);
 	    if (err)
 	      {
 		grub_free (direl);
@@ -1541,7 +1674,7 @@ grub_btrfs_dir (grub_device_t device, const char *path,
 	    }
 	}
 
-      err = grub_btrfs_read_logical (data, elemaddr, direl, elemsize, 0);
+      err = grub_btrfs_read_logical (data, elemaddr, direl, elemsize, 0, 1);
       if (err)
 	{
 	  r = -err;
@@ -1719,14 +1852,22 @@ grub_btrfs_embed (grub_device_t device __attribute__ ((unused)),
 }
 #endif
 
+static const struct grub_fs_signature grub_btrfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (65600, "_BHRfS_M"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_btrfs_fs = {
   .name = "btrfs",
+  .signatures = grub_btrfs_signatures,
   .dir = grub_btrfs_dir,
   .open = grub_btrfs_open,
   .read = grub_btrfs_read,
   .close = grub_btrfs_close,
   .uuid = grub_btrfs_uuid,
   .label = grub_btrfs_label,
+  .free_mount = grub_btrfs_free,
 #ifdef GRUB_UTIL
   .embed = grub_btrfs_embed,
   .reserved_first_sector = 1,
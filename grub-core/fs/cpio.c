@@ -732,6 +732,23 @@ grub_cpio_close (grub_file_t file)
   return grub_errno;
 }
 
+static const struct grub_fs_signature grub_cpio_signatures[] =
+  {
+#ifdef MODE_USTAR
+    GRUB_FS_SIGNATURE (257, "ustar"),
+#elif defined (MODE_ODC)
+    GRUB_FS_SIGNATURE (0, "070707"),
+#elif defined (MODE_NEWC)
+    GRUB_FS_SIGNATURE (0, "070701"),
+    GRUB_FS_SIGNATURE (0, "070702"),
+#elif defined (MODE_BIGENDIAN)
+    GRUB_FS_SIGNATURE (0, "\x71\xc7"),
+#else
+    GRUB_FS_SIGNATURE (0, "\xc7\x71"),
+#endif
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_cpio_fs = {
 #ifdef MODE_USTAR
   .name = "tarfs",
@@ -742,6 +759,7 @@ static struct grub_fs grub_cpio_fs = {
 #else
   .name = "cpiofs",
 #endif
+  .signatures = grub_cpio_signatures,
   .dir = grub_cpio_dir,
   .open = grub_cpio_open,
   .read = grub_cpio_read,
@@ -46,6 +46,7 @@
 #include <grub/dl.h>
 #include <grub/types.h>
 #include <grub/fshelp.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -313,10 +314,13 @@ struct grub_ext2_data
   grub_disk_t disk;
   struct grub_ext2_inode *inode;
   struct grub_fshelp_node diropen;
+  struct grub_fshelp_dcache *dcache;
 };
 
 static grub_dl_t my_mod;
 
+static struct grub_fs grub_ext2_fs;
+
 
 
 /* Read into BLKGRP the blockgroup descriptor of blockgroup GROUP of
@@ -325,11 +329,11 @@ inline static grub_err_t
 grub_ext2_blockgroup (struct grub_ext2_data *data, int group,
 		      struct grub_ext2_block_group *blkgrp)
 {
-  return grub_disk_read (data->disk,
-                         ((grub_le_to_cpu32 (data->sblock.first_data_block) + 1)
-                          << LOG2_EXT2_BLOCK_SIZE (data)),
-			 group * sizeof (struct grub_ext2_block_group),
-			 sizeof (struct grub_ext2_block_group), blkgrp);
+  return grub_disk_read_pinned (data->disk,
+				((grub_le_to_cpu32 (data->sblock.first_data_block) + 1)
+				 << LOG2_EXT2_BLOCK_SIZE (data)),
+				group * sizeof (struct grub_ext2_block_group),
+				sizeof (struct grub_ext2_block_group), blkgrp);
 }
 
 static struct grub_ext4_extent_header *
@@ -363,9 +367,9 @@ grub_ext4_find_leaf (struct grub_ext2_data *data, grub_properly_aligned_t *buf,
 
       block = grub_le_to_cpu16 (index[i].leaf_hi);
       block = (block << 32) + grub_le_to_cpu32 (index[i].leaf);
-      if (grub_disk_read (data->disk,
-                          block << LOG2_EXT2_BLOCK_SIZE (data),
-                          0, EXT2_BLOCK_SIZE(data), buf))
+      if (grub_disk_read_pinned (data->disk,
+				 block << LOG2_EXT2_BLOCK_SIZE (data),
+				 0, EXT2_BLOCK_SIZE(data), buf))
         return 0;
 
       ext_block = (struct grub_ext4_extent_header *) buf;
@@ -381,50 +385,6 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   unsigned int blksz = EXT2_BLOCK_SIZE (data);
   int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
 
-  if (grub_le_to_cpu32(inode->flags) & EXT4_EXTENTS_FLAG)
-    {
-      GRUB_PROPERLY_ALIGNED_ARRAY (buf, EXT2_BLOCK_SIZE(data));
-      struct grub_ext4_extent_header *leaf;
-      struct grub_ext4_extent *ext;
-      int i;
-
-      leaf = grub_ext4_find_leaf (data, buf,
-                                  (struct grub_ext4_extent_header *) inode->blocks.dir_blocks,
-                                  fileblock);
-      if (! leaf)
-        {
-          grub_error (GRUB_ERR_BAD_FS, "invalid extent");
-          return -1;
-        }
-
-      ext = (struct grub_ext4_extent *) (leaf + 1);
-      for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
-        {
-          if (fileblock < grub_le_to_cpu32 (ext[i].block))
-            break;
-        }
-
-      if (--i >= 0)
-        {
-          fileblock -= grub_le_to_cpu32 (ext[i].block);
-          if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-            return 0;
-          else
-            {
-              grub_disk_addr_t start;
-
-              start = grub_le_to_cpu16 (ext[i].start_hi);
-              start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
-
-              return fileblock + start;
-            }
-        }
-      else
-        {
-          grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
-          return -1;
-        }
-    }
   /* Direct blocks.  */
   if (fileblock < INDIRECT_BLOCKS)
     blknr = grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
@@ -433,11 +393,11 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
     {
       grub_uint32_t indir[blksz / 4];
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (inode->blocks.indir_block))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (inode->blocks.indir_block))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
       blknr = grub_le_to_cpu32 (indir[fileblock - INDIRECT_BLOCKS]);
@@ -450,18 +410,18 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 					 + blksz / 4);
       grub_uint32_t indir[blksz / 4];
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (inode->blocks.double_indir_block))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (inode->blocks.double_indir_block))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (indir[rblock / perblock]))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (indir[rblock / perblock]))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
 
@@ -476,25 +436,25 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 					 * (blksz / 4 + 1));
       grub_uint32_t indir[blksz / 4];
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (inode->blocks.triple_indir_block))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (inode->blocks.triple_indir_block))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (indir[(rblock / perblock) / perblock]))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (indir[(rblock / perblock) / perblock]))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
-      if (grub_disk_read (data->disk,
-			  ((grub_disk_addr_t)
-			   grub_le_to_cpu32 (indir[(rblock / perblock) % perblock]))
-			  << log2_blksz,
-			  0, blksz, indir))
+      if (grub_disk_read_pinned (data->disk,
+				 ((grub_disk_addr_t)
+				  grub_le_to_cpu32 (indir[(rblock / perblock) % perblock]))
+				 << log2_blksz,
+				 0, blksz, indir))
 	return grub_errno;
 
       blknr = grub_le_to_cpu32 (indir[rblock % perblock]);
@@ -508,6 +468,65 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   return blknr;
 }
 
+/* Map FILEBLOCK of NODE to a disk block and store in *LEN how many blocks
+   of the file follow it contiguously on disk.  */
+static grub_disk_addr_t
+grub_ext2_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		       grub_disk_addr_t *len)
+{
+  struct grub_ext2_data *data = node->data;
+  struct grub_ext2_inode *inode = &node->inode;
+  GRUB_PROPERLY_ALIGNED_ARRAY (buf, EXT2_BLOCK_SIZE(data));
+  struct grub_ext4_extent_header *leaf;
+  struct grub_ext4_extent *ext;
+  int i;
+
+  *len = 1;
+
+  /* Indirect block maps are only contiguous by chance, which
+     grub_fshelp_read_file_extents detects on its own.  */
+  if (! (grub_le_to_cpu32(inode->flags) & EXT4_EXTENTS_FLAG))
+    return grub_ext2_read_block (node, fileblock);
+
+  leaf = grub_ext4_find_leaf (data, buf,
+			      (struct grub_ext4_extent_header *) inode->blocks.dir_blocks,
+			      fileblock);
+  if (! leaf)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid extent");
+      return -1;
+    }
+
+  ext = (struct grub_ext4_extent *) (leaf + 1);
+  for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
+    {
+      if (fileblock < grub_le_to_cpu32 (ext[i].block))
+	break;
+    }
+
+  if (--i >= 0)
+    {
+      fileblock -= grub_le_to_cpu32 (ext[i].block);
+      if (fileblock >= grub_le_to_cpu16 (ext[i].len))
+	return 0;
+      else
+	{
+	  grub_disk_addr_t start;
+
+	  start = grub_le_to_cpu16 (ext[i].start_hi);
+	  start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
+
+	  *len = grub_le_to_cpu16 (ext[i].len) - fileblock;
+	  return fileblock + start;
+	}
+    }
+  else
+    {
+      grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
+      return -1;
+    }
+}
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -516,11 +535,11 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_ext2_read_block,
-				grub_cpu_to_le32 (node->inode.size)
-				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
-				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_ext2_read_extent,
+					grub_cpu_to_le32 (node->inode.size)
+					| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
+					LOG2_EXT2_BLOCK_SIZE (node->data), 0);
 
 }
 
@@ -552,11 +571,11 @@ grub_ext2_read_inode (struct grub_ext2_data *data,
     % inodes_per_block;
 
   /* Read the inode.  */
-  if (grub_disk_read (data->disk,
-		      (((grub_disk_addr_t) grub_le_to_cpu32 (blkgrp.inode_table_id) + blkno)
-		        << LOG2_EXT2_BLOCK_SIZE (data)),
-		      EXT2_INODE_SIZE (data) * blkoff,
-		      sizeof (struct grub_ext2_inode), inode))
+  if (grub_disk_read_pinned (data->disk,
+			     (((grub_disk_addr_t) grub_le_to_cpu32 (blkgrp.inode_table_id) + blkno)
+			       << LOG2_EXT2_BLOCK_SIZE (data)),
+			     EXT2_INODE_SIZE (data) * blkoff,
+			     sizeof (struct grub_ext2_inode), inode))
     return grub_errno;
 
   return 0;
@@ -572,8 +591,8 @@ grub_ext2_mount (grub_disk_t disk)
     return 0;
 
   /* Read the superblock.  */
-  grub_disk_read (disk, 1 * 2, 0, sizeof (struct grub_ext2_sblock),
-                  &data->sblock);
+  grub_disk_read_pinned (disk, 1 * 2, 0, sizeof (struct grub_ext2_sblock),
+			 &data->sblock);
   if (grub_errno)
     goto fail;
 
@@ -606,6 +625,9 @@ grub_ext2_mount (grub_disk_t disk)
   if (grub_errno)
     goto fail;
 
+  data->dcache = grub_fshelp_dcache_new (sizeof (struct grub_fshelp_node));
+  grub_errno = GRUB_ERR_NONE;
+
   return data;
 
  fail:
@@ -616,6 +638,47 @@ grub_ext2_mount (grub_disk_t disk)
   return 0;
 }
 
+static void
+grub_ext2_free (void *data)
+{
+  grub_fshelp_dcache_free (((struct grub_ext2_data *) data)->dcache);
+  grub_free (data);
+}
+
+/* Return the filesystem on DISK, reusing an instance from the mount cache
+   when possible.  */
+static struct grub_ext2_data *
+grub_ext2_get (grub_disk_t disk)
+{
+  struct grub_ext2_data *data;
+
+  data = grub_fs_mount_cache_get (&grub_ext2_fs, disk);
+  if (! data)
+    {
+      int span;
+
+      span = grub_boottrace_begin ("mount", "%s %s", grub_ext2_fs.name,
+				   disk->name);
+      data = grub_ext2_mount (disk);
+      grub_boottrace_end (span);
+      if (data)
+	grub_fs_mount_cache_add (&grub_ext2_fs, disk, data);
+      return data;
+    }
+
+  /* The last open left its file in DIROPEN.  */
+  data->disk = disk;
+  data->diropen.ino = 2;
+  data->diropen.inode_read = 1;
+  if (grub_ext2_read_inode (data, 2, data->inode))
+    {
+      grub_fs_mount_cache_put (&grub_ext2_fs, data);
+      return 0;
+    }
+
+  return data;
+}
+
 static char *
 grub_ext2_read_symlink (grub_fshelp_node_t node)
 {
@@ -763,16 +826,16 @@ grub_ext2_open (struct grub_file *file, const char *name)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ext2_mount (file->device->disk);
+  data = grub_ext2_get (file->device->disk);
   if (! data)
     {
       err = grub_errno;
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_cached (data->dcache, name, &data->diropen,
+				      &fdiro, grub_ext2_iterate_dir,
+				      grub_ext2_read_symlink, GRUB_FSHELP_REG);
   if (err)
     goto fail;
 
@@ -796,7 +859,7 @@ grub_ext2_open (struct grub_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -806,7 +869,7 @@ grub_ext2_open (struct grub_file *file, const char *name)
 static grub_err_t
 grub_ext2_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, file->data);
 
   grub_dl_unref (my_mod);
 
@@ -862,12 +925,13 @@ grub_ext2_dir (grub_device_t device, const char *path,
 
   grub_dl_ref (my_mod);
 
-  data = grub_ext2_mount (device->disk);
+  data = grub_ext2_get (device->disk);
   if (! data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_ext2_iterate_dir,
-			 grub_ext2_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (data->dcache, path, &data->diropen, &fdiro,
+				grub_ext2_iterate_dir, grub_ext2_read_symlink,
+				GRUB_FSHELP_DIR);
   if (grub_errno)
     goto fail;
 
@@ -876,7 +940,7 @@ grub_ext2_dir (grub_device_t device, const char *path,
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -891,7 +955,7 @@ grub_ext2_label (grub_device_t device, char **label)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ext2_mount (disk);
+  data = grub_ext2_get (disk);
   if (data)
     *label = grub_strndup (data->sblock.volume_name,
 			   sizeof (data->sblock.volume_name));
@@ -900,7 +964,7 @@ grub_ext2_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, data);
 
   return grub_errno;
 }
@@ -913,7 +977,7 @@ grub_ext2_uuid (grub_device_t device, char **uuid)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ext2_mount (disk);
+  data = grub_ext2_get (disk);
   if (data)
     {
       *uuid = grub_xasprintf ("%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
@@ -931,7 +995,7 @@ grub_ext2_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, data);
 
   return grub_errno;
 }
@@ -945,7 +1009,7 @@ grub_ext2_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ext2_mount (disk);
+  data = grub_ext2_get (disk);
   if (!data)
     *tm = 0;
   else
@@ -953,7 +1017,7 @@ grub_ext2_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_ext2_fs, data);
 
   return grub_errno;
 
@@ -961,9 +1025,16 @@ grub_ext2_mtime (grub_device_t device, grub_int32_t *tm)
 
 
 
+static const struct grub_fs_signature grub_ext2_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (1080, "\x53\xef"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_ext2_fs =
   {
     .name = "ext2",
+    .signatures = grub_ext2_signatures,
     .dir = grub_ext2_dir,
     .open = grub_ext2_open,
     .read = grub_ext2_read,
@@ -971,6 +1042,7 @@ static struct grub_fs grub_ext2_fs =
     .label = grub_ext2_label,
     .uuid = grub_ext2_uuid,
     .mtime = grub_ext2_mtime,
+    .free_mount = grub_ext2_free,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
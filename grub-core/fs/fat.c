@@ -28,6 +28,7 @@
 #include <grub/charset.h>
 #include <grub/fat.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -204,6 +205,8 @@ struct grub_fat_data
 
 static grub_dl_t my_mod;
 
+static struct grub_fs grub_fat_fs;
+
 #ifndef MODE_EXFAT
 static int
 fat_log2 (unsigned x)
@@ -452,6 +455,35 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Return the filesystem on DISK, reusing an instance from the mount cache
+   when possible.  */
+static struct grub_fat_data *
+grub_fat_get (grub_disk_t disk)
+{
+  struct grub_fat_data *data;
+
+  data = grub_fs_mount_cache_get (&grub_fat_fs, disk);
+  if (! data)
+    {
+      int span;
+
+      span = grub_boottrace_begin ("mount", "%s %s", grub_fat_fs.name,
+				   disk->name);
+      data = grub_fat_mount (disk);
+      grub_boottrace_end (span);
+      if (data)
+	grub_fs_mount_cache_add (&grub_fat_fs, disk, data);
+      return data;
+    }
+
+  /* Start from the root directory again.  */
+  data->file_cluster = data->root_cluster;
+  data->cur_cluster_num = ~0U;
+  data->attr = GRUB_FAT_ATTR_DIRECTORY;
+
+  return data;
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
 		    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
@@ -958,7 +990,7 @@ grub_fat_dir (grub_device_t device, const char *path,
 
   grub_dl_ref (my_mod);
 
-  data = grub_fat_mount (disk);
+  data = grub_fat_get (disk);
   if (! data)
     goto fail;
 
@@ -983,7 +1015,7 @@ grub_fat_dir (grub_device_t device, const char *path,
  fail:
 
   grub_free (dirname);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_fat_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -998,7 +1030,7 @@ grub_fat_open (grub_file_t file, const char *name)
 
   grub_dl_ref (my_mod);
 
-  data = grub_fat_mount (file->device->disk);
+  data = grub_fat_get (file->device->disk);
   if (! data)
     goto fail;
 
@@ -1023,7 +1055,7 @@ grub_fat_open (grub_file_t file, const char *name)
 
  fail:
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_fat_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1040,7 +1072,7 @@ grub_fat_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_fat_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_fs_mount_cache_put (&grub_fat_fs, file->data);
 
   grub_dl_unref (my_mod);
 
@@ -1056,7 +1088,7 @@ grub_fat_label (grub_device_t device, char **label)
   struct grub_fat_data *data;
   grub_disk_t disk = device->disk;
 
-  data = grub_fat_mount (disk);
+  data = grub_fat_get (disk);
   if (! data)
     return grub_errno;
 
@@ -1086,7 +1118,7 @@ grub_fat_label (grub_device_t device, char **label)
 				* GRUB_MAX_UTF8_PER_UTF16 + 1);
 	  if (!*label)
 	    {
-	      grub_free (data);
+	      grub_fs_mount_cache_put (&grub_fat_fs, data);
 	      return grub_errno;
 	    }
 	  chc = dir.type_specific.volume_label.character_count;
@@ -1098,7 +1130,7 @@ grub_fat_label (grub_device_t device, char **label)
 	}
     }
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_fat_fs, data);
   return grub_errno;
 }
 
@@ -1116,14 +1148,14 @@ grub_fat_label (grub_device_t device, char **label)
 
   grub_dl_ref (my_mod);
 
-  data = grub_fat_mount (disk);
+  data = grub_fat_get (disk);
   if (! data)
     goto fail;
 
   if (! (data->attr & GRUB_FAT_ATTR_DIRECTORY))
     {
       grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a directory"));
-      return 0;
+      goto fail;
     }
 
   err = grub_fat_iterate_init (&ctxt);
@@ -1143,7 +1175,7 @@ grub_fat_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_fat_fs, data);
 
   return grub_errno;
 }
@@ -1158,7 +1190,7 @@ grub_fat_uuid (grub_device_t device, char **uuid)
 
   grub_dl_ref (my_mod);
 
-  data = grub_fat_mount (disk);
+  data = grub_fat_get (disk);
   if (data)
     {
       char *ptr;
@@ -1173,17 +1205,29 @@ grub_fat_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_fat_fs, data);
 
   return grub_errno;
 }
 
+#ifdef MODE_EXFAT
+/* FAT has no magic worth the name.  */
+static const struct grub_fs_signature grub_fat_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (3, "EXFAT\x20\x20\x20"),
+    { 0, 0, 0 }
+  };
+#endif
+
 static struct grub_fs grub_fat_fs =
   {
 #ifdef MODE_EXFAT
     .name = "exfat",
 #else
     .name = "fat",
+#endif
+#ifdef MODE_EXFAT
+    .signatures = grub_fat_signatures,
 #endif
     .dir = grub_fat_dir,
     .open = grub_fat_open,
@@ -27,6 +27,149 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* The number of slots of a dentry cache.  */
+#define GRUB_FSHELP_DCACHE_SIZE	256
+
+/* The entries of a dentry cache are allocated from an arena in chunks of
+   GRUB_FSHELP_DCACHE_CHUNK bytes.  Replaced entries aren't reclaimed one
+   by one; once GRUB_FSHELP_DCACHE_BYTES have been used, the whole cache
+   is dropped and the arena reset.  */
+#define GRUB_FSHELP_DCACHE_CHUNK	16384
+#define GRUB_FSHELP_DCACHE_BYTES	131072
+
+/* The identifier of the root directory in a dentry cache.  0 stands for a
+   directory that isn't cached.  */
+#define GRUB_FSHELP_DCACHE_ROOT	1
+
+/* The result of looking NAME up in the directory DIR.  */
+struct grub_fshelp_dentry
+{
+  unsigned long dir;
+  /* The identifier of the node found, for looking up its entries.  */
+  unsigned long id;
+  enum grub_fshelp_filetype type;
+  /* A copy of the node found, or 0 if NAME doesn't exist.  */
+  grub_fshelp_node_t node;
+  char name[0];
+};
+
+struct grub_fshelp_dcache
+{
+  grub_size_t nodesize;
+  unsigned long next_id;
+  grub_arena_t arena;
+  grub_size_t used;
+  struct grub_fshelp_dentry *slots[GRUB_FSHELP_DCACHE_SIZE];
+};
+
+struct grub_fshelp_dcache *
+grub_fshelp_dcache_new (grub_size_t nodesize)
+{
+  struct grub_fshelp_dcache *dcache;
+
+  dcache = grub_zalloc (sizeof (*dcache));
+  if (! dcache)
+    return 0;
+
+  dcache->arena = grub_arena_create (GRUB_FSHELP_DCACHE_CHUNK);
+  if (! dcache->arena)
+    {
+      grub_free (dcache);
+      return 0;
+    }
+
+  dcache->nodesize = nodesize;
+  dcache->next_id = GRUB_FSHELP_DCACHE_ROOT + 1;
+
+  return dcache;
+}
+
+void
+grub_fshelp_dcache_free (struct grub_fshelp_dcache *dcache)
+{
+  if (! dcache)
+    return;
+
+  grub_arena_destroy (dcache->arena);
+  grub_free (dcache);
+}
+
+static unsigned
+dcache_slot (unsigned long dir, const char *name)
+{
+  unsigned long hash = dir;
+
+  while (*name)
+    hash = hash * 31 + (grub_uint8_t) *name++;
+
+  return hash % GRUB_FSHELP_DCACHE_SIZE;
+}
+
+static struct grub_fshelp_dentry *
+dcache_lookup (struct grub_fshelp_dcache *dcache, unsigned long dir,
+	       const char *name)
+{
+  struct grub_fshelp_dentry *dentry;
+
+  dentry = dcache->slots[dcache_slot (dir, name)];
+  if (dentry && dentry->dir == dir && grub_strcmp (dentry->name, name) == 0)
+    return dentry;
+
+  return 0;
+}
+
+/* Remember that NAME in the directory DIR is NODE of type TYPE, or that it
+   doesn't exist if NODE is 0, replacing the entry which used the same slot.
+   Return the identifier of NODE, or 0 if it couldn't be cached.  */
+static unsigned long
+dcache_insert (struct grub_fshelp_dcache *dcache, unsigned long dir,
+	       const char *name, enum grub_fshelp_filetype type,
+	       grub_fshelp_node_t node)
+{
+  struct grub_fshelp_dentry *dentry;
+  grub_size_t size;
+
+  size = sizeof (*dentry) + grub_strlen (name) + 1;
+  if (node)
+    size += dcache->nodesize;
+
+  if (dcache->used + size > GRUB_FSHELP_DCACHE_BYTES)
+    {
+      grub_memset (dcache->slots, 0, sizeof (dcache->slots));
+      grub_arena_reset (dcache->arena);
+      dcache->used = 0;
+    }
+
+  dentry = grub_arena_alloc (dcache->arena,
+			     sizeof (*dentry) + grub_strlen (name) + 1);
+  if (! dentry)
+    goto fail;
+
+  dentry->node = 0;
+  if (node)
+    {
+      dentry->node = grub_arena_alloc (dcache->arena, dcache->nodesize);
+      if (! dentry->node)
+	goto fail;
+      grub_memcpy (dentry->node, node, dcache->nodesize);
+    }
+  dcache->used += size;
+
+  dentry->dir = dir;
+  dentry->id = dcache->next_id++;
+  dentry->type = type;
+  grub_strcpy (dentry->name, name);
+
+  dcache->slots[dcache_slot (dir, name)] = dentry;
+
+  return dentry->id;
+
+ fail:
+  /* Not being able to cache isn't an error.  */
+  grub_errno = GRUB_ERR_NONE;
+  return 0;
+}
+
 /* Lookup the node PATH.  The node ROOTNODE describes the root of the
    directory tree.  The node found is returned in FOUNDNODE, which is
    either a ROOTNODE or a new malloc'ed node.  ITERATE_DIR is used to
@@ -46,17 +189,38 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 					    grub_fshelp_node_t node)),
 		       char *(*read_symlink) (grub_fshelp_node_t node),
 		       enum grub_fshelp_filetype expecttype)
+{
+  return grub_fshelp_find_file_cached (0, path, rootnode, foundnode,
+				       iterate_dir, read_symlink, expecttype);
+}
+
+/* Like grub_fshelp_find_file, but remember the directory entries looked
+   up in DCACHE, if not 0, and look them up there first.  */
+grub_err_t
+grub_fshelp_find_file_cached (struct grub_fshelp_dcache *dcache,
+			      const char *path, grub_fshelp_node_t rootnode,
+			      grub_fshelp_node_t *foundnode,
+			      int (*iterate_dir) (grub_fshelp_node_t dir,
+						  int NESTED_FUNC_ATTR (*hook)
+						  (const char *filename,
+						   enum grub_fshelp_filetype filetype,
+						   grub_fshelp_node_t node)),
+			      char *(*read_symlink) (grub_fshelp_node_t node),
+			      enum grub_fshelp_filetype expecttype)
 {
   grub_err_t err;
   enum grub_fshelp_filetype foundtype = GRUB_FSHELP_DIR;
+  unsigned long foundid = 0;
   int symlinknest = 0;
 
   auto grub_err_t NESTED_FUNC_ATTR find_file (const char *currpath,
 					      grub_fshelp_node_t currroot,
+					      unsigned long rootid,
 					      grub_fshelp_node_t *currfound);
 
   grub_err_t NESTED_FUNC_ATTR find_file (const char *currpath,
 					 grub_fshelp_node_t currroot,
+					 unsigned long rootid,
 					 grub_fshelp_node_t *currfound)
     {
       char fpath[grub_strlen (currpath) + 1];
@@ -65,6 +229,9 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       enum grub_fshelp_filetype type = GRUB_FSHELP_DIR;
       grub_fshelp_node_t currnode = currroot;
       grub_fshelp_node_t oldnode = currroot;
+      /* The dentry cache identifiers of CURRNODE and of its directory.  */
+      unsigned long id = rootid;
+      unsigned long dirid;
 
       auto int NESTED_FUNC_ATTR iterate (const char *filename,
 					 enum grub_fshelp_filetype filetype,
@@ -108,11 +275,13 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       if (! *name)
 	{
 	  *currfound = currnode;
+	  foundid = id;
 	  return 0;
 	}
 
       for (;;)
 	{
+	  struct grub_fshelp_dentry *dentry = 0;
 	  int found;
 
 	  /* Extract the actual part from the pathname.  */
@@ -133,8 +302,46 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	      return grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a directory"));
 	    }
 
-	  /* Iterate over the directory.  */
-	  found = iterate_dir (currnode, iterate);
+	  dirid = id;
+	  if (dirid)
+	    dentry = dcache_lookup (dcache, dirid, name);
+
+	  if (dentry)
+	    {
+	      grub_dprintf ("fshelp", "dentry cache hit for `%s'\n", name);
+
+	      found = 0;
+	      id = dentry->id;
+	      if (dentry->node)
+		{
+		  grub_fshelp_node_t node;
+
+		  node = grub_malloc (dcache->nodesize);
+		  if (! node)
+		    {
+		      free_node (currnode);
+		      currnode = 0;
+		      return grub_errno;
+		    }
+		  grub_memcpy (node, dentry->node, dcache->nodesize);
+
+		  type = dentry->type;
+		  oldnode = currnode;
+		  currnode = node;
+		  found = 1;
+		}
+	    }
+	  else
+	    {
+	      /* Iterate over the directory.  */
+	      found = iterate_dir (currnode, iterate);
+
+	      id = 0;
+	      if (dirid && ! grub_errno)
+		id = dcache_insert (dcache, dirid, name, type,
+				    found ? currnode : 0);
+	    }
+
 	  if (! found)
 	    {
 	      free_node (currnode);
@@ -175,11 +382,13 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 		{
 		  free_node (oldnode);
 		  oldnode = rootnode;
+		  dirid = dcache ? GRUB_FSHELP_DCACHE_ROOT : 0;
 		}
 
 	      /* Lookup the node the symlink points to.  */
-	      find_file (symlink, oldnode, &currnode);
+	      find_file (symlink, oldnode, dirid, &currnode);
 	      type = foundtype;
+	      id = foundid;
 	      grub_free (symlink);
 
 	      if (grub_errno)
@@ -197,6 +406,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	    {
 	      *currfound = currnode;
 	      foundtype = type;
+	      foundid = id;
 	      return 0;
 	    }
 
@@ -212,7 +422,8 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       return grub_errno;
     }
 
-  err = find_file (path, rootnode, foundnode);
+  err = find_file (path, rootnode, dcache ? GRUB_FSHELP_DCACHE_ROOT : 0,
+		   foundnode);
   if (err)
     return err;
 
@@ -225,83 +436,193 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
   return 0;
 }
 
-/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  GET_BLOCK is used to translate file
-   blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-grub_ssize_t
-grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
-		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
-                                                           unsigned offset,
-                                                           unsigned length),
-		       grub_off_t pos, grub_size_t len, char *buf,
+/* The number of runs grub_fshelp_read_file hands to the disk layer at
+   once.  */
+#define GRUB_FSHELP_VEC_MAX	32
+
+/* Translate the file block BLOCK of NODE to a disk block, using GET_EXTENT
+   if available and GET_BLOCK otherwise.  Store the number of blocks known
+   to follow it contiguously, including itself, in *RUN.  */
+static grub_disk_addr_t
+grub_fshelp_map_block (grub_fshelp_node_t node, grub_disk_addr_t block,
 		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
-                                                      grub_disk_addr_t block),
-		       grub_off_t filesize, int log2blocksize,
-		       grub_disk_addr_t blocks_start)
+						      grub_disk_addr_t block),
+		       grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+						       grub_disk_addr_t block,
+						       grub_disk_addr_t *len),
+		       grub_disk_addr_t *run)
+{
+  grub_disk_addr_t blknr;
+
+  *run = 1;
+  if (! get_extent)
+    return get_block (node, block);
+
+  blknr = get_extent (node, block, run);
+  if (*run == 0)
+    *run = 1;
+  return blknr;
+}
+
+/* Read the NVEC queued runs VEC with one vectored read.  */
+static grub_err_t
+grub_fshelp_read_vec (grub_disk_t disk,
+		      void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+							  unsigned offset,
+							  unsigned length),
+		      struct grub_disk_vec *vec, unsigned nvec)
+{
+  grub_err_t err;
+
+  disk->read_hook = read_hook;
+  err = grub_disk_read_vec (disk, vec, nvec);
+  disk->read_hook = 0;
+  return err;
+}
+
+static grub_ssize_t
+grub_fshelp_read_file_real (grub_disk_t disk, grub_fshelp_node_t node,
+			    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								unsigned offset,
+								unsigned length),
+			    grub_off_t pos, grub_size_t len, char *buf,
+			    grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+							   grub_disk_addr_t block),
+			    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							    grub_disk_addr_t block,
+							    grub_disk_addr_t *len),
+			    grub_off_t filesize, int log2blocksize,
+			    grub_disk_addr_t blocks_start)
 {
   grub_disk_addr_t i, blockcnt;
-  int blocksize = 1 << (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  grub_disk_addr_t next_blknr = 0, next_run = 0;
+  int shift = log2blocksize + GRUB_DISK_SECTOR_BITS;
+  struct grub_disk_vec vec[GRUB_FSHELP_VEC_MAX];
+  unsigned nvec = 0;
 
   /* Adjust LEN so it we can't read past the end of the file.  */
   if (pos + len > filesize)
     len = filesize - pos;
 
-  blockcnt = ((len + pos) + blocksize - 1) >> (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  blockcnt = ((len + pos) + (1 << shift) - 1) >> shift;
 
-  for (i = pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS); i < blockcnt; i++)
+  i = pos >> shift;
+  while (i < blockcnt)
     {
-      grub_disk_addr_t blknr;
-      int blockoff = pos & (blocksize - 1);
-      int blockend = blocksize;
-
-      int skipfirst = 0;
-
-      blknr = get_block (node, i);
-      if (grub_errno)
-	return -1;
-
-      blknr = blknr << log2blocksize;
+      grub_disk_addr_t blknr, run;
+      grub_off_t start, end;
 
-      /* Last block.  */
-      if (i == blockcnt - 1)
+      /* The previous iteration may already have looked this run up.  */
+      if (next_run)
 	{
-	  blockend = (len + pos) & (blocksize - 1);
-
-	  /* The last portion is exactly blocksize.  */
-	  if (! blockend)
-	    blockend = blocksize;
+	  blknr = next_blknr;
+	  run = next_run;
+	  next_run = 0;
+	}
+      else
+	{
+	  blknr = grub_fshelp_map_block (node, i, get_block, get_extent, &run);
+	  if (grub_errno)
+	    return -1;
 	}
 
-      /* First block.  */
-      if (i == (pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS)))
+      /* Merge the following runs as long as they are contiguous on disk,
+	 so that they are read with a single disk read.  */
+      while (i + run < blockcnt)
 	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
+	  next_blknr = grub_fshelp_map_block (node, i + run, get_block,
+					      get_extent, &next_run);
+	  if (grub_errno)
+	    return -1;
+	  if (blknr ? (next_blknr != blknr + run) : (next_blknr != 0))
+	    break;
+	  run += next_run;
+	  next_run = 0;
 	}
 
+      if (run > blockcnt - i)
+	run = blockcnt - i;
+
+      /* The part of the run inside the requested range.  */
+      start = i << shift;
+      end = (i + run) << shift;
+      if (start < pos)
+	start = pos;
+      if (end > pos + len)
+	end = pos + len;
+
       /* If the block number is 0 this block is not stored on disk but
-	 is zero filled instead.  */
+	 is zero filled instead.  Otherwise queue the run, so that the
+	 disk layer gets to see many runs at once.  */
       if (blknr)
 	{
-	  disk->read_hook = read_hook;
+	  if (nvec == GRUB_FSHELP_VEC_MAX)
+	    {
+	      if (grub_fshelp_read_vec (disk, read_hook, vec, nvec))
+		return -1;
+	      nvec = 0;
+	    }
 
-	  grub_disk_read (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf);
-	  disk->read_hook = 0;
-	  if (grub_errno)
-	    return -1;
+	  vec[nvec].sector = (blknr << log2blocksize) + blocks_start;
+	  vec[nvec].offset = start - (i << shift);
+	  vec[nvec].size = end - start;
+	  vec[nvec].buf = buf;
+	  nvec++;
 	}
       else
-	grub_memset (buf, 0, blockend);
+	grub_memset (buf, 0, end - start);
 
-      buf += blocksize - skipfirst;
+      buf += end - start;
+      i += run;
     }
 
+  if (nvec && grub_fshelp_read_vec (disk, read_hook, vec, nvec))
+    return -1;
+
   return len;
 }
 
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  GET_BLOCK is used to translate file
+   blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  */
+grub_ssize_t
+grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+                                                           unsigned offset,
+                                                           unsigned length),
+		       grub_off_t pos, grub_size_t len, char *buf,
+		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+                                                      grub_disk_addr_t block),
+		       grub_off_t filesize, int log2blocksize,
+		       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     get_block, 0, filesize, log2blocksize,
+				     blocks_start);
+}
+
+/* Like grub_fshelp_read_file, but GET_EXTENT translates a file block to
+   the disk block it is stored in and stores the number of blocks of the
+   file that follow contiguously on disk, including this one, in *LEN.  */
+grub_ssize_t
+grub_fshelp_read_file_extents (grub_disk_t disk, grub_fshelp_node_t node,
+			       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								   unsigned offset,
+								   unsigned length),
+			       grub_off_t pos, grub_size_t len, char *buf,
+			       grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							       grub_disk_addr_t block,
+							       grub_disk_addr_t *len),
+			       grub_off_t filesize, int log2blocksize,
+			       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     0, get_extent, filesize, log2blocksize,
+				     blocks_start);
+}
+
 unsigned int
 grub_fshelp_log2blksize (unsigned int blksize, unsigned int *pow)
 {
@@ -1351,9 +1351,16 @@ grub_hfs_uuid (grub_device_t device, char **uuid)
 
 
 
+static const struct grub_fs_signature grub_hfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (1024, "BD"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_hfs_fs =
   {
     .name = "hfs",
+    .signatures = grub_hfs_signatures,
     .dir = grub_hfs_dir,
     .open = grub_hfs_open,
     .read = grub_hfs_read,
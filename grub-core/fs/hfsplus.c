@@ -29,6 +29,7 @@
 #include <grub/fshelp.h>
 #include <grub/hfs.h>
 #include <grub/charset.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -240,10 +241,14 @@ struct grub_hfsplus_data
      filesystem (one inside a plain HFS wrapper).  */
   grub_disk_addr_t embedded_offset;
   int case_sensitive;
+
+  struct grub_fshelp_dcache *dcache;
 };
 
 static grub_dl_t my_mod;
 
+static struct grub_fs grub_hfsplus_fs;
+
 
 /* Return the offset of the record with the index INDEX, in the node
    NODE which is part of the B+ tree BTREE.  */
@@ -275,7 +280,7 @@ grub_hfsplus_btree_recptr (struct grub_hfsplus_btree *btree,
    FILEBLOCK to the next block.  */
 static grub_disk_addr_t
 grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
-			 grub_disk_addr_t *fileblock)
+			 grub_disk_addr_t *fileblock, grub_disk_addr_t *len)
 {
   int i;
   grub_disk_addr_t blksleft = *fileblock;
@@ -284,7 +289,10 @@ grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
   for (i = 0; i < 8; i++)
     {
       if (blksleft < grub_be_to_cpu32 (extent[i].count))
-	return grub_be_to_cpu32 (extent[i].start) + blksleft;
+	{
+	  *len = grub_be_to_cpu32 (extent[i].count) - blksleft;
+	  return grub_be_to_cpu32 (extent[i].start) + blksleft;
+	}
       blksleft -= grub_be_to_cpu32 (extent[i].count);
     }
 
@@ -304,9 +312,11 @@ static int grub_hfsplus_cmp_extkey (struct grub_hfsplus_key *keya,
 				    struct grub_hfsplus_key_internal *keyb);
 
 /* Search for the block FILEBLOCK inside the file NODE.  Return the
-   blocknumber of this block on disk.  */
+   blocknumber of this block on disk and store the number of blocks left
+   in its extent in *LEN.  */
 static grub_disk_addr_t
-grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_hfsplus_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+			  grub_disk_addr_t *len)
 {
   struct grub_hfsplus_btnode *nnode = 0;
   grub_disk_addr_t blksleft = fileblock;
@@ -320,7 +330,7 @@ grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
       grub_off_t ptr;
 
       /* Try to find this block in the current set of extents.  */
-      blk = grub_hfsplus_find_block (extents, &blksleft);
+      blk = grub_hfsplus_find_block (extents, &blksleft, len);
 
       /* The previous iteration of this loop allocated memory.  The
 	 code above used this memory, it can be freed now.  */
@@ -379,11 +389,12 @@ grub_hfsplus_read_file (grub_fshelp_node_t node,
 					   unsigned offset, unsigned length),
 			grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_hfsplus_read_block,
-				node->size,
-				node->data->log2blksize - GRUB_DISK_SECTOR_BITS,
-				node->data->embedded_offset);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_hfsplus_read_extent,
+					node->size,
+					node->data->log2blksize
+					- GRUB_DISK_SECTOR_BITS,
+					node->data->embedded_offset);
 }
 
 static struct grub_hfsplus_data *
@@ -504,6 +515,9 @@ grub_hfsplus_mount (grub_disk_t disk)
   data->dirroot.data = data;
   data->dirroot.fileid = GRUB_HFSPLUS_FILEID_ROOTDIR;
 
+  data->dcache = grub_fshelp_dcache_new (sizeof (struct grub_fshelp_node));
+  grub_errno = GRUB_ERR_NONE;
+
   return data;
 
  fail:
@@ -515,6 +529,39 @@ grub_hfsplus_mount (grub_disk_t disk)
   return 0;
 }
 
+static void
+grub_hfsplus_free (void *data)
+{
+  grub_fshelp_dcache_free (((struct grub_hfsplus_data *) data)->dcache);
+  grub_free (data);
+}
+
+/* Return the filesystem on DISK, reusing an instance from the mount cache
+   when possible.  */
+static struct grub_hfsplus_data *
+grub_hfsplus_get (grub_disk_t disk)
+{
+  struct grub_hfsplus_data *data;
+
+  data = grub_fs_mount_cache_get (&grub_hfsplus_fs, disk);
+  if (! data)
+    {
+      int span;
+
+      span = grub_boottrace_begin ("mount", "%s %s", grub_hfsplus_fs.name,
+				   disk->name);
+      data = grub_hfsplus_mount (disk);
+      grub_boottrace_end (span);
+      if (data)
+	grub_fs_mount_cache_add (&grub_hfsplus_fs, disk, data);
+      return data;
+    }
+
+  data->disk = disk;
+
+  return data;
+}
+
 /* Compare the on disk catalog key KEYA with the catalog key we are
    looking for (KEYB).  */
 static int
@@ -927,13 +974,13 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
 
   grub_dl_ref (my_mod);
 
-  data = grub_hfsplus_mount (file->device->disk);
+  data = grub_hfsplus_get (file->device->disk);
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (name, &data->dirroot, &fdiro,
-			 grub_hfsplus_iterate_dir,
-			 grub_hfsplus_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (data->dcache, name, &data->dirroot, &fdiro,
+				grub_hfsplus_iterate_dir,
+				grub_hfsplus_read_symlink, GRUB_FSHELP_REG);
   if (grub_errno)
     goto fail;
 
@@ -949,7 +996,7 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -960,7 +1007,7 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
 static grub_err_t
 grub_hfsplus_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, file->data);
 
   grub_dl_unref (my_mod);
 
@@ -1006,14 +1053,14 @@ grub_hfsplus_dir (grub_device_t device, const char *path,
 
   grub_dl_ref (my_mod);
 
-  data = grub_hfsplus_mount (device->disk);
+  data = grub_hfsplus_get (device->disk);
   if (!data)
     goto fail;
 
   /* Find the directory that should be opened.  */
-  grub_fshelp_find_file (path, &data->dirroot, &fdiro,
-			 grub_hfsplus_iterate_dir,
-			 grub_hfsplus_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (data->dcache, path, &data->dirroot, &fdiro,
+				grub_hfsplus_iterate_dir,
+				grub_hfsplus_read_symlink, GRUB_FSHELP_DIR);
   if (grub_errno)
     goto fail;
 
@@ -1023,7 +1070,7 @@ grub_hfsplus_dir (grub_device_t device, const char *path,
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1044,7 +1091,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 
   *label = 0;
 
-  data = grub_hfsplus_mount (disk);
+  data = grub_hfsplus_get (disk);
   if (!data)
     return grub_errno;
 
@@ -1057,7 +1104,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
   if (grub_hfsplus_btree_search (&data->catalog_tree, &intern,
 				 grub_hfsplus_cmp_catkey_id, &node, &ptr))
     {
-      grub_free (data);
+      grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
       return 0;
     }
 
@@ -1082,7 +1129,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 		       label_len) = '\0';
 
   grub_free (node);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
 
   return GRUB_ERR_NONE;
 }
@@ -1096,7 +1143,7 @@ grub_hfsplus_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_ref (my_mod);
 
-  data = grub_hfsplus_mount (disk);
+  data = grub_hfsplus_get (disk);
   if (!data)
     *tm = 0;
   else
@@ -1104,7 +1151,7 @@ grub_hfsplus_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
 
   return grub_errno;
 
@@ -1118,7 +1165,7 @@ grub_hfsplus_uuid (grub_device_t device, char **uuid)
 
   grub_dl_ref (my_mod);
 
-  data = grub_hfsplus_mount (disk);
+  data = grub_hfsplus_get (disk);
   if (data)
     {
       *uuid = grub_xasprintf ("%016llx",
@@ -1130,16 +1177,25 @@ grub_hfsplus_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_hfsplus_fs, data);
 
   return grub_errno;
 }
 
 
 
+static const struct grub_fs_signature grub_hfsplus_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (1024, "H+"),
+    GRUB_FS_SIGNATURE (1024, "HX"),
+    GRUB_FS_SIGNATURE (1024, "BD"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_hfsplus_fs =
   {
     .name = "hfsplus",
+    .signatures = grub_hfsplus_signatures,
     .dir = grub_hfsplus_dir,
     .open = grub_hfsplus_open,
     .read = grub_hfsplus_read,
@@ -1147,6 +1203,7 @@ static struct grub_fs grub_hfsplus_fs =
     .label = grub_hfsplus_label,
     .mtime = grub_hfsplus_mtime,
     .uuid = grub_hfsplus_uuid,
+    .free_mount = grub_hfsplus_free,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
@@ -1093,9 +1093,16 @@ grub_iso9660_mtime (grub_device_t device, grub_int32_t *timebuf)
 
 
 
+static const struct grub_fs_signature grub_iso9660_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (32769, "CD001"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_iso9660_fs =
   {
     .name = "iso9660",
+    .signatures = grub_iso9660_signatures,
     .dir = grub_iso9660_dir,
     .open = grub_iso9660_open,
     .read = grub_iso9660_read,
@@ -23,6 +23,7 @@
 #include <grub/misc.h>
 #include <grub/disk.h>
 #include <grub/dl.h>
+#include <grub/fshelp.h>
 #include <grub/types.h>
 #include <grub/charset.h>
 #include <grub/i18n.h>
@@ -256,10 +257,11 @@ static grub_dl_t my_mod;
 static grub_err_t grub_jfs_lookup_symlink (struct grub_jfs_data *data, grub_uint32_t ino);
 
 /* Get the block number for the block BLK in the node INODE in the
-   mounted filesystem DATA.  */
+   mounted filesystem DATA.  If LEN isn't NULL, store the number of blocks
+   left in the extent of BLK in it.  */
 static grub_int64_t
 grub_jfs_blkno (struct grub_jfs_data *data, struct grub_jfs_inode *inode,
-		grub_uint64_t blk)
+		grub_uint64_t blk, grub_disk_addr_t *len)
 {
   auto grub_int64_t getblk (struct grub_jfs_treehead *treehead,
 			    struct grub_jfs_tree_extent *extents);
@@ -279,8 +281,14 @@ grub_jfs_blkno (struct grub_jfs_data *data, struct grub_jfs_inode *inode,
 		  && ((grub_le_to_cpu16 (extents[i].extent.length))
 		      + (extents[i].extent.length2 << 16)
 		      + grub_le_to_cpu32 (extents[i].offset2)) > blk)
-		return (blk - grub_le_to_cpu32 (extents[i].offset2)
-			+ grub_le_to_cpu32 (extents[i].extent.blk2));
+		{
+		  if (len)
+		    *len = ((grub_le_to_cpu16 (extents[i].extent.length))
+			    + (extents[i].extent.length2 << 16)
+			    + grub_le_to_cpu32 (extents[i].offset2) - blk);
+		  return (blk - grub_le_to_cpu32 (extents[i].offset2)
+			  + grub_le_to_cpu32 (extents[i].extent.blk2));
+		}
 	    }
 	  else
 	    if (blk >= grub_le_to_cpu32 (extents[i].offset2))
@@ -323,7 +331,7 @@ grub_jfs_read_inode (struct grub_jfs_data *data, grub_uint32_t ino,
   grub_uint64_t iagblk;
   grub_uint64_t inoblk;
 
-  iagblk = grub_jfs_blkno (data, &data->fileset, iagnum + 1);
+  iagblk = grub_jfs_blkno (data, &data->fileset, iagnum + 1, 0);
   if (grub_errno)
     return grub_errno;
 
@@ -573,6 +581,15 @@ grub_jfs_getent (struct grub_jfs_diropen *diro)
 }
 
 
+static grub_disk_addr_t
+grub_jfs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t block,
+		      grub_disk_addr_t *len)
+{
+  struct grub_jfs_data *data = (struct grub_jfs_data *) node;
+
+  return grub_jfs_blkno (data, &data->currinode, block, len);
+}
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -581,54 +598,12 @@ grub_jfs_read_file (struct grub_jfs_data *data,
 				       unsigned offset, unsigned length),
 		    grub_off_t pos, grub_size_t len, char *buf)
 {
-  grub_off_t i;
-  grub_off_t blockcnt;
-
-  blockcnt = (len + pos + grub_le_to_cpu32 (data->sblock.blksz) - 1)
-    >> grub_le_to_cpu16 (data->sblock.log2_blksz);
-
-  for (i = pos >> grub_le_to_cpu16 (data->sblock.log2_blksz); i < blockcnt; i++)
-    {
-      grub_disk_addr_t blknr;
-      grub_uint32_t blockoff = pos & (grub_le_to_cpu32 (data->sblock.blksz) - 1);
-      grub_uint32_t blockend = grub_le_to_cpu32 (data->sblock.blksz);
-
-      grub_uint64_t skipfirst = 0;
-
-      blknr = grub_jfs_blkno (data, &data->currinode, i);
-      if (grub_errno)
-	return -1;
-
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (grub_le_to_cpu32 (data->sblock.blksz) - 1);
-
-	  if (!blockend)
-	    blockend = grub_le_to_cpu32 (data->sblock.blksz);
-	}
-
-      /* First block.  */
-      if (i == (pos >> grub_le_to_cpu16 (data->sblock.log2_blksz)))
-	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
-	}
-
-      data->disk->read_hook = read_hook;
-      grub_disk_read (data->disk,
-		      blknr << (grub_le_to_cpu16 (data->sblock.log2_blksz)
-				- GRUB_DISK_SECTOR_BITS),
-		      skipfirst, blockend, buf);
-
-      data->disk->read_hook = 0;
-      if (grub_errno)
-	return -1;
-
-      buf += grub_le_to_cpu32 (data->sblock.blksz) - skipfirst;
-    }
-
-  return len;
+  return grub_fshelp_read_file_extents (data->disk, (grub_fshelp_node_t) data,
+					read_hook, pos, len, buf,
+					grub_jfs_read_extent,
+					grub_le_to_cpu64 (data->currinode.size),
+					grub_le_to_cpu16 (data->sblock.log2_blksz)
+					- GRUB_DISK_SECTOR_BITS, 0);
 }
 
 
@@ -971,9 +946,16 @@ grub_jfs_label (grub_device_t device, char **label)
 }
 
 
+static const struct grub_fs_signature grub_jfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (32768, "JFS1"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_jfs_fs =
   {
     .name = "jfs",
+    .signatures = grub_jfs_signatures,
     .dir = grub_jfs_dir,
     .open = grub_jfs_open,
     .read = grub_jfs_read,
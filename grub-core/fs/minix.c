@@ -664,6 +664,34 @@ grub_minix_close (grub_file_t file)
 
 
 
+static const struct grub_fs_signature grub_minix_signatures[] =
+  {
+#if defined(MODE_MINIX3)
+#ifdef MODE_BIGENDIAN
+    GRUB_FS_SIGNATURE (1048, "\x4d\x5a"),
+#else
+    GRUB_FS_SIGNATURE (1048, "\x5a\x4d"),
+#endif
+#elif defined(MODE_MINIX2)
+#ifdef MODE_BIGENDIAN
+    GRUB_FS_SIGNATURE (1040, "\x24\x68"),
+    GRUB_FS_SIGNATURE (1040, "\x24\x78"),
+#else
+    GRUB_FS_SIGNATURE (1040, "\x68\x24"),
+    GRUB_FS_SIGNATURE (1040, "\x78\x24"),
+#endif
+#else
+#ifdef MODE_BIGENDIAN
+    GRUB_FS_SIGNATURE (1040, "\x13\x7f"),
+    GRUB_FS_SIGNATURE (1040, "\x13\x8f"),
+#else
+    GRUB_FS_SIGNATURE (1040, "\x7f\x13"),
+    GRUB_FS_SIGNATURE (1040, "\x8f\x13"),
+#endif
+#endif
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_minix_fs =
   {
 #ifdef MODE_BIGENDIAN
@@ -683,6 +711,7 @@ static struct grub_fs grub_minix_fs =
     .name = "minix",
 #endif
 #endif
+    .signatures = grub_minix_signatures,
     .dir = grub_minix_dir,
     .open = grub_minix_open,
     .read = grub_minix_read,
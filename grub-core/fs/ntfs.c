@@ -27,11 +27,14 @@
 #include <grub/fshelp.h>
 #include <grub/ntfs.h>
 #include <grub/charset.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
 static grub_dl_t my_mod;
 
+static struct grub_fs grub_ntfs_fs;
+
 #define grub_fshelp_node grub_ntfs_file 
 
 static inline grub_uint16_t
@@ -358,8 +361,11 @@ retry:
   return 0;
 }
 
+/* Map the cluster BLOCK to a disk cluster and store the number of clusters
+   left in its run in *LEN.  Runs are only ever walked forward.  */
 static grub_disk_addr_t
-grub_ntfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t block)
+grub_ntfs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t block,
+		       grub_disk_addr_t *len)
 {
   struct grub_ntfs_rlst *ctx;
 
@@ -368,10 +374,10 @@ grub_ntfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t block)
     {
       if (grub_ntfs_read_run_list (ctx))
 	return -1;
-      return ctx->curr_lcn;
     }
-  else
-    return (ctx->flags & GRUB_NTFS_RF_BLNK) ? 0 : (block -
+
+  *len = ctx->next_vcn - block;
+  return (ctx->flags & GRUB_NTFS_RF_BLNK) ? 0 : (block -
 					 ctx->curr_vcn + ctx->curr_lcn);
 }
 
@@ -481,9 +487,11 @@ read_data (struct grub_ntfs_attr *at, char *pa, char *dest,
       unsigned int pow;
 
       if (!grub_fshelp_log2blksize (ctx->comp.spc, &pow))
-	grub_fshelp_read_file (ctx->comp.disk, (grub_fshelp_node_t) ctx,
-			       read_hook, ofs, len, dest,
-			       grub_ntfs_read_block, ofs + len, pow, 0);
+	grub_fshelp_read_file_extents (ctx->comp.disk,
+				       (grub_fshelp_node_t) ctx,
+				       read_hook, ofs, len, dest,
+				       grub_ntfs_read_extent, ofs + len,
+				       pow, 0);
       return grub_errno;
     }
 
@@ -1012,6 +1020,52 @@ fail:
   return 0;
 }
 
+/* Free DATA for good, once it leaves the mount cache.  */
+static void
+grub_ntfs_free (void *ptr)
+{
+  struct grub_ntfs_data *data = ptr;
+
+  free_file (&data->mmft);
+  free_file (&data->cmft);
+  grub_free (data);
+}
+
+/* Return the filesystem on DISK, reusing an instance from the mount cache
+   when possible.  */
+static struct grub_ntfs_data *
+grub_ntfs_get (grub_disk_t disk)
+{
+  struct grub_ntfs_data *data;
+
+  data = grub_fs_mount_cache_get (&grub_ntfs_fs, disk);
+  if (! data)
+    {
+      int span;
+
+      span = grub_boottrace_begin ("mount", "%s %s", grub_ntfs_fs.name,
+				   disk->name);
+      data = grub_ntfs_mount (disk);
+      grub_boottrace_end (span);
+      if (data)
+	grub_fs_mount_cache_add (&grub_ntfs_fs, disk, data);
+      return data;
+    }
+
+  /* The last open left its file in CMFT.  */
+  data->disk = disk;
+  free_file (&data->cmft);
+  grub_memset (&data->cmft, 0, sizeof (data->cmft));
+  data->cmft.data = data;
+  if (init_file (&data->cmft, GRUB_NTFS_FILE_ROOT))
+    {
+      grub_fs_mount_cache_put (&grub_ntfs_fs, data);
+      return 0;
+    }
+
+  return data;
+}
+
 static grub_err_t
 grub_ntfs_dir (grub_device_t device, const char *path,
 	       int (*hook) (const char *filename,
@@ -1041,7 +1095,7 @@ grub_ntfs_dir (grub_device_t device, const char *path,
 
   grub_dl_ref (my_mod);
 
-  data = grub_ntfs_mount (device->disk);
+  data = grub_ntfs_get (device->disk);
   if (!data)
     goto fail;
 
@@ -1059,12 +1113,7 @@ fail:
       free_file (fdiro);
       grub_free (fdiro);
     }
-  if (data)
-    {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
-    }
+  grub_fs_mount_cache_put (&grub_ntfs_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1079,7 +1128,7 @@ grub_ntfs_open (grub_file_t file, const char *name)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ntfs_mount (file->device->disk);
+  data = grub_ntfs_get (file->device->disk);
   if (!data)
     goto fail;
 
@@ -1108,12 +1157,7 @@ grub_ntfs_open (grub_file_t file, const char *name)
   return 0;
 
 fail:
-  if (data)
-    {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
-    }
+  grub_fs_mount_cache_put (&grub_ntfs_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1140,12 +1184,7 @@ grub_ntfs_close (grub_file_t file)
 
   data = file->data;
 
-  if (data)
-    {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
-    }
+  grub_fs_mount_cache_put (&grub_ntfs_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1163,7 +1202,7 @@ grub_ntfs_label (grub_device_t device, char **label)
 
   *label = 0;
 
-  data = grub_ntfs_mount (device->disk);
+  data = grub_ntfs_get (device->disk);
   if (!data)
     goto fail;
 
@@ -1210,12 +1249,7 @@ fail:
       free_file (mft);
       grub_free (mft);
     }
-  if (data)
-    {
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
-    }
+  grub_fs_mount_cache_put (&grub_ntfs_fs, data);
 
   grub_dl_unref (my_mod);
 
@@ -1230,7 +1264,7 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_ref (my_mod);
 
-  data = grub_ntfs_mount (disk);
+  data = grub_ntfs_get (disk);
   if (data)
     {
       char *ptr;
@@ -1238,9 +1272,7 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
       if (*uuid)
 	for (ptr = *uuid; *ptr; ptr++)
 	  *ptr = grub_toupper (*ptr);
-      free_file (&data->mmft);
-      free_file (&data->cmft);
-      grub_free (data);
+      grub_fs_mount_cache_put (&grub_ntfs_fs, data);
     }
   else
     *uuid = NULL;
@@ -1250,15 +1282,23 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
   return grub_errno;
 }
 
+static const struct grub_fs_signature grub_ntfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (3, "NTFS"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_ntfs_fs =
   {
     .name = "ntfs",
+    .signatures = grub_ntfs_signatures,
     .dir = grub_ntfs_dir,
     .open = grub_ntfs_open,
     .read = grub_ntfs_read,
     .close = grub_ntfs_close,
     .label = grub_ntfs_label,
     .uuid = grub_ntfs_uuid,
+    .free_mount = grub_ntfs_free,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
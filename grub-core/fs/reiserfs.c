@@ -1373,9 +1373,16 @@ grub_reiserfs_uuid (grub_device_t device, char **uuid)
   return grub_errno;
 }
 
+static const struct grub_fs_signature grub_reiserfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (65588, "ReIsEr"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_reiserfs_fs =
   {
     .name = "reiserfs",
+    .signatures = grub_reiserfs_signatures,
     .dir = grub_reiserfs_dir,
     .open = grub_reiserfs_open,
     .read = grub_reiserfs_read,
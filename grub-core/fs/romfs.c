@@ -454,9 +454,16 @@ grub_romfs_label (grub_device_t device, char **label)
 }
 
 
+static const struct grub_fs_signature grub_romfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (0, "-rom1fs-"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_romfs_fs =
   {
     .name = "romfs",
+    .signatures = grub_romfs_signatures,
     .dir = grub_romfs_dir,
     .open = grub_romfs_open,
     .read = grub_romfs_read,
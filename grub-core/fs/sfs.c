@@ -729,9 +729,16 @@ grub_sfs_label (grub_device_t device, char **label)
 }
 
 
+static const struct grub_fs_signature grub_sfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (0, "SFS\x00"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_sfs_fs =
   {
     .name = "sfs",
+    .signatures = grub_sfs_signatures,
     .dir = grub_sfs_dir,
     .open = grub_sfs_open,
     .read = grub_sfs_read,
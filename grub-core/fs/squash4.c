@@ -27,9 +27,11 @@
 #include <grub/fshelp.h>
 #include <grub/deflate.h>
 #include <minilzo.h>
+#include <grub/lib/lz4.h>
 
 #include "xz.h"
 #include "xz_stream.h"
+#include "zstd.h"
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -183,6 +185,8 @@ enum
     COMPRESSION_ZLIB = 1,
     COMPRESSION_LZO = 3,
     COMPRESSION_XZ = 4,
+    COMPRESSION_LZ4 = 5,
+    COMPRESSION_ZSTD = 6,
   };
 
 
@@ -202,6 +206,9 @@ struct grub_squash_data
 			      struct grub_squash_data *data);
   struct xz_dec *xzdec;
   char *xzbuf;
+  ZSTD_DCtx *zstdctx;
+  /* Uncompressed block for zstd and lz4.  */
+  char *blockbuf;
 };
 
 struct grub_fshelp_node
@@ -377,6 +384,77 @@ xz_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   return ret;
 }
 
+/* Metadata chunks may be bigger than data blocks.  */
+static grub_size_t
+block_bufsize (grub_size_t blksz)
+{
+  return blksz < SQUASH_CHUNK_SIZE ? SQUASH_CHUNK_SIZE : blksz;
+}
+
+static grub_ssize_t
+zstd_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		 char *outbuf, grub_size_t len, struct grub_squash_data *data)
+{
+  grub_size_t usize = block_bufsize (data->blksz);
+  grub_size_t zret;
+
+  /* Decompress whole blocks straight into the caller's buffer.  */
+  if (off == 0 && len >= usize)
+    {
+      zret = ZSTD_decompressDCtx (data->zstdctx, outbuf, len, inbuf, insize);
+      if (ZSTD_isError (zret))
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid zstd chunk");
+	  return -1;
+	}
+      return zret;
+    }
+
+  zret = ZSTD_decompressDCtx (data->zstdctx, data->blockbuf, usize,
+			      inbuf, insize);
+  if (ZSTD_isError (zret))
+    {
+      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid zstd chunk");
+      return -1;
+    }
+  if (off >= zret)
+    return 0;
+  if (len > zret - off)
+    len = zret - off;
+  grub_memcpy (outbuf, data->blockbuf + off, len);
+  return len;
+}
+
+static grub_ssize_t
+lz4_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		char *outbuf, grub_size_t len, struct grub_squash_data *data)
+{
+  grub_size_t usize = block_bufsize (data->blksz);
+  grub_ssize_t ret;
+
+  /* Decompress whole blocks straight into the caller's buffer.  */
+  if (off == 0 && len >= usize)
+    {
+      ret = grub_lz4_decompress (inbuf, insize, outbuf, len, 0);
+      if (ret < 0)
+	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid lz4 chunk");
+      return ret;
+    }
+
+  ret = grub_lz4_decompress (inbuf, insize, data->blockbuf, usize, 0);
+  if (ret < 0)
+    {
+      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid lz4 chunk");
+      return -1;
+    }
+  if (off >= (grub_size_t) ret)
+    return 0;
+  if (len > ret - off)
+    len = ret - off;
+  grub_memcpy (outbuf, data->blockbuf + off, len);
+  return len;
+}
+
 static struct grub_squash_data *
 squash_mount (grub_disk_t disk)
 {
@@ -439,6 +517,33 @@ squash_mount (grub_disk_t disk)
 	  return NULL;
 	}
       break;
+    case grub_cpu_to_le16_compile_time (COMPRESSION_LZ4):
+      data->decompress = lz4_decompress;
+      data->blockbuf = grub_malloc (block_bufsize (grub_le_to_cpu32
+						   (sb.block_size)));
+      if (!data->blockbuf)
+	{
+	  grub_free (data);
+	  return NULL;
+	}
+      break;
+    case grub_cpu_to_le16_compile_time (COMPRESSION_ZSTD):
+      data->decompress = zstd_decompress;
+      data->blockbuf = grub_malloc (block_bufsize (grub_le_to_cpu32
+						   (sb.block_size)));
+      if (!data->blockbuf)
+	{
+	  grub_free (data);
+	  return NULL;
+	}
+      data->zstdctx = ZSTD_createDCtx ();
+      if (!data->zstdctx)
+	{
+	  grub_free (data->blockbuf);
+	  grub_free (data);
+	  return NULL;
+	}
+      break;
     default:
       grub_free (data);
       grub_error (GRUB_ERR_BAD_FS, "unsupported compression %d",
@@ -634,6 +739,9 @@ squash_unmount (struct grub_squash_data *data)
   if (data->xzdec)
     xz_dec_end (data->xzdec);
   grub_free (data->xzbuf);
+  if (data->zstdctx)
+    ZSTD_freeDCtx (data->zstdctx);
+  grub_free (data->blockbuf);
   grub_free (data->ino.cumulated_block_sizes);
   grub_free (data->ino.block_sizes);
   grub_free (data);
@@ -972,9 +1080,16 @@ grub_squash_mtime (grub_device_t dev, grub_int32_t *tm)
   return GRUB_ERR_NONE;
 } 
 
+static const struct grub_fs_signature grub_squash_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (0, "hsqs"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_squash_fs =
   {
     .name = "squash4",
+    .signatures = grub_squash_signatures,
     .dir = grub_squash_dir,
     .open = grub_squash_open,
     .read = grub_squash_read,
@@ -23,6 +23,7 @@
 #include <grub/misc.h>
 #include <grub/disk.h>
 #include <grub/dl.h>
+#include <grub/fshelp.h>
 #include <grub/types.h>
 #include <grub/i18n.h>
 
@@ -312,6 +313,29 @@ grub_ufs_get_file_block (struct grub_ufs_data *data, grub_disk_addr_t blk)
 }
 
 
+/* Map the fragment FRAG of the current inode to a disk fragment and store
+   the number of fragments left in its block in *LEN.  */
+static grub_disk_addr_t
+grub_ufs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t frag,
+		      grub_disk_addr_t *len)
+{
+  struct grub_ufs_data *data = (struct grub_ufs_data *) node;
+  int log2_frags = (data->log2_blksz - GRUB_DISK_SECTOR_BITS
+		    - grub_le_to_cpu32 (data->sblock.log2_blksz));
+  grub_disk_addr_t blknr, idx;
+
+  idx = frag & ((1 << log2_frags) - 1);
+  *len = (1 << log2_frags) - idx;
+
+  /* XXX: If the block number is 0 this block is not stored on
+     disk but is zero filled instead.  */
+  blknr = grub_ufs_get_file_block (data, frag >> log2_frags);
+  if (! blknr)
+    return 0;
+
+  return blknr + idx;
+}
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -320,65 +344,14 @@ grub_ufs_read_file (struct grub_ufs_data *data,
 				       unsigned offset, unsigned length),
 		    grub_off_t pos, grub_size_t len, char *buf)
 {
-  struct grub_ufs_sblock *sblock = &data->sblock;
-  grub_off_t i;
-  grub_off_t blockcnt;
-
-  /* Adjust len so it we can't read past the end of the file.  */
-  if (len + pos > INODE_SIZE (data))
-    len = INODE_SIZE (data) - pos;
-
-  blockcnt = (len + pos + UFS_BLKSZ (sblock) - 1) >> UFS_LOG_BLKSZ (sblock);
-
-  for (i = pos >> UFS_LOG_BLKSZ (sblock); i < blockcnt; i++)
-    {
-      grub_disk_addr_t blknr;
-      grub_off_t blockoff;
-      grub_off_t blockend = UFS_BLKSZ (sblock);
-
-      int skipfirst = 0;
-
-      blockoff = pos & (UFS_BLKSZ (sblock) - 1);
-
-      blknr = grub_ufs_get_file_block (data, i);
-      if (grub_errno)
-	return -1;
-
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (UFS_BLKSZ (sblock) - 1);
-
-	  if (!blockend)
-	    blockend = UFS_BLKSZ (sblock);
-	}
-
-      /* First block.  */
-      if (i == (pos >> UFS_LOG_BLKSZ (sblock)))
-	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
-	}
-
-      /* XXX: If the block number is 0 this block is not stored on
-	 disk but is zero filled instead.  */
-      if (blknr)
-	{
-	  data->disk->read_hook = read_hook;
-	  grub_disk_read (data->disk,
-			  blknr << grub_le_to_cpu32 (data->sblock.log2_blksz),
-			  skipfirst, blockend, buf);
-	  data->disk->read_hook = 0;
-	  if (grub_errno)
-	    return -1;
-	}
-      else
-	grub_memset (buf, UFS_BLKSZ (sblock) - skipfirst, 0);
-
-      buf += UFS_BLKSZ (sblock) - skipfirst;
-    }
-
-  return len;
+  /* Blocks may end in fragments, so map the file with the granularity of
+     fragments, but ask for whole blocks at a time.  */
+  return grub_fshelp_read_file_extents (data->disk, (grub_fshelp_node_t) data,
+					read_hook, pos, len, buf,
+					grub_ufs_read_extent,
+					INODE_SIZE (data),
+					grub_le_to_cpu32 (data->sblock.log2_blksz),
+					0);
 }
 
 /* Read inode INO from the mounted filesystem described by DATA.  This
@@ -815,6 +788,22 @@ grub_ufs_mtime (grub_device_t device, grub_int32_t *tm)
 
 
 
+static const struct grub_fs_signature grub_ufs_signatures[] =
+  {
+#ifdef MODE_UFS2
+    GRUB_FS_SIGNATURE (66908, "\x19\x01\x54\x19"),
+    GRUB_FS_SIGNATURE (9564, "\x19\x01\x54\x19"),
+    GRUB_FS_SIGNATURE (1372, "\x19\x01\x54\x19"),
+    GRUB_FS_SIGNATURE (263516, "\x19\x01\x54\x19"),
+#else
+    GRUB_FS_SIGNATURE (66908, "\x54\x19\x01\x00"),
+    GRUB_FS_SIGNATURE (9564, "\x54\x19\x01\x00"),
+    GRUB_FS_SIGNATURE (1372, "\x54\x19\x01\x00"),
+    GRUB_FS_SIGNATURE (263516, "\x54\x19\x01\x00"),
+#endif
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_ufs_fs =
   {
 #ifdef MODE_UFS2
@@ -822,6 +811,7 @@ static struct grub_fs grub_ufs_fs =
 #else
     .name = "ufs1",
 #endif
+    .signatures = grub_ufs_signatures,
     .dir = grub_ufs_dir,
     .open = grub_ufs_open,
     .read = grub_ufs_read,
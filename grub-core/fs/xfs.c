@@ -25,6 +25,7 @@
 #include <grub/dl.h>
 #include <grub/types.h>
 #include <grub/fshelp.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -157,11 +158,14 @@ struct grub_xfs_data
   int pos;
   int bsize;
   grub_uint32_t agsize;
+  struct grub_fshelp_dcache *dcache;
   struct grub_fshelp_node diropen;
 };
 
 static grub_dl_t my_mod;
 
+static struct grub_fs grub_xfs_fs;
+
 
 
 /* Filetype information as used in inodes.  */
@@ -275,14 +279,19 @@ grub_xfs_read_inode (struct grub_xfs_data *data, grub_uint64_t ino,
 }
 
 
+/* Map FILEBLOCK of NODE to a disk block and store in *LEN how many blocks
+   of the file follow it contiguously on disk.  */
 static grub_disk_addr_t
-grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_xfs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *len)
 {
   struct grub_xfs_btree_node *leaf = 0;
   int ex, nrec;
   grub_xfs_extent *exts;
   grub_uint64_t ret = 0;
 
+  *len = 1;
+
   if (node->inode.format == XFS_INODE_FORMAT_BTREE)
     {
       grub_uint64_t *keys;
@@ -363,10 +372,14 @@ grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
       /* Sparse block.  */
       if (fileblock < offset)
-        break;
+        {
+          *len = offset - fileblock;
+          break;
+        }
       else if (fileblock < offset + size)
         {
           ret = (fileblock - offset + start);
+          *len = offset + size - fileblock;
           break;
         }
     }
@@ -385,11 +398,11 @@ grub_xfs_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_xfs_read_block,
-				grub_be_to_cpu64 (node->inode.size),
-				node->data->sblock.log2_bsize
-				- GRUB_DISK_SECTOR_BITS, 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_xfs_read_extent,
+					grub_be_to_cpu64 (node->inode.size),
+					node->data->sblock.log2_bsize
+					- GRUB_DISK_SECTOR_BITS, 0);
 }
 
 
@@ -691,6 +704,11 @@ grub_xfs_mount (grub_disk_t disk)
 
   grub_xfs_read_inode (data, data->diropen.ino, &data->diropen.inode);
 
+  data->dcache = grub_fshelp_dcache_new (sizeof (struct grub_fshelp_node)
+					 - sizeof (struct grub_xfs_inode)
+					 + (1 << data->sblock.log2_inode));
+  grub_errno = GRUB_ERR_NONE;
+
   return data;
  fail:
 
@@ -702,6 +720,47 @@ grub_xfs_mount (grub_disk_t disk)
   return 0;
 }
 
+static void
+grub_xfs_free (void *data)
+{
+  grub_fshelp_dcache_free (((struct grub_xfs_data *) data)->dcache);
+  grub_free (data);
+}
+
+/* Return the filesystem on DISK, reusing an instance from the mount cache
+   when possible.  */
+static struct grub_xfs_data *
+grub_xfs_get (grub_disk_t disk)
+{
+  struct grub_xfs_data *data;
+
+  data = grub_fs_mount_cache_get (&grub_xfs_fs, disk);
+  if (! data)
+    {
+      int span;
+
+      span = grub_boottrace_begin ("mount", "%s %s", grub_xfs_fs.name,
+				   disk->name);
+      data = grub_xfs_mount (disk);
+      grub_boottrace_end (span);
+      if (data)
+	grub_fs_mount_cache_add (&grub_xfs_fs, disk, data);
+      return data;
+    }
+
+  /* The last open left its file in DIROPEN.  */
+  data->disk = disk;
+  data->diropen.ino = data->sblock.rootino;
+  data->diropen.inode_read = 1;
+  if (grub_xfs_read_inode (data, data->diropen.ino, &data->diropen.inode))
+    {
+      grub_fs_mount_cache_put (&grub_xfs_fs, data);
+      return 0;
+    }
+
+  return data;
+}
+
 
 static grub_err_t
 grub_xfs_dir (grub_device_t device, const char *path,
@@ -733,12 +792,13 @@ grub_xfs_dir (grub_device_t device, const char *path,
 
   grub_dl_ref (my_mod);
 
-  data = grub_xfs_mount (device->disk);
+  data = grub_xfs_get (device->disk);
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (data->dcache, path, &data->diropen, &fdiro,
+				grub_xfs_iterate_dir, grub_xfs_read_symlink,
+				GRUB_FSHELP_DIR);
   if (grub_errno)
     goto fail;
 
@@ -747,7 +807,7 @@ grub_xfs_dir (grub_device_t device, const char *path,
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_xfs_fs, data);
 
  mount_fail:
 
@@ -766,12 +826,13 @@ grub_xfs_open (struct grub_file *file, const char *name)
 
   grub_dl_ref (my_mod);
 
-  data = grub_xfs_mount (file->device->disk);
+  data = grub_xfs_get (file->device->disk);
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (name, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (data->dcache, name, &data->diropen, &fdiro,
+				grub_xfs_iterate_dir, grub_xfs_read_symlink,
+				GRUB_FSHELP_REG);
   if (grub_errno)
     goto fail;
 
@@ -800,7 +861,7 @@ grub_xfs_open (struct grub_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_xfs_fs, data);
 
  mount_fail:
   grub_dl_unref (my_mod);
@@ -823,7 +884,7 @@ grub_xfs_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_xfs_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_fs_mount_cache_put (&grub_xfs_fs, file->data);
 
   grub_dl_unref (my_mod);
 
@@ -839,7 +900,7 @@ grub_xfs_label (grub_device_t device, char **label)
 
   grub_dl_ref (my_mod);
 
-  data = grub_xfs_mount (disk);
+  data = grub_xfs_get (disk);
   if (data)
     *label = grub_strndup ((char *) (data->sblock.label), 12);
   else
@@ -847,7 +908,7 @@ grub_xfs_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_xfs_fs, data);
 
   return grub_errno;
 }
@@ -860,7 +921,7 @@ grub_xfs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_ref (my_mod);
 
-  data = grub_xfs_mount (disk);
+  data = grub_xfs_get (disk);
   if (data)
     {
       *uuid = grub_xasprintf ("%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
@@ -878,22 +939,30 @@ grub_xfs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fs_mount_cache_put (&grub_xfs_fs, data);
 
   return grub_errno;
 }
 
 
 
+static const struct grub_fs_signature grub_xfs_signatures[] =
+  {
+    GRUB_FS_SIGNATURE (0, "XFSB"),
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_xfs_fs =
   {
     .name = "xfs",
+    .signatures = grub_xfs_signatures,
     .dir = grub_xfs_dir,
     .open = grub_xfs_open,
     .read = grub_xfs_read,
     .close = grub_xfs_close,
     .label = grub_xfs_label,
     .uuid = grub_xfs_uuid,
+    .free_mount = grub_xfs_free,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 1,
@@ -54,6 +54,7 @@
 #include <grub/deflate.h>
 #include <grub/crypto.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -3307,9 +3308,13 @@ unmount_device (struct grub_zfs_device_desc *desc)
     }
 }
 
+static struct grub_fs grub_zfs_fs;
+
+/* Free DATA for good, once it leaves the mount cache.  */
 static void
-zfs_unmount (struct grub_zfs_data *data)
+zfs_free (void *ptr)
 {
+  struct grub_zfs_data *data = ptr;
   unsigned i;
   for (i = 0; i < data->n_devices_attached; i++)
     unmount_device (&data->devices_attached[i]);
@@ -3323,6 +3328,12 @@ zfs_unmount (struct grub_zfs_data *data)
   grub_free (data);
 }
 
+static void
+zfs_unmount (struct grub_zfs_data *data)
+{
+  grub_fs_mount_cache_put (&grub_zfs_fs, data);
+}
+
 /*
  * zfs_mount() locates a valid uberblock of the root pool and read in its MOS
  * to the memory address MOS.
@@ -3338,6 +3349,7 @@ zfs_mount (grub_device_t dev)
   grub_zfs_endian_t ub_endian = GRUB_ZFS_UNKNOWN_ENDIAN;
   uberblock_t *ub;
   int inserted;
+  int span;
 
   if (! dev->disk)
     {
@@ -3345,9 +3357,31 @@ zfs_mount (grub_device_t dev)
       return 0;
     }
 
+  /* Reuse the pool, after forgetting the file and the subvolume of the
+     last user.  */
+  data = grub_fs_mount_cache_get (&grub_zfs_fs, dev->disk);
+  if (data)
+    {
+      unsigned i;
+
+      if (data->device_original)
+	data->device_original->dev = dev;
+      grub_free (data->file_buf);
+      data->file_buf = 0;
+      data->file_start = data->file_end = 0;
+      for (i = 0; i < data->subvol.nkeys; i++)
+	grub_crypto_cipher_close (data->subvol.keyring[i].cipher);
+      grub_free (data->subvol.keyring);
+      grub_memset (&data->subvol, 0, sizeof (data->subvol));
+      return data;
+    }
+
   data = grub_zalloc (sizeof (*data));
   if (!data)
     return 0;
+
+  span = grub_boottrace_begin ("mount", "%s %s", grub_zfs_fs.name,
+			       dev->disk->name);
 #if 0
   /* if it's our first time here, zero the best uberblock out */
   if (data->best_drive == 0 && data->best_part == 0 && find_best_root)
@@ -3362,6 +3396,7 @@ zfs_mount (grub_device_t dev)
   if (err)
     {
       zfs_unmount (data);
+      grub_boottrace_end (span);
       return NULL;
     }
 
@@ -3375,6 +3410,7 @@ zfs_mount (grub_device_t dev)
   if (err)
     {
       zfs_unmount (data);
+      grub_boottrace_end (span);
       return NULL;
     }
 
@@ -3383,6 +3419,7 @@ zfs_mount (grub_device_t dev)
       grub_error (GRUB_ERR_BAD_FS, "OSP too small");
       grub_free (osp);
       zfs_unmount (data);
+      grub_boottrace_end (span);
       return NULL;
     }
 
@@ -3394,6 +3431,9 @@ zfs_mount (grub_device_t dev)
   grub_free (osp);
 
   data->mounted = 1;
+  grub_boottrace_end (span);
+
+  grub_fs_mount_cache_add (&grub_zfs_fs, dev->disk, data);
 
   return data;
 }
@@ -3535,10 +3575,14 @@ grub_zfs_open (struct grub_file *file, const char *fsfilename)
 
 	  err = zio_read (bp, data->dnode.endian, &sahdrp, NULL, data);
 	  if (err)
-	    return err;
+	    {
+	      zfs_unmount (data);
+	      return err;
+	    }
 	}
       else
 	{
+	  zfs_unmount (data);
 	  return grub_error (GRUB_ERR_BAD_FS, "filesystem is corrupt");
 	}
 
@@ -3550,7 +3594,10 @@ grub_zfs_open (struct grub_file *file, const char *fsfilename)
       file->size = grub_zfs_to_cpu64 (((znode_phys_t *) DN_BONUS (&data->dnode.dn))->zp_size, data->dnode.endian);
     }
   else
-    return grub_error (GRUB_ERR_BAD_FS, "bad bonus type");
+    {
+      zfs_unmount (data);
+      return grub_error (GRUB_ERR_BAD_FS, "bad bonus type");
+    }
 
   file->data = data;
   file->offset = 0;
@@ -3951,6 +3998,7 @@ static struct grub_fs grub_zfs_fs = {
   .label = zfs_label,
   .uuid = zfs_uuid,
   .mtime = zfs_mtime,
+  .free_mount = zfs_free,
 #ifdef GRUB_UTIL
   .embed = grub_zfs_embed,
   .reserved_first_sector = 1,
@@ -37,6 +37,7 @@
 #include <grub/gui_string_util.h>
 #include <grub/icon_manager.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 static void
 init_terminal (grub_gfxmenu_view_t view);
@@ -53,6 +54,8 @@ grub_gfxmenu_view_new (const char *theme_path,
   grub_font_t default_font;
   grub_video_rgba_color_t default_fg_color;
   grub_video_rgba_color_t default_bg_color;
+  grub_err_t err;
+  int span;
 
   view = grub_malloc (sizeof (*view));
   if (! view)
@@ -90,7 +93,10 @@ grub_gfxmenu_view_new (const char *theme_path,
   view->progress_message_frame.y = view->screen.y
     + view->screen.height - 90 - 20 - view->progress_message_frame.height;
 
-  if (grub_gfxmenu_view_load_theme (view, theme_path) != 0)
+  span = grub_boottrace_begin ("theme", "%s", theme_path);
+  err = grub_gfxmenu_view_load_theme (view, theme_path);
+  grub_boottrace_end (span);
+  if (err != 0)
     {
       grub_gfxmenu_view_destroy (view);
       return 0;
@@ -22,6 +22,8 @@
  * by Mark Adler.  It has been very heavily modified.  In particular, the
  * original would run through the whole file at once, and this version can
  * be stopped and restarted on any boundary during the decompression process.
+ * The decoder itself has since been replaced by a table-driven one in the
+ * manner of zlib's inflate_fast, with a 64-bit bit buffer.
  *
  * The license and header comments that file are included here.
  */
@@ -55,7 +57,72 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define WSIZE	0x8000
 
 
-#define INBUFSIZ  0x2000
+#define INBUFSIZ  0x10000
+
+/* Reads of at least this many bytes at the current position are
+   decompressed straight into the caller's buffer, smaller ones into the
+   scratch buffer and copied from the window.  */
+#define DIRECT_MIN	0x1000
+
+/* Checkpoints to resume decompressing from are taken at the first block
+   boundary after every CHECKPOINT_SPAN bytes of output.  When there are
+   MAX_CHECKPOINTS of them, every other one is dropped and the span
+   doubled.  */
+#define CHECKPOINT_SPAN	0x100000
+#define MAX_CHECKPOINTS	256
+
+/* An entry of the decoding tables.  A table is indexed by the next bits of
+   the input and the entry says how many of them the code takes and what it
+   decodes to.  Length and distance entries carry the base value and the
+   number of extra bits that follow the code, so that a whole length or
+   distance is decoded with one lookup.  Codes longer than the root bits of
+   the table continue in a sub-table.  */
+struct inflate_entry
+{
+  /* The number of extra bits, or one of the OP_* below.  */
+  grub_uint8_t op;
+  /* The number of bits of the code used by this entry.  */
+  grub_uint8_t bits;
+  /* The literal, the base value or the offset of the sub-table.  */
+  grub_uint16_t val;
+};
+
+#define OP_LITERAL	0x10
+#define OP_END		0x11
+#define OP_INVALID	0x12
+/* Plus the number of index bits of the sub-table.  */
+#define OP_SUBTABLE	0x20
+
+/* The root bits of the tables and the worst case sizes of the tables with
+   their sub-tables, as computed by zlib's enough.c.  */
+#define LIT_BITS	9
+#define LIT_ENOUGH	852
+#define DIST_BITS	6
+#define DIST_ENOUGH	592
+#define CODELEN_BITS	7
+
+#define MAX_BITS	15
+
+/* A point at the start of a block to resume decompressing from.  */
+struct gzio_checkpoint
+{
+  /* The offset in the uncompressed data.  */
+  grub_off_t pos;
+  /* The offset in bits of the block in the underlying file.  */
+  grub_uint64_t bitpos;
+  /* The WHAVE bytes before POS, oldest first.  */
+  unsigned whave;
+  grub_uint8_t *window;
+};
+
+/* The state of the decompressor.  */
+enum
+  {
+    STATE_HEADER,
+    STATE_STORED,
+    STATE_CODES,
+    STATE_DONE
+  };
 
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
@@ -63,43 +130,56 @@ struct grub_gzio
   /* The underlying file object.  */
   grub_file_t file;
   /* If input is in memory following fields are used instead of file.  */
-  grub_size_t mem_input_size, mem_input_off;
-  grub_uint8_t *mem_input;
+  grub_size_t mem_input_size;
+  const grub_uint8_t *mem_input;
   /* The offset at which the data starts in the underlying file.  */
   grub_off_t data_offset;
-  /* The type of current block.  */
-  int block_type;
-  /* The length of current block.  */
-  int block_len;
+  /* The input buffer, for input from a file.  */
+  grub_uint8_t *inbuf;
+  /* The offset of the input buffer in the underlying file.  */
+  grub_off_t inbuf_offset;
+  /* The unread part of the input.  */
+  const grub_uint8_t *in_next;
+  const grub_uint8_t *in_end;
+  /* The number of zero bytes fed after the end of the input.  */
+  unsigned overrun;
+  /* The bit buffer.  Bits above BITCNT may hold the bits of the next input
+     byte already.  */
+  grub_uint64_t bitbuf;
+  /* The bits in the bit buffer.  */
+  unsigned bitcnt;
+  /* What comes next in the stream.  */
+  int state;
   /* The flag of the last block.  */
   int last_block;
-  /* The flag of codes.  */
-  int code_state;
-  /* The length of a copy.  */
-  unsigned inflate_n;
-  /* The index of a copy.  */
-  unsigned inflate_d;
-  /* The input buffer.  */
-  grub_uint8_t inbuf[INBUFSIZ];
-  int inbuf_d;
-  /* The bit buffer.  */
-  unsigned long bb;
-  /* The bits in the bit buffer.  */
-  unsigned bk;
-  /* The sliding window in uncompressed data.  */
-  grub_uint8_t slide[WSIZE];
-  /* Current position in the slide.  */
-  unsigned wp;
-  /* The literal/length code table.  */
-  struct huft *tl;
-  /* The distance code table.  */
-  struct huft *td;
-  /* The lookup bits for the literal/length code table. */
-  int bl;
-  /* The lookup bits for the distance code table.  */
-  int bd;
-  /* The original offset value.  */
-  grub_off_t saved_offset;
+  /* The bytes left in the current stored block.  */
+  grub_uint32_t block_len;
+  /* The rest of a copy which didn't fit in the output.  */
+  unsigned match_len;
+  unsigned match_dist;
+  /* The tables of the current block.  */
+  const struct inflate_entry *lit;
+  const struct inflate_entry *dist;
+  /* The number of bytes decompressed so far.  */
+  grub_off_t pos;
+  /* The last WSIZE bytes decompressed, as a circular buffer, or NULL if
+     everything is decompressed in one go.  */
+  grub_uint8_t *window;
+  /* Where the next byte goes in the window.  */
+  unsigned wnext;
+  /* The valid bytes in the window.  */
+  unsigned whave;
+  /* WSIZE bytes to decompress into when the caller's buffer can't be
+     used.  */
+  grub_uint8_t *scratch;
+  /* The checkpoints taken so far, by increasing position.  */
+  struct gzio_checkpoint *checkpoints;
+  unsigned ncheckpoints;
+  grub_off_t checkpoint_span;
+  /* The tables of dynamic blocks.  */
+  struct inflate_entry lit_table[LIT_ENOUGH];
+  struct inflate_entry dist_table[DIST_ENOUGH];
+  struct inflate_entry codelen_table[1 << CODELEN_BITS];
 };
 typedef struct grub_gzio *grub_gzio_t;
 
@@ -164,10 +244,6 @@ eat_field (grub_file_t file, int len)
 #define INFLATE_FIXED	1
 #define INFLATE_DYNAMIC	2
 
-typedef unsigned char uch;
-typedef unsigned short ush;
-typedef unsigned long ulg;
-
 static int
 test_gzip_header (grub_file_t file)
 {
@@ -229,895 +305,856 @@ test_gzip_header (grub_file_t file)
 }
 
 
-/* Huffman code lookup table entry--this entry is four bytes for machines
-   that have 16-bit pointers (e.g. PC's in the small or medium model).
-   Valid extra bits are 0..13.  e == 15 is EOB (end of block), e == 16
-   means that v is a literal, 16 < e < 32 means that v is a pointer to
-   the next table, which codes e - 16 bits, and lastly e == 99 indicates
-   an unused code.  If a code with e == 99 is looked up, this implies an
-   error in the data. */
-struct huft
-{
-  uch e;			/* number of extra bits or operation */
-  uch b;			/* number of bits in this code or subcode */
-  union
-    {
-      ush n;			/* literal, length base, or distance base */
-      struct huft *t;		/* pointer to next level of table */
-    }
-  v;
-};
-
-
-/* The inflate algorithm uses a sliding 32K byte window on the uncompressed
-   stream to find repeated byte strings.  This is implemented here as a
-   circular buffer.  The index is updated simply by incrementing and then
-   and'ing with 0x7fff (32K-1). */
-/* It is left to other modules to supply the 32K area.  It is assumed
-   to be usable as if it were declared "uch slide[32768];" or as just
-   "uch *slide;" and then malloc'ed in the latter case.  The definition
-   must be in unzip.h, included above. */
-
-
 /* Tables for deflate from PKZIP's appnote.txt. */
-static unsigned bitorder[] =
+static const grub_uint8_t bitorder[] =
 {				/* Order of the bit length code lengths */
   16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-static ush cplens[] =
+static const grub_uint16_t cplens[] =
 {				/* Copy lengths for literal codes 257..285 */
   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0};
-	/* note: see note #13 above about the 258 in this list. */
-static ush cplext[] =
+static const grub_uint8_t cplext[] =
 {				/* Extra bits for literal codes 257..285 */
   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
-  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 99, 99};	/* 99==invalid */
-static ush cpdist[] =
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, OP_INVALID, OP_INVALID};
+static const grub_uint16_t cpdist[] =
 {				/* Copy offsets for distance codes 0..29 */
   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
-  8193, 12289, 16385, 24577};
-static ush cpdext[] =
+  8193, 12289, 16385, 24577, 0, 0};
+static const grub_uint8_t cpdext[] =
 {				/* Extra bits for distance codes */
   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
   7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
-  12, 12, 13, 13};
-
-
-/*
-   Huffman code decoding is performed using a multi-level table lookup.
-   The fastest way to decode is to simply build a lookup table whose
-   size is determined by the longest code.  However, the time it takes
-   to build this table can also be a factor if the data being decoded
-   is not very long.  The most common codes are necessarily the
-   shortest codes, so those codes dominate the decoding time, and hence
-   the speed.  The idea is you can have a shorter table that decodes the
-   shorter, more probable codes, and then point to subsidiary tables for
-   the longer codes.  The time it costs to decode the longer codes is
-   then traded against the time it takes to make longer tables.
-
-   This results of this trade are in the variables lbits and dbits
-   below.  lbits is the number of bits the first level table for literal/
-   length codes can decode in one step, and dbits is the same thing for
-   the distance codes.  Subsequent tables are also less than or equal to
-   those sizes.  These values may be adjusted either when all of the
-   codes are shorter than that, in which case the longest code length in
-   bits is used, or when the shortest code is *longer* than the requested
-   table size, in which case the length of the shortest code in bits is
-   used.
-
-   There are two different values for the two tables, since they code a
-   different number of possibilities each.  The literal/length table
-   codes 286 possible values, or in a flat code, a little over eight
-   bits.  The distance table codes 30 possible values, or a little less
-   than five bits, flat.  The optimum values for speed end up being
-   about one bit more than those, so lbits is 8+1 and dbits is 5+1.
-   The optimum values may differ though from machine to machine, and
-   possibly even between compilers.  Your mileage may vary.
- */
-
+  12, 12, 13, 13, OP_INVALID, OP_INVALID};
 
-static int lbits = 9;		/* bits in base literal/length lookup table */
-static int dbits = 6;		/* bits in base distance lookup table */
+#pragma GCC diagnostic ignored "-Wunsafe-loop-optimizations"
 
+/* The kinds of tables.  */
+enum
+  {
+    TABLE_CODELEN,
+    TABLE_LIT,
+    TABLE_DIST
+  };
 
-/* If BMAX needs to be larger than 16, then h and x[] should be ulg. */
-#define BMAX 16			/* maximum bit length of any code (16 for explode) */
-#define N_MAX 288		/* maximum number of codes in any set */
+/* The tables of fixed blocks, built on first use.  */
+static struct inflate_entry fixed_lit[1 << LIT_BITS];
+static struct inflate_entry fixed_dist[1 << DIST_BITS];
+static int fixed_built;
 
+static struct inflate_entry
+symbol_entry (int kind, unsigned sym)
+{
+  struct inflate_entry e;
+
+  e.bits = 0;
+  e.val = sym;
+  if (kind == TABLE_CODELEN || (kind == TABLE_LIT && sym < 256))
+    e.op = OP_LITERAL;
+  else if (kind == TABLE_LIT && sym == 256)
+    e.op = OP_END;
+  else if (kind == TABLE_LIT)
+    {
+      e.op = cplext[sym - 257];
+      e.val = cplens[sym - 257];
+    }
+  else
+    {
+      e.op = cpdext[sym];
+      e.val = cpdist[sym];
+    }
+  return e;
+}
 
-/* Macros for inflate() bit peeking and grabbing.
-   The usage is:
+/* Build in TABLE, of SIZE entries, the table of the KIND for the N code
+   lengths LENS, with ROOT bits in the first level.  Like zlib, only accept
+   complete codes or a single code of one bit: the sizes of the tables
+   depend on it.  Return non-zero if the lengths are invalid.  */
+static int
+build_table (const grub_uint8_t *lens, unsigned n, int kind, unsigned root,
+	     struct inflate_entry *table, unsigned size)
+{
+  unsigned count[MAX_BITS + 1], offs[MAX_BITS + 2];
+  grub_uint16_t sorted[288];
+  struct inflate_entry e;
+  unsigned len, max, sym, i, j;
+  unsigned code, used, sub = 0, sub_base = 0, prefix = ~0U;
+  int left;
+
+  grub_memset (count, 0, sizeof (count));
+  for (sym = 0; sym < n; sym++)
+    count[lens[sym]]++;
+  count[0] = 0;
+
+  max = MAX_BITS;
+  while (max > 0 && ! count[max])
+    max--;
+
+  left = 1;
+  for (len = 1; len <= MAX_BITS; len++)
+    {
+      left <<= 1;
+      left -= count[len];
+      if (left < 0)
+	return 1;
+    }
+  if (left > 0 && max > 1)
+    return 1;
+
+  offs[1] = 0;
+  for (len = 1; len <= MAX_BITS; len++)
+    offs[len + 1] = offs[len] + count[len];
+  for (sym = 0; sym < n; sym++)
+    if (lens[sym])
+      sorted[offs[lens[sym]]++] = sym;
+
+  e.op = OP_INVALID;
+  e.bits = 1;
+  e.val = 0;
+  for (i = 0; i < (1U << root); i++)
+    table[i] = e;
+  used = 1 << root;
+
+  /* Hand out the canonical codes in order.  The tables are indexed by the
+     codes bit-reversed, as they come in the input.  */
+  code = 0;
+  i = 0;
+  for (len = 1; len <= max; len++, code <<= 1)
+    for (; count[len]; count[len]--, code++)
+      {
+	unsigned rev = 0;
+
+	for (j = 0; j < len; j++)
+	  rev |= ((code >> j) & 1) << (len - 1 - j);
+
+	e = symbol_entry (kind, sorted[i++]);
+	if (len <= root)
+	  {
+	    e.bits = len;
+	    for (j = rev; j < (1U << root); j += 1 << len)
+	      table[j] = e;
+	    continue;
+	  }
+
+	if ((rev & ((1 << root) - 1)) != prefix)
+	  {
+	    struct inflate_entry inv = { OP_INVALID, 1, 0 };
+	    int avail;
+
+	    /* A new sub-table, just big enough for the codes left which
+	       start with this prefix.  */
+	    prefix = rev & ((1 << root) - 1);
+	    sub = len - root;
+	    avail = 1 << sub;
+	    while (sub + root < max)
+	      {
+		avail -= count[sub + root];
+		if (avail <= 0)
+		  break;
+		sub++;
+		avail <<= 1;
+	      }
+	    if (used + (1 << sub) > size)
+	      return 1;
+	    sub_base = used;
+	    used += 1 << sub;
+	    for (j = 0; j < (1U << sub); j++)
+	      table[sub_base + j] = inv;
+	    table[prefix].op = OP_SUBTABLE + sub;
+	    table[prefix].bits = root;
+	    table[prefix].val = sub_base;
+	  }
+
+	if (len - root > sub)
+	  return 1;
+	e.bits = len - root;
+	for (j = rev >> root; j < (1U << sub); j += 1 << (len - root))
+	  table[sub_base + j] = e;
+      }
 
-        NEEDBITS(j)
-        x = b & mask_bits[j];
-        DUMPBITS(j)
+  return 0;
+}
 
-   where NEEDBITS makes sure that b has at least j bits in it, and
-   DUMPBITS removes the bits from b.  The macros use the variable k
-   for the number of bits in b.  Normally, b and k are register
-   variables for speed, and are initialized at the beginning of a
-   routine that uses these macros from a global bit buffer and count.
+static void
+build_fixed_tables (void)
+{
+  grub_uint8_t lens[288];
+  unsigned i;
 
-   If we assume that EOB will be the longest code, then we will never
-   ask for bits with NEEDBITS that are beyond the end of the stream.
-   So, NEEDBITS should not read any more bytes than are needed to
-   meet the request.  Then no bytes need to be "returned" to the buffer
-   at the end of the last block.
+  for (i = 0; i < 144; i++)
+    lens[i] = 8;
+  for (; i < 256; i++)
+    lens[i] = 9;
+  for (; i < 280; i++)
+    lens[i] = 7;
+  for (; i < 288; i++)
+    lens[i] = 8;
+  build_table (lens, 288, TABLE_LIT, LIT_BITS, fixed_lit,
+	       ARRAY_SIZE (fixed_lit));
+
+  for (i = 0; i < 32; i++)
+    lens[i] = 5;
+  build_table (lens, 32, TABLE_DIST, DIST_BITS, fixed_dist,
+	       ARRAY_SIZE (fixed_dist));
+
+  fixed_built = 1;
+}
 
-   However, this assumption is not true for fixed blocks--the EOB code
-   is 7 bits, but the other literal/length codes can be 8 or 9 bits.
-   (The EOB code is shorter than other codes because fixed blocks are
-   generally short.  So, while a block always has an EOB, many other
-   literal/length codes have a significantly lower probability of
-   showing up at all.)  However, by making the first table have a
-   lookup of seven bits, the EOB code will be found in that first
-   lookup, and so will not require that too many bits be pulled from
-   the stream.
- */
 
-static ush mask_bits[] =
+/* Read the next chunk of the input.  Return zero at its end.  */
+static int
+fill_input (grub_gzio_t gzio)
 {
-  0x0000,
-  0x0001, 0x0003, 0x0007, 0x000f, 0x001f, 0x003f, 0x007f, 0x00ff,
-  0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff
-};
+  grub_ssize_t n;
 
-#pragma GCC diagnostic ignored "-Wunsafe-loop-optimizations"
+  if (! gzio->file)
+    return 0;
 
-#define NEEDBITS(n) do {while(k<(n)){b|=((ulg)get_byte(gzio))<<k;k+=8;}} while (0)
-#define DUMPBITS(n) do {b>>=(n);k-=(n);} while (0)
+  gzio->inbuf_offset = grub_file_tell (gzio->file);
+  n = grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+  if (n <= 0)
+    return 0;
 
-static int
-get_byte (grub_gzio_t gzio)
+  gzio->in_next = gzio->inbuf;
+  gzio->in_end = gzio->inbuf + n;
+  return 1;
+}
+
+/* Fill the bit buffer with at least 56 bits.  Past the end of the input,
+   zeroes are fed, which a valid stream doesn't get to use: give up when
+   much more than a bit buffer of them has been consumed.  */
+static grub_err_t
+refill (grub_gzio_t gzio)
 {
-  if (gzio->mem_input)
+  if (gzio->in_end - gzio->in_next >= 8)
     {
-      if (gzio->mem_input_off < gzio->mem_input_size)
-	return gzio->mem_input[gzio->mem_input_off++];
-      return 0;
+      /* Load 8 bytes at once, keeping the whole ones.  */
+      gzio->bitbuf |= grub_le_to_cpu64 (grub_get_unaligned64 (gzio->in_next))
+	<< gzio->bitcnt;
+      gzio->in_next += (63 - gzio->bitcnt) >> 3;
+      gzio->bitcnt |= 56;
+      return GRUB_ERR_NONE;
     }
 
-  if (gzio->file && (grub_file_tell (gzio->file)
-		     == (grub_off_t) gzio->data_offset
-		     || gzio->inbuf_d == INBUFSIZ))
+  while (gzio->bitcnt <= 56)
     {
-      gzio->inbuf_d = 0;
-      grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      if (gzio->in_next == gzio->in_end && ! fill_input (gzio))
+	{
+	  if (grub_errno)
+	    return grub_errno;
+	  if (++gzio->overrun > 16)
+	    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			       N_("premature end of compressed data"));
+	  gzio->bitbuf &= ((grub_uint64_t) 1 << gzio->bitcnt) - 1;
+	  gzio->bitcnt += 8;
+	  continue;
+	}
+      gzio->bitbuf |= (grub_uint64_t) *gzio->in_next++ << gzio->bitcnt;
+      gzio->bitcnt += 8;
     }
 
-  return gzio->inbuf[gzio->inbuf_d++];
+  return GRUB_ERR_NONE;
 }
 
-static void
-gzio_seek (grub_gzio_t gzio, grub_off_t off)
+/* Take N bits, at most 32, off the bit buffer.  */
+static grub_err_t
+get_bits (grub_gzio_t gzio, unsigned n, unsigned *val)
 {
-  if (gzio->mem_input)
-    {
-      if (off > gzio->mem_input_size)
-	grub_error (GRUB_ERR_OUT_OF_RANGE,
-		    N_("attempt to seek outside of the file"));
-      else
-	gzio->mem_input_off = off;
-    }
-  else
-    grub_file_seek (gzio->file, off);
-}
+  if (gzio->bitcnt < n && refill (gzio))
+    return grub_errno;
 
-/* more function prototypes */
-static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
-		       struct huft **, int *);
-static int huft_free (struct huft *);
-static int inflate_codes_in_window (grub_gzio_t);
+  *val = gzio->bitbuf & ((1ULL << n) - 1);
+  gzio->bitbuf >>= n;
+  gzio->bitcnt -= n;
+  return GRUB_ERR_NONE;
+}
 
+static void
+end_block (grub_gzio_t gzio)
+{
+  gzio->state = gzio->last_block ? STATE_DONE : STATE_HEADER;
+}
 
-/* Given a list of code lengths and a maximum table size, make a set of
-   tables to decode that set of codes.  Return zero on success, one if
-   the given code set is incomplete (the tables are still built in this
-   case), two if the input is invalid (all zero length codes or an
-   oversubscribed set of lengths), and three if not enough memory. */
+static grub_err_t
+init_stored_block (grub_gzio_t gzio)
+{
+  unsigned len, nlen;
+
+  /* Go to a byte boundary and forget the bits beyond the buffer, since
+     the block is copied from the input directly.  */
+  gzio->bitbuf >>= gzio->bitcnt & 7;
+  gzio->bitcnt &= ~7;
+  if (get_bits (gzio, 16, &len) || get_bits (gzio, 16, &nlen))
+    return grub_errno;
+  gzio->bitbuf &= ((grub_uint64_t) 1 << gzio->bitcnt) - 1;
+
+  if (len != (~nlen & 0xffff))
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "the length of a stored block does not match");
+
+  gzio->block_len = len;
+  gzio->state = STATE_STORED;
+  if (! len)
+    end_block (gzio);
+  return GRUB_ERR_NONE;
+}
 
-static int
-huft_build (unsigned *b,	/* code lengths in bits (all assumed <= BMAX) */
-	    unsigned n,		/* number of codes (assumed <= N_MAX) */
-	    unsigned s,		/* number of simple-valued codes (0..s-1) */
-	    ush * d,		/* list of base values for non-simple codes */
-	    ush * e,		/* list of extra bits for non-simple codes */
-	    struct huft **t,	/* result: starting table */
-	    int *m)		/* maximum lookup bits, returns actual */
+static grub_err_t
+init_dynamic_block (grub_gzio_t gzio)
 {
-  unsigned a;			/* counter for codes of length k */
-  unsigned c[BMAX + 1];		/* bit length count table */
-  unsigned f;			/* i repeats in table every f entries */
-  int g;			/* maximum code length */
-  int h;			/* table level */
-  register unsigned i;		/* counter, current code */
-  register unsigned j;		/* counter */
-  register int k;		/* number of bits in current code */
-  int l;			/* bits per table (returned in m) */
-  register unsigned *p;		/* pointer into c[], b[], or v[] */
-  register struct huft *q;	/* points to current table */
-  struct huft r;		/* table entry for structure assignment */
-  struct huft *u[BMAX];		/* table stack */
-  unsigned v[N_MAX];		/* values in order of bit length */
-  register int w;		/* bits before this table == (l * h) */
-  unsigned x[BMAX + 1];		/* bit offsets, then code stack */
-  unsigned *xp;			/* pointer into x */
-  int y;			/* number of dummy codes added */
-  unsigned z;			/* number of entries in current table */
-
-  /* Generate counts for each bit length */
-  grub_memset ((char *) c, 0, sizeof (c));
-  p = b;
-  i = n;
-  do
-    {
-      c[*p]++;			/* assume all entries <= BMAX */
-      p++;			/* Can't combine with above line (Solaris bug) */
-    }
-  while (--i);
-  if (c[0] == n)		/* null input--all zero length codes */
+  grub_uint8_t lens[286 + 30];
+  grub_uint8_t codelens[19];
+  unsigned nl, nd, nb, i, n, val;
+
+  if (get_bits (gzio, 5, &nl) || get_bits (gzio, 5, &nd)
+      || get_bits (gzio, 4, &nb))
+    return grub_errno;
+  nl += 257;
+  nd += 1;
+  nb += 4;
+  if (nl > 286 || nd > 30)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too much data");
+
+  grub_memset (codelens, 0, sizeof (codelens));
+  for (i = 0; i < nb; i++)
+    if (get_bits (gzio, 3, &val))
+      return grub_errno;
+    else
+      codelens[bitorder[i]] = val;
+
+  if (build_table (codelens, 19, TABLE_CODELEN, CODELEN_BITS,
+		   gzio->codelen_table, ARRAY_SIZE (gzio->codelen_table)))
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "failed in building a Huffman code table");
+
+  /* Read in the literal/length and distance code lengths.  */
+  for (i = 0; i < nl + nd; )
     {
-      *t = (struct huft *) NULL;
-      *m = 0;
-      return 0;
-    }
+      struct inflate_entry e;
+      grub_uint8_t fill = 0;
+
+      if (gzio->bitcnt < CODELEN_BITS + 7 && refill (gzio))
+	return grub_errno;
+      e = gzio->codelen_table[gzio->bitbuf & ((1 << CODELEN_BITS) - 1)];
+      if (e.op == OP_INVALID)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   "failed in building a Huffman code table");
+      gzio->bitbuf >>= e.bits;
+      gzio->bitcnt -= e.bits;
+
+      if (e.val < 16)
+	{
+	  lens[i++] = e.val;
+	  continue;
+	}
 
-  /* Find minimum and maximum length, bound *m by those */
-  l = *m;
-  for (j = 1; j <= BMAX; j++)
-    if (c[j])
-      break;
-  k = j;			/* minimum code length */
-  if ((unsigned) l < j)
-    l = j;
-  for (i = BMAX; i; i--)
-    if (c[i])
-      break;
-  g = i;			/* maximum code length */
-  if ((unsigned) l > i)
-    l = i;
-  *m = l;
-
-  /* Adjust last length count to fill out codes, if needed */
-  for (y = 1 << j; j < i; j++, y <<= 1)
-    if ((y -= c[j]) < 0)
-      return 2;			/* bad input: more codes than bits */
-  if ((y -= c[i]) < 0)
-    return 2;
-  c[i] += y;
-
-  /* Generate starting offsets into the value table for each length */
-  x[1] = j = 0;
-  p = c + 1;
-  xp = x + 2;
-  while (--i)
-    {				/* note that i == g from above */
-      *xp++ = (j += *p++);
+      if (e.val == 16)
+	{
+	  if (i == 0)
+	    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			       "too many codes found");
+	  fill = lens[i - 1];
+	  if (get_bits (gzio, 2, &n))
+	    return grub_errno;
+	  n += 3;
+	}
+      else if (e.val == 17)
+	{
+	  if (get_bits (gzio, 3, &n))
+	    return grub_errno;
+	  n += 3;
+	}
+      else
+	{
+	  if (get_bits (gzio, 7, &n))
+	    return grub_errno;
+	  n += 11;
+	}
+      if (i + n > nl + nd)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   "too many codes found");
+      grub_memset (lens + i, fill, n);
+      i += n;
     }
 
-  /* Make a table of values in order of bit lengths */
-  p = b;
-  i = 0;
-  do
+  if (! lens[256]
+      || build_table (lens, nl, TABLE_LIT, LIT_BITS,
+		      gzio->lit_table, ARRAY_SIZE (gzio->lit_table))
+      || build_table (lens + nl, nd, TABLE_DIST, DIST_BITS,
+		      gzio->dist_table, ARRAY_SIZE (gzio->dist_table)))
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "failed in building a Huffman code table");
+
+  gzio->lit = gzio->lit_table;
+  gzio->dist = gzio->dist_table;
+  gzio->state = STATE_CODES;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+get_new_block (grub_gzio_t gzio)
+{
+  unsigned last, type;
+
+  if (get_bits (gzio, 1, &last) || get_bits (gzio, 2, &type))
+    return grub_errno;
+  gzio->last_block = last;
+
+  switch (type)
     {
-      if ((j = *p++) != 0)
-	v[x[j]++] = i;
+    case INFLATE_STORED:
+      return init_stored_block (gzio);
+    case INFLATE_FIXED:
+      if (! fixed_built)
+	build_fixed_tables ();
+      gzio->lit = fixed_lit;
+      gzio->dist = fixed_dist;
+      gzio->state = STATE_CODES;
+      return GRUB_ERR_NONE;
+    case INFLATE_DYNAMIC:
+      return init_dynamic_block (gzio);
+    default:
+      return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			 "unknown block type %d", type);
     }
-  while (++i < n);
-
-  /* Generate the Huffman codes and for each, make the table entries */
-  x[0] = i = 0;			/* first Huffman code is zero */
-  p = v;			/* grab values in bit order */
-  h = -1;			/* no tables yet--level -1 */
-  w = -l;			/* bits decoded == (l * h) */
-  u[0] = (struct huft *) NULL;	/* just to keep compilers happy */
-  q = (struct huft *) NULL;	/* ditto */
-  z = 0;			/* ditto */
-
-  /* go through the bit lengths (k already is bits in shortest code) */
-  for (; k <= g; k++)
-    {
-      a = c[k];
-      while (a--)
-	{
-	  /* here i is the Huffman code of length k bits for value *p */
-	  /* make tables up to required level */
-	  while (k > w + l)
-	    {
-	      h++;
-	      w += l;		/* previous table always l bits */
-
-	      /* compute minimum size table less than or equal to l bits */
-	      z = (z = (unsigned) (g - w)) > (unsigned) l ? (unsigned) l : z;	/* upper limit on table size */
-	      if ((f = 1 << (j = k - w)) > a + 1)	/* try a k-w bit table */
-		{		/* too few codes for k-w bit table */
-		  f -= a + 1;	/* deduct codes from patterns left */
-		  xp = c + k;
-		  while (++j < z)	/* try smaller tables up to z bits */
-		    {
-		      if ((f <<= 1) <= *++xp)
-			break;	/* enough codes to use up j bits */
-		      f -= *xp;	/* else deduct codes from patterns */
-		    }
-		}
-	      z = 1 << j;	/* table entries for j-bit table */
-
-	      /* allocate and link in new table */
-	      q = (struct huft *) grub_malloc ((z + 1) * sizeof (struct huft));
-	      if (! q)
-		{
-		  if (h)
-		    huft_free (u[0]);
-		  return 3;
-		}
-
-	      *t = q + 1;	/* link to list for huft_free() */
-	      *(t = &(q->v.t)) = (struct huft *) NULL;
-	      u[h] = ++q;	/* table starts after link */
-
-	      /* connect to last table, if there is one */
-	      if (h)
-		{
-		  x[h] = i;	/* save pattern for backing up */
-		  r.b = (uch) l;	/* bits to dump before this table */
-		  r.e = (uch) (16 + j);		/* bits in this table */
-		  r.v.t = q;	/* pointer to this table */
-		  j = i >> (w - l);	/* (get around Turbo C bug) */
-		  u[h - 1][j] = r;	/* connect to last table */
-		}
-	    }
+}
 
-	  /* set up table entry in r */
-	  r.b = (uch) (k - w);
-	  if (p >= v + n)
-	    r.e = 99;		/* out of values--invalid code */
-	  else if (*p < s)
-	    {
-	      r.e = (uch) (*p < 256 ? 16 : 15);		/* 256 is end-of-block code */
-	      r.v.n = (ush) (*p);	/* simple code is just the value */
-	      p++;		/* one compiler does not like *p++ */
-	    }
-	  else
-	    {
-	      r.e = (uch) e[*p - s];	/* non-simple--look up in lists */
-	      r.v.n = d[*p++ - s];
-	    }
+/* Copy what fits in OUT of the pending match, which may start in the
+   window.  Return the new output position.  */
+static grub_size_t
+copy_match (grub_gzio_t gzio, grub_uint8_t *out, grub_size_t done,
+	    grub_size_t len)
+{
+  unsigned n = gzio->match_len;
+  unsigned dist = gzio->match_dist;
 
-	  /* fill code-like entries with r */
-	  f = 1 << (k - w);
-	  for (j = i >> w; j < z; j += f)
-	    q[j] = r;
+  if (n > len - done)
+    n = len - done;
+  gzio->match_len -= n;
 
-	  /* backwards increment the k-bit code i */
-	  for (j = 1 << (k - 1); i & j; j >>= 1)
-	    i ^= j;
-	  i ^= j;
+  if (dist > done)
+    {
+      unsigned back = dist - done;
+      unsigned from = (gzio->wnext - back) & (WSIZE - 1);
 
-	  /* backup over finished tables */
-	  while ((i & ((1 << w) - 1)) != x[h])
-	    {
-	      h--;		/* don't need to update q */
-	      w -= l;
-	    }
+      for (; n && back; n--, back--)
+	{
+	  out[done++] = gzio->window[from];
+	  from = (from + 1) & (WSIZE - 1);
 	}
     }
 
-  /* Return true (1) if we were given an incomplete table */
-  return y != 0 && g != 1;
-}
+  for (; n; n--, done++)
+    out[done] = out[done - dist];
 
+  return done;
+}
 
-/* Free the malloc'ed tables built by huft_build(), which makes a linked
-   list of the tables it made, with the links in a dummy first entry of
-   each table.  */
-static int
-huft_free (struct huft *t)
+static grub_size_t
+inflate_stored (grub_gzio_t gzio, grub_uint8_t *out, grub_size_t done,
+		grub_size_t len)
 {
-  register struct huft *p, *q;
+  grub_size_t n = gzio->block_len;
 
+  if (n > len - done)
+    n = len - done;
+  gzio->block_len -= n;
 
-  /* Go through linked list, freeing from the malloced (t[-1]) address. */
-  p = t;
-  while (p != (struct huft *) NULL)
+  /* The bytes already in the bit buffer come first.  */
+  for (; n && gzio->bitcnt; n--)
     {
-      q = (--p)->v.t;
-      grub_free ((char *) p);
-      p = q;
+      out[done++] = gzio->bitbuf;
+      gzio->bitbuf >>= 8;
+      gzio->bitcnt -= 8;
     }
-  return 0;
-}
-
-
-/*
- *  inflate (decompress) the codes in a deflated (compressed) block.
- *  Return an error code or zero if it all goes ok.
- */
 
-static int
-inflate_codes_in_window (grub_gzio_t gzio)
-{
-  register unsigned e;		/* table entry flag/number of extra bits */
-  unsigned n, d;		/* length and index for copy */
-  unsigned w;			/* current window position */
-  struct huft *t;		/* pointer to table entry */
-  unsigned ml, md;		/* masks for bl and bd bits */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
-
-  /* make local copies of globals */
-  d = gzio->inflate_d;
-  n = gzio->inflate_n;
-  b = gzio->bb;			/* initialize bit buffer */
-  k = gzio->bk;
-  w = gzio->wp;			/* initialize window position */
-
-  /* inflate the coded data */
-  ml = mask_bits[gzio->bl];		/* precompute masks for speed */
-  md = mask_bits[gzio->bd];
-  for (;;)			/* do until end of block */
+  while (n)
     {
-      if (! gzio->code_state)
-	{
-	  NEEDBITS ((unsigned) gzio->bl);
-	  if ((e = (t = gzio->tl + ((unsigned) b & ml))->e) > 16)
-	    do
-	      {
-		if (e == 99)
-		  {
-		    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				"an unused code found");
-		    return 1;
-		  }
-		DUMPBITS (t->b);
-		e -= 16;
-		NEEDBITS (e);
-	      }
-	    while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e) > 16);
-	  DUMPBITS (t->b);
+      grub_size_t size = gzio->in_end - gzio->in_next;
 
-	  if (e == 16)		/* then it's a literal */
-	    {
-	      gzio->slide[w++] = (uch) t->v.n;
-	      if (w == WSIZE)
-		break;
-	    }
-	  else
-	    /* it's an EOB or a length */
+      if (! size)
+	{
+	  if (! fill_input (gzio))
 	    {
-	      /* exit if end of block */
-	      if (e == 15)
-		{
-		  gzio->block_len = 0;
-		  break;
-		}
-
-	      /* get length of block to copy */
-	      NEEDBITS (e);
-	      n = t->v.n + ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
-
-	      /* decode distance of block to copy */
-	      NEEDBITS ((unsigned) gzio->bd);
-	      if ((e = (t = gzio->td + ((unsigned) b & md))->e) > 16)
-		do
-		  {
-		    if (e == 99)
-		      {
-			grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				    "an unused code found");
-			return 1;
-		      }
-		    DUMPBITS (t->b);
-		    e -= 16;
-		    NEEDBITS (e);
-		  }
-		while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e)
-		       > 16);
-	      DUMPBITS (t->b);
-	      NEEDBITS (e);
-	      d = w - t->v.n - ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
-	      gzio->code_state++;
+	      if (! grub_errno)
+		grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			    N_("premature end of compressed data"));
+	      return done;
 	    }
+	  continue;
 	}
+      if (size > n)
+	size = n;
+      grub_memcpy (out + done, gzio->in_next, size);
+      gzio->in_next += size;
+      done += size;
+      n -= size;
+    }
 
-      if (gzio->code_state)
-	{
-	  /* do the copy */
-	  do
-	    {
-	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
-		    : e);
-
-	      if (w - d >= e)
-		{
-		  grub_memmove (gzio->slide + w, gzio->slide + d, e);
-		  w += e;
-		  d += e;
-		}
-	      else
-		/* purposefully use the overlap for extra copies here!! */
-		{
-		  while (e--)
-		    gzio->slide[w++] = gzio->slide[d++];
-		}
-
-	      if (w == WSIZE)
-		break;
-	    }
-	  while (n);
+  if (! gzio->block_len)
+    end_block (gzio);
+  return done;
+}
 
-	  if (! n)
-	    gzio->code_state--;
+/* Decode the codes of the current block into OUT until the block ends or
+   LEN bytes are there.  This is the hot loop: the bit buffer is kept in
+   locals, which the stores to OUT would otherwise force back to memory,
+   and refilled once per code.  56 bits cover the longest literal/length
+   with its extra bits plus the longest distance with its.  */
+static grub_size_t
+inflate_codes (grub_gzio_t gzio, grub_uint8_t *out, grub_size_t done,
+	       grub_size_t len)
+{
+  const struct inflate_entry *lit = gzio->lit;
+  const struct inflate_entry *dist = gzio->dist;
+  const grub_uint8_t *in = gzio->in_next;
+  const grub_uint8_t *in_end = gzio->in_end;
+  grub_uint64_t bitbuf = gzio->bitbuf;
+  unsigned bitcnt = gzio->bitcnt;
+  unsigned whave = gzio->whave;
+
+  while (done < len)
+    {
+      struct inflate_entry e;
+      unsigned length, d;
 
-	  /* did we break from the loop too soon? */
-	  if (w == WSIZE)
+      if (in_end - in >= 8)
+	{
+	  bitbuf |= grub_le_to_cpu64 (grub_get_unaligned64 (in)) << bitcnt;
+	  in += (63 - bitcnt) >> 3;
+	  bitcnt |= 56;
+	}
+      else
+	{
+	  grub_err_t err;
+
+	  gzio->in_next = in;
+	  gzio->bitbuf = bitbuf;
+	  gzio->bitcnt = bitcnt;
+	  err = refill (gzio);
+	  in = gzio->in_next;
+	  in_end = gzio->in_end;
+	  bitbuf = gzio->bitbuf;
+	  bitcnt = gzio->bitcnt;
+	  if (err)
 	    break;
 	}
-    }
 
-  /* restore the globals from the locals */
-  gzio->inflate_d = d;
-  gzio->inflate_n = n;
-  gzio->wp = w;			/* restore global window pointer */
-  gzio->bb = b;			/* restore global bit buffer */
-  gzio->bk = k;
+      e = lit[bitbuf & ((1 << LIT_BITS) - 1)];
+      if (e.op >= OP_SUBTABLE)
+	{
+	  bitbuf >>= LIT_BITS;
+	  bitcnt -= LIT_BITS;
+	  e = lit[e.val + (bitbuf & ((1 << (e.op - OP_SUBTABLE)) - 1))];
+	}
+      bitbuf >>= e.bits;
+      bitcnt -= e.bits;
 
-  return ! gzio->block_len;
-}
+      if (e.op == OP_LITERAL)
+	{
+	  out[done++] = e.val;
+	  continue;
+	}
+      if (e.op == OP_END)
+	{
+	  end_block (gzio);
+	  break;
+	}
+      if (e.op == OP_INVALID)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid literal code");
+	  break;
+	}
+
+      length = e.val + (bitbuf & ((1 << e.op) - 1));
+      bitbuf >>= e.op;
+      bitcnt -= e.op;
 
+      e = dist[bitbuf & ((1 << DIST_BITS) - 1)];
+      if (e.op >= OP_SUBTABLE)
+	{
+	  bitbuf >>= DIST_BITS;
+	  bitcnt -= DIST_BITS;
+	  e = dist[e.val + (bitbuf & ((1 << (e.op - OP_SUBTABLE)) - 1))];
+	}
+      bitbuf >>= e.bits;
+      bitcnt -= e.bits;
+      if (e.op == OP_INVALID)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid distance code");
+	  break;
+	}
+      d = e.val + (bitbuf & ((1 << e.op) - 1));
+      bitbuf >>= e.op;
+      bitcnt -= e.op;
 
-/* get header for an inflated type 0 (stored) block. */
+      if (d > done + whave)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		      "invalid distance too far back");
+	  break;
+	}
 
-static void
-init_stored_block (grub_gzio_t gzio)
-{
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
-
-  /* make local copies of globals */
-  b = gzio->bb;			/* initialize bit buffer */
-  k = gzio->bk;
-
-  /* go to byte boundary */
-  DUMPBITS (k & 7);
-
-  /* get the length and its complement */
-  NEEDBITS (16);
-  gzio->block_len = ((unsigned) b & 0xffff);
-  DUMPBITS (16);
-  NEEDBITS (16);
-  if (gzio->block_len != (int) ((~b) & 0xffff))
-    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		"the length of a stored block does not match");
-  DUMPBITS (16);
-
-  /* restore global variables */
-  gzio->bb = b;
-  gzio->bk = k;
-}
+      if (d <= done && len - done >= length + 8)
+	{
+	  /* The whole copy is in OUT, with room to spare to copy 8 bytes
+	     at a time.  */
+	  grub_uint8_t *dst = out + done;
+	  const grub_uint8_t *src = dst - d;
+	  grub_uint8_t *end = dst + length;
 
+	  if (d == 1)
+	    {
+	      grub_memset (dst, *src, length);
+	      dst = end;
+	    }
+	  else if (d < 8)
+	    {
+	      /* The copy repeats every D bytes, so after a few bytes it can
+		 go 8 at a time from a multiple of D of at least 8 back.  */
+	      unsigned period = d, n;
+
+	      while (period < 8)
+		period += d;
+	      for (n = period - d; n; n--)
+		*dst++ = *src++;
+	      src = dst - period;
+	    }
+	  while (dst < end)
+	    {
+	      grub_set_unaligned64 (dst, grub_get_unaligned64 (src));
+	      dst += 8;
+	      src += 8;
+	    }
+	  done += length;
+	}
+      else
+	{
+	  gzio->match_len = length;
+	  gzio->match_dist = d;
+	  done = copy_match (gzio, out, done, len);
+	}
+    }
 
-/* get header for an inflated type 1 (fixed Huffman codes) block.  We should
-   either replace this with a custom decoder, or at least precompute the
-   Huffman tables. */
+  gzio->in_next = in;
+  gzio->bitbuf = bitbuf;
+  gzio->bitcnt = bitcnt;
+  return done;
+}
 
+/* Remember the last WSIZE bytes of the LEN bytes just decompressed into
+   OUT.  */
 static void
-init_fixed_block (grub_gzio_t gzio)
+update_window (grub_gzio_t gzio, grub_uint8_t *out, grub_size_t len)
 {
-  int i;			/* temporary variable */
-  unsigned l[288];		/* length list for huft_build */
+  unsigned n;
 
-  /* set up literal table */
-  for (i = 0; i < 144; i++)
-    l[i] = 8;
-  for (; i < 256; i++)
-    l[i] = 9;
-  for (; i < 280; i++)
-    l[i] = 7;
-  for (; i < 288; i++)		/* make a complete, but wrong code set */
-    l[i] = 8;
-  gzio->bl = 7;
-  if (huft_build (l, 288, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
-    {
-      if (grub_errno == GRUB_ERR_NONE)
-	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		    "failed in building a Huffman code table");
-      return;
-    }
+  if (! gzio->window || ! len)
+    return;
 
-  /* set up distance table */
-  for (i = 0; i < 30; i++)	/* make an incomplete code set */
-    l[i] = 5;
-  gzio->bd = 5;
-  if (huft_build (l, 30, 0, cpdist, cpdext, &gzio->td, &gzio->bd) > 1)
+  if (len >= WSIZE)
     {
-      if (grub_errno == GRUB_ERR_NONE)
-	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		    "failed in building a Huffman code table");
-      huft_free (gzio->tl);
-      gzio->tl = 0;
+      if (out == gzio->scratch)
+	{
+	  /* Nothing to copy, the scratch buffer becomes the window.  */
+	  gzio->scratch = gzio->window;
+	  gzio->window = out;
+	}
+      else
+	grub_memcpy (gzio->window, out + len - WSIZE, WSIZE);
+      gzio->wnext = 0;
+      gzio->whave = WSIZE;
       return;
     }
 
-  /* indicate we're now working on a block */
-  gzio->code_state = 0;
-  gzio->block_len++;
+  n = WSIZE - gzio->wnext;
+  if (n > len)
+    n = len;
+  grub_memcpy (gzio->window + gzio->wnext, out, n);
+  grub_memcpy (gzio->window, out + n, len - n);
+  gzio->wnext = (gzio->wnext + len) & (WSIZE - 1);
+  gzio->whave += len;
+  if (gzio->whave > WSIZE)
+    gzio->whave = WSIZE;
 }
 
-
-/* get header for an inflated type 2 (dynamic Huffman codes) block. */
-
+/* Take a checkpoint at the current block boundary if one is due, the LEN
+   bytes of output in OUT not being in the window yet.  Checkpoints only
+   make things faster, so failing to allocate one isn't an error.  */
 static void
-init_dynamic_block (grub_gzio_t gzio)
+add_checkpoint (grub_gzio_t gzio, const grub_uint8_t *out, grub_size_t len)
 {
-  int i;			/* temporary variables */
-  unsigned j;
-  unsigned l;			/* last length */
-  unsigned m;			/* mask for bit lengths table */
-  unsigned n;			/* number of lengths to get */
-  unsigned nb;			/* number of bit length codes */
-  unsigned nl;			/* number of literal/length codes */
-  unsigned nd;			/* number of distance codes */
-  unsigned ll[286 + 30];	/* literal/length and distance code lengths */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
-
-  /* make local bit buffer */
-  b = gzio->bb;
-  k = gzio->bk;
-
-  /* read in table lengths */
-  NEEDBITS (5);
-  nl = 257 + ((unsigned) b & 0x1f);	/* number of literal/length codes */
-  DUMPBITS (5);
-  NEEDBITS (5);
-  nd = 1 + ((unsigned) b & 0x1f);	/* number of distance codes */
-  DUMPBITS (5);
-  NEEDBITS (4);
-  nb = 4 + ((unsigned) b & 0xf);	/* number of bit length codes */
-  DUMPBITS (4);
-  if (nl > 286 || nd > 30)
-    {
-      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too much data");
-      return;
-    }
+  struct gzio_checkpoint *cp;
+  grub_off_t pos = gzio->pos + len;
+  unsigned keep, n, i;
 
-  /* read in bit-length-code lengths */
-  for (j = 0; j < nb; j++)
-    {
-      NEEDBITS (3);
-      ll[bitorder[j]] = (unsigned) b & 7;
-      DUMPBITS (3);
-    }
-  for (; j < 19; j++)
-    ll[bitorder[j]] = 0;
+  if (! gzio->file
+      || pos < (gzio->ncheckpoints
+		? gzio->checkpoints[gzio->ncheckpoints - 1].pos : 0)
+	       + gzio->checkpoint_span)
+    return;
 
-  /* build decoding table for trees--single level, 7 bit lookup */
-  gzio->bl = 7;
-  if (huft_build (ll, 19, 19, NULL, NULL, &gzio->tl, &gzio->bl) != 0)
+  if (! gzio->checkpoints)
     {
-      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		  "failed in building a Huffman code table");
-      return;
+      gzio->checkpoints = grub_malloc (MAX_CHECKPOINTS
+				       * sizeof (gzio->checkpoints[0]));
+      if (! gzio->checkpoints)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
     }
 
-  /* read in literal and distance code lengths */
-  n = nl + nd;
-  m = mask_bits[gzio->bl];
-  i = l = 0;
-  while ((unsigned) i < n)
+  if (gzio->ncheckpoints == MAX_CHECKPOINTS)
     {
-      NEEDBITS ((unsigned) gzio->bl);
-      j = (gzio->td = gzio->tl + ((unsigned) b & m))->b;
-      DUMPBITS (j);
-      j = gzio->td->v.n;
-      if (j < 16)		/* length of code in bits (0..15) */
-	ll[i++] = l = j;	/* save last length in l */
-      else if (j == 16)		/* repeat last length 3 to 6 times */
+      for (i = 0; i < MAX_CHECKPOINTS / 2; i++)
 	{
-	  NEEDBITS (2);
-	  j = 3 + ((unsigned) b & 3);
-	  DUMPBITS (2);
-	  if ((unsigned) i + j > n)
-	    {
-	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
-	      return;
-	    }
-	  while (j--)
-	    ll[i++] = l;
-	}
-      else if (j == 17)		/* 3 to 10 zero length codes */
-	{
-	  NEEDBITS (3);
-	  j = 3 + ((unsigned) b & 7);
-	  DUMPBITS (3);
-	  if ((unsigned) i + j > n)
-	    {
-	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
-	      return;
-	    }
-	  while (j--)
-	    ll[i++] = 0;
-	  l = 0;
-	}
-      else
-	/* j == 18: 11 to 138 zero length codes */
-	{
-	  NEEDBITS (7);
-	  j = 11 + ((unsigned) b & 0x7f);
-	  DUMPBITS (7);
-	  if ((unsigned) i + j > n)
-	    {
-	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
-	      return;
-	    }
-	  while (j--)
-	    ll[i++] = 0;
-	  l = 0;
+	  grub_free (gzio->checkpoints[2 * i].window);
+	  gzio->checkpoints[i] = gzio->checkpoints[2 * i + 1];
 	}
+      gzio->ncheckpoints = MAX_CHECKPOINTS / 2;
+      gzio->checkpoint_span *= 2;
+      if (pos < gzio->checkpoints[gzio->ncheckpoints - 1].pos
+	  + gzio->checkpoint_span)
+	return;
     }
 
-  /* free decoding table for trees */
-  huft_free (gzio->tl);
-  gzio->td = 0;
-  gzio->tl = 0;
-
-  /* restore the global bit buffer */
-  gzio->bb = b;
-  gzio->bk = k;
-
-  /* build the decoding tables for literal/length and distance codes */
-  gzio->bl = lbits;
-  if (huft_build (ll, nl, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
+  cp = &gzio->checkpoints[gzio->ncheckpoints];
+  cp->window = grub_malloc (WSIZE);
+  if (! cp->window)
     {
-      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		  "failed in building a Huffman code table");
+      grub_errno = GRUB_ERR_NONE;
       return;
     }
-  gzio->bd = dbits;
-  if (huft_build (ll + nl, nd, 0, cpdist, cpdext, &gzio->td, &gzio->bd) != 0)
+
+  /* The last WSIZE bytes of the window followed by OUT.  */
+  keep = gzio->whave + len < WSIZE ? gzio->whave + len : WSIZE;
+  if (len < keep)
     {
-      huft_free (gzio->tl);
-      gzio->tl = 0;
-      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		  "failed in building a Huffman code table");
-      return;
+      unsigned from = (gzio->wnext - (keep - len)) & (WSIZE - 1);
+
+      n = keep - len;
+      if (n > WSIZE - from)
+	n = WSIZE - from;
+      grub_memcpy (cp->window, gzio->window + from, n);
+      grub_memcpy (cp->window + n, gzio->window, keep - len - n);
+      grub_memcpy (cp->window + keep - len, out, len);
     }
+  else
+    grub_memcpy (cp->window, out + len - keep, keep);
 
-  /* indicate we're now working on a block */
-  gzio->code_state = 0;
-  gzio->block_len++;
+  cp->pos = pos;
+  cp->whave = keep;
+  cp->bitpos = (gzio->inbuf_offset + (gzio->in_next - gzio->inbuf)) * 8
+    - gzio->bitcnt;
+  gzio->ncheckpoints++;
 }
 
-
+/* Resume decompressing from CP.  */
 static void
-get_new_block (grub_gzio_t gzio)
+restore_checkpoint (grub_gzio_t gzio, struct gzio_checkpoint *cp)
 {
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
-
-  /* make local bit buffer */
-  b = gzio->bb;
-  k = gzio->bk;
-
-  /* read in last block bit */
-  NEEDBITS (1);
-  gzio->last_block = (int) b & 1;
-  DUMPBITS (1);
-
-  /* read in block type */
-  NEEDBITS (2);
-  gzio->block_type = (unsigned) b & 3;
-  DUMPBITS (2);
+  unsigned dummy;
 
-  /* restore the global bit buffer */
-  gzio->bb = b;
-  gzio->bk = k;
-
-  switch (gzio->block_type)
-    {
-    case INFLATE_STORED:
-      init_stored_block (gzio);
-      break;
-    case INFLATE_FIXED:
-      init_fixed_block (gzio);
-      break;
-    case INFLATE_DYNAMIC:
-      init_dynamic_block (gzio);
-      break;
-    default:
-      break;
-    }
+  initialize_tables (gzio);
+  grub_file_seek (gzio->file, cp->bitpos >> 3);
+  gzio->pos = cp->pos;
+  grub_memcpy (gzio->window, cp->window, cp->whave);
+  gzio->whave = cp->whave;
+  gzio->wnext = cp->whave & (WSIZE - 1);
+  get_bits (gzio, cp->bitpos & 7, &dummy);
 }
 
-
+/* Get to OFFSET, which is behind the window or far ahead of it, as fast as
+   possible: from the last checkpoint before it if there is one and it is
+   closer than the current position, or else from the start.  */
 static void
-inflate_window (grub_gzio_t gzio)
+seek_checkpoint (grub_gzio_t gzio, grub_off_t offset)
 {
-  /* initialize window */
-  gzio->wp = 0;
+  unsigned lo = 0, hi = gzio->ncheckpoints;
 
-  /*
-   *  Main decompression loop.
-   */
-
-  while (gzio->wp < WSIZE && grub_errno == GRUB_ERR_NONE)
+  while (lo < hi)
     {
-      if (! gzio->block_len)
-	{
-	  if (gzio->last_block)
-	    break;
+      unsigned mid = (lo + hi) / 2;
 
-	  get_new_block (gzio);
-	}
+      if (gzio->checkpoints[mid].pos <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
 
-      if (gzio->block_type > INFLATE_DYNAMIC)
-	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		    "unknown block type %d", gzio->block_type);
+  if (lo && (offset < gzio->pos || gzio->checkpoints[lo - 1].pos > gzio->pos))
+    restore_checkpoint (gzio, &gzio->checkpoints[lo - 1]);
+  else if (offset < gzio->pos)
+    initialize_tables (gzio);
+}
 
-      if (grub_errno != GRUB_ERR_NONE)
-	return;
+/* Decompress the next LEN bytes into OUT.  Return how many there are,
+   fewer at the end of the stream or on an error.  */
+static grub_size_t
+inflate (grub_gzio_t gzio, grub_uint8_t *out, grub_size_t len)
+{
+  grub_size_t done = 0;
 
-      /*
-       *  Expand stored block here.
-       */
-      if (gzio->block_type == INFLATE_STORED)
+  while (done < len && gzio->state != STATE_DONE
+	 && grub_errno == GRUB_ERR_NONE)
+    {
+      if (gzio->match_len)
 	{
-	  int w = gzio->wp;
-
-	  /*
-	   *  This is basically a glorified pass-through
-	   */
-
-	  while (gzio->block_len && w < WSIZE && grub_errno == GRUB_ERR_NONE)
-	    {
-	      gzio->slide[w++] = get_byte (gzio);
-	      gzio->block_len--;
-	    }
-
-	  gzio->wp = w;
-
+	  done = copy_match (gzio, out, done, len);
 	  continue;
 	}
 
-      /*
-       *  Expand other kind of block.
-       */
-
-      if (inflate_codes_in_window (gzio))
+      switch (gzio->state)
 	{
-	  huft_free (gzio->tl);
-	  huft_free (gzio->td);
-	  gzio->tl = 0;
-	  gzio->td = 0;
+	case STATE_HEADER:
+	  add_checkpoint (gzio, out, done);
+	  get_new_block (gzio);
+	  break;
+	case STATE_STORED:
+	  done = inflate_stored (gzio, out, done, len);
+	  break;
+	case STATE_CODES:
+	  done = inflate_codes (gzio, out, done, len);
+	  break;
 	}
     }
 
-  gzio->saved_offset += WSIZE;
+  update_window (gzio, out, done);
+  gzio->pos += done;
 
   /* XXX do CRC calculation here! */
+  return done;
 }
 
 
 static void
 initialize_tables (grub_gzio_t gzio)
 {
-  gzio->saved_offset = 0;
-  gzio_seek (gzio, gzio->data_offset);
+  if (gzio->file)
+    {
+      grub_file_seek (gzio->file, gzio->data_offset);
+      gzio->in_next = gzio->in_end = gzio->inbuf;
+    }
+  else
+    {
+      gzio->in_next = gzio->mem_input + gzio->data_offset;
+      gzio->in_end = gzio->mem_input + gzio->mem_input_size;
+    }
+  gzio->overrun = 0;
 
   /* Initialize the bit buffer.  */
-  gzio->bk = 0;
-  gzio->bb = 0;
+  gzio->bitbuf = 0;
+  gzio->bitcnt = 0;
 
   /* Reset partial decompression code.  */
+  gzio->state = STATE_HEADER;
   gzio->last_block = 0;
-  gzio->block_len = 0;
-
-  /* Reset memory allocation stuff.  */
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
+  gzio->match_len = 0;
+  gzio->pos = 0;
+  gzio->wnext = 0;
+  gzio->whave = 0;
 }
 
 
@@ -1130,11 +1167,11 @@ grub_gzio_open (grub_file_t io)
   grub_file_t file;
   grub_gzio_t gzio = 0;
 
-  file = (grub_file_t) grub_malloc (sizeof (*file));
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
   if (! file)
     return 0;
 
-  gzio = grub_zalloc (sizeof (*gzio));
+  gzio = grub_zalloc (sizeof (*gzio) + INBUFSIZ + 2 * WSIZE);
   if (! gzio)
     {
       grub_free (file);
@@ -1142,6 +1179,10 @@ grub_gzio_open (grub_file_t io)
     }
 
   gzio->file = io;
+  gzio->inbuf = (grub_uint8_t *) (gzio + 1);
+  gzio->window = gzio->inbuf + INBUFSIZ;
+  gzio->scratch = gzio->window + WSIZE;
+  gzio->checkpoint_span = CHECKPOINT_SPAN;
 
   file->device = io->device;
   file->offset = 0;
@@ -1167,9 +1208,14 @@ static int
 test_zlib_header (grub_gzio_t gzio)
 {
   grub_uint8_t cmf, flg;
-  
-  cmf = get_byte (gzio);
-  flg = get_byte (gzio);
+
+  if (gzio->mem_input_size < 2)
+    {
+      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, N_("unsupported gzip format"));
+      return 0;
+    }
+  cmf = gzio->mem_input[0];
+  flg = gzio->mem_input[1];
 
   /* Check that compression method is DEFLATE.  */
   if ((cmf & 0xf) != DEFLATED)
@@ -1205,30 +1251,51 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
 {
   grub_ssize_t ret = 0;
 
-  /* Do we reset decompression to the beginning of the file?  */
-  if (gzio->saved_offset > offset + WSIZE)
-    initialize_tables (gzio);
+  /* Do we restart decompression from a checkpoint or the beginning of
+     the file?  */
+  if (offset + gzio->whave < gzio->pos
+      || (gzio->ncheckpoints && offset > gzio->pos + gzio->checkpoint_span))
+    seek_checkpoint (gzio, offset);
 
   /*
-   *  This loop operates upon uncompressed data only.  The only
-   *  special thing it does is to make sure the decompression
-   *  window is within the range of data it needs.
+   *  This loop operates upon uncompressed data only.  Data behind the
+   *  current position is copied from the window, data ahead of it is
+   *  decompressed into the scratch buffer first unless the caller's buffer
+   *  can take it directly.
    */
 
   while (len > 0 && grub_errno == GRUB_ERR_NONE)
     {
-      register grub_size_t size;
-      register char *srcaddr;
-
-      while (offset >= gzio->saved_offset)
-	inflate_window (gzio);
-
-      srcaddr = (char *) ((offset & (WSIZE - 1)) + gzio->slide);
-      size = gzio->saved_offset - offset;
-      if (size > len)
-	size = len;
+      grub_size_t size;
 
-      grub_memmove (buf, srcaddr, size);
+      if (offset < gzio->pos)
+	{
+	  unsigned from;
+
+	  size = gzio->pos - offset;
+	  from = (gzio->wnext - size) & (WSIZE - 1);
+	  if (size > len)
+	    size = len;
+	  if (size > WSIZE - from)
+	    size = WSIZE - from;
+	  grub_memcpy (buf, gzio->window + from, size);
+	}
+      else if (gzio->state == STATE_DONE)
+	{
+	  /* Past the end of the stream.  */
+	  size = len;
+	  grub_memset (buf, 0, size);
+	}
+      else if (gzio->scratch && (offset > gzio->pos || len < DIRECT_MIN))
+	{
+	  size = WSIZE;
+	  if (offset > gzio->pos && offset - gzio->pos < size)
+	    size = offset - gzio->pos;
+	  inflate (gzio, gzio->scratch, size);
+	  continue;
+	}
+      else
+	size = inflate (gzio, (grub_uint8_t *) buf, len);
 
       buf += size;
       len -= size;
@@ -1255,8 +1322,9 @@ grub_gzio_close (grub_file_t file)
   grub_gzio_t gzio = file->data;
 
   grub_file_close (gzio->file);
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
+  while (gzio->ncheckpoints)
+    grub_free (gzio->checkpoints[--gzio->ncheckpoints].window);
+  grub_free (gzio->checkpoints);
   grub_free (gzio);
 
   /* No need to close the same device twice.  */
@@ -1272,12 +1340,18 @@ grub_zlib_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   grub_gzio_t gzio = 0;
   grub_ssize_t ret;
 
-  gzio = grub_zalloc (sizeof (*gzio));
+  /* Without an offset everything is decompressed straight into OUTBUF, and
+     neither the window nor the scratch buffer is needed.  */
+  gzio = grub_malloc (sizeof (*gzio) + (off ? 2 * WSIZE : 0));
   if (! gzio)
     return -1;
+  gzio->file = 0;
   gzio->mem_input = (grub_uint8_t *) inbuf;
   gzio->mem_input_size = insize;
-  gzio->mem_input_off = 0;
+  gzio->window = off ? (grub_uint8_t *) (gzio + 1) : 0;
+  gzio->scratch = off ? gzio->window + WSIZE : 0;
+  gzio->checkpoints = 0;
+  gzio->ncheckpoints = 0;
 
   if (!test_zlib_header (gzio))
     {
@@ -1292,7 +1366,7 @@ grub_zlib_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   return ret;
 }
 
-
+
 
 static struct grub_fs grub_gzio_fs =
   {
@@ -0,0 +1,589 @@
+/* lz4io.c - decompression support for lz4 */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+#include <grub/lib/lz4.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define LZ4_MAGIC 0x184d2204
+#define LZ4_SKIPPABLE_MAGIC 0x184d2a50
+#define LZ4_SKIPPABLE_MASK 0xfffffff0
+
+/* Frame descriptor flags.  */
+#define LZ4_FLG_VERSION_MASK	0xc0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_INDEP	0x20
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_RESERVED	0x02
+#define LZ4_FLG_DICT_ID		0x01
+
+#define LZ4_BD_MAX_SIZE_SHIFT	4
+#define LZ4_BD_MAX_SIZE_MASK	0x70
+
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+#define LZ4_CHECKSUM_SIZE 4
+/* FLG, BD, content size and header checksum.  */
+#define LZ4_DESCRIPTOR_MAX_SIZE 11
+
+enum
+  {
+    /* The block depends on the previous one.  */
+    LZ4IO_LINKED = 1,
+    /* The block is followed by the checksum of its data.  */
+    LZ4IO_CHECKSUM = 2
+  };
+
+struct grub_lz4io_block
+{
+  /* The offset of the block's data in the file.  */
+  grub_off_t offset;
+  /* The offset of the block's data in the uncompressed data.  */
+  grub_off_t uncompressed_offset;
+  /* The size of the stored data, and whether it is compressed.  */
+  grub_uint32_t size;
+  /* The size of the uncompressed data.  */
+  grub_uint32_t usize;
+  int flags;
+};
+
+struct grub_lz4io
+{
+  grub_file_t file;
+  struct grub_lz4io_block *blocks;
+  grub_size_t nblocks;
+  grub_size_t max_block_size;
+  /* The stored data of a block, and its checksum.  */
+  grub_uint8_t *cbuf;
+  /* The last decompressed block, at GRUB_LZ4_WINDOW_SIZE, preceded by
+     the data before it if the block is linked to the previous one.  */
+  grub_uint8_t *ubuf;
+  int has_block;
+  grub_size_t cur_block;
+  grub_size_t history;
+};
+
+typedef struct grub_lz4io *grub_lz4io_t;
+static struct grub_fs grub_lz4io_fs;
+
+#define PRIME32_1 0x9e3779b1U
+#define PRIME32_2 0x85ebca77U
+#define PRIME32_3 0xc2b2ae3dU
+#define PRIME32_4 0x27d4eb2fU
+#define PRIME32_5 0x165667b1U
+
+static inline grub_uint32_t
+rotl32 (grub_uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+static inline grub_uint32_t
+xxh32_round (grub_uint32_t acc, const grub_uint8_t *p)
+{
+  acc += grub_le_to_cpu32 (grub_get_unaligned32 (p)) * PRIME32_2;
+  return rotl32 (acc, 13) * PRIME32_1;
+}
+
+/* The xxHash32 checksum of LEN bytes at BUF, with seed 0, as used by the
+   LZ4 frame format.  */
+static grub_uint32_t
+xxh32 (const grub_uint8_t *buf, grub_size_t len)
+{
+  const grub_uint8_t *end = buf + len;
+  grub_uint32_t h;
+
+  if (len >= 16)
+    {
+      grub_uint32_t v1 = PRIME32_1 + PRIME32_2;
+      grub_uint32_t v2 = PRIME32_2;
+      grub_uint32_t v3 = 0;
+      grub_uint32_t v4 = -PRIME32_1;
+
+      do
+	{
+	  v1 = xxh32_round (v1, buf);
+	  v2 = xxh32_round (v2, buf + 4);
+	  v3 = xxh32_round (v3, buf + 8);
+	  v4 = xxh32_round (v4, buf + 12);
+	  buf += 16;
+	}
+      while (end - buf >= 16);
+
+      h = rotl32 (v1, 1) + rotl32 (v2, 7) + rotl32 (v3, 12) + rotl32 (v4, 18);
+    }
+  else
+    h = PRIME32_5;
+
+  h += len;
+
+  for (; end - buf >= 4; buf += 4)
+    {
+      h += grub_le_to_cpu32 (grub_get_unaligned32 (buf)) * PRIME32_3;
+      h = rotl32 (h, 17) * PRIME32_4;
+    }
+  for (; buf < end; buf++)
+    {
+      h += *buf * PRIME32_5;
+      h = rotl32 (h, 11) * PRIME32_1;
+    }
+
+  h ^= h >> 15;
+  h *= PRIME32_2;
+  h ^= h >> 13;
+  h *= PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Decompress block I into DST, which has room for CAPACITY bytes and is
+   preceded by HISTORY bytes of data.  Return the size of the data.  */
+static grub_ssize_t
+decode_block (grub_lz4io_t lz4io, grub_size_t i, grub_uint8_t *dst,
+	      grub_size_t capacity, grub_size_t history)
+{
+  struct grub_lz4io_block *block = &lz4io->blocks[i];
+  grub_size_t csize = block->size & ~LZ4_BLOCK_UNCOMPRESSED;
+  grub_size_t rsize = csize;
+  grub_ssize_t ret;
+
+  if (block->flags & LZ4IO_CHECKSUM)
+    rsize += LZ4_CHECKSUM_SIZE;
+
+  grub_file_seek (lz4io->file, block->offset);
+  if (grub_file_read (lz4io->file, lz4io->cbuf, rsize) != (grub_ssize_t) rsize)
+    goto corrupted;
+
+  if ((block->flags & LZ4IO_CHECKSUM)
+      && xxh32 (lz4io->cbuf, csize)
+      != grub_le_to_cpu32 (grub_get_unaligned32 (lz4io->cbuf + csize)))
+    goto corrupted;
+
+  if (block->size & LZ4_BLOCK_UNCOMPRESSED)
+    {
+      if (csize > capacity)
+	goto corrupted;
+      grub_memcpy (dst, lz4io->cbuf, csize);
+      return csize;
+    }
+
+  ret = grub_lz4_decompress (lz4io->cbuf, csize, dst, capacity, history);
+  if (ret < 0)
+    goto corrupted;
+  return ret;
+
+ corrupted:
+  if (!grub_errno)
+    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, N_("lz4 file corrupted"));
+  return -1;
+}
+
+static int
+check_block_size (grub_lz4io_t lz4io, grub_size_t i, grub_size_t size)
+{
+  if (size == lz4io->blocks[i].usize)
+    return 1;
+
+  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, N_("lz4 file corrupted"));
+  return 0;
+}
+
+/* Decompress block I into ubuf, along with the blocks it depends on.  */
+static int
+load_block (grub_lz4io_t lz4io, grub_size_t i)
+{
+  struct grub_lz4io_block *blocks = lz4io->blocks;
+  grub_uint8_t *dst = lz4io->ubuf + GRUB_LZ4_WINDOW_SIZE;
+  grub_size_t start = i;
+
+  if (lz4io->has_block && lz4io->cur_block == i)
+    return 0;
+
+  /* The first block of a frame is never linked.  */
+  while ((blocks[start].flags & LZ4IO_LINKED)
+	 && !(lz4io->has_block && lz4io->cur_block == start - 1))
+    start--;
+
+  for (; start <= i; start++)
+    {
+      grub_size_t history = 0;
+      grub_ssize_t size;
+
+      /* Keep the end of the previous data as the window.  */
+      if (blocks[start].flags & LZ4IO_LINKED)
+	{
+	  grub_size_t prev = blocks[start - 1].usize;
+
+	  history = lz4io->history + prev;
+	  if (history > GRUB_LZ4_WINDOW_SIZE)
+	    history = GRUB_LZ4_WINDOW_SIZE;
+	  grub_memmove (dst - history, dst + prev - history, history);
+	}
+
+      lz4io->has_block = 0;
+      size = decode_block (lz4io, start, dst, blocks[start].usize, history);
+      if (size < 0 || !check_block_size (lz4io, start, size))
+	return -1;
+      lz4io->has_block = 1;
+      lz4io->cur_block = start;
+      lz4io->history = history;
+    }
+
+  return 0;
+}
+
+/* Return the block containing OFFSET.  */
+static grub_size_t
+find_block (grub_lz4io_t lz4io, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = lz4io->nblocks;
+
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+
+      if (lz4io->blocks[mid].uncompressed_offset <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+static int
+add_block (grub_lz4io_t lz4io, grub_size_t *alloc, grub_off_t offset,
+	   grub_uint32_t size, int flags)
+{
+  struct grub_lz4io_block *block;
+
+  if (lz4io->nblocks == *alloc)
+    {
+      struct grub_lz4io_block *blocks;
+
+      *alloc = *alloc ? 2 * *alloc : 16;
+      blocks = grub_realloc (lz4io->blocks, *alloc * sizeof (blocks[0]));
+      if (!blocks)
+	return 0;
+      lz4io->blocks = blocks;
+    }
+
+  block = &lz4io->blocks[lz4io->nblocks++];
+  block->offset = offset;
+  block->size = size;
+  block->usize = 0;
+  block->flags = flags;
+  return 1;
+}
+
+/* Find the size of the data of BLOCK, which is at most MAX_SIZE bytes,
+   from its sequences.  It's read into cbuf.  */
+static int
+read_block_size (grub_lz4io_t lz4io, struct grub_lz4io_block *block,
+		 grub_uint32_t max_size)
+{
+  grub_uint32_t csize = block->size & ~LZ4_BLOCK_UNCOMPRESSED;
+  grub_ssize_t size;
+
+  if (block->size & LZ4_BLOCK_UNCOMPRESSED)
+    {
+      block->usize = csize;
+      return 1;
+    }
+
+  grub_file_seek (lz4io->file, block->offset);
+  if (grub_file_read (lz4io->file, lz4io->cbuf, csize) != (grub_ssize_t) csize)
+    return 0;
+
+  size = grub_lz4_uncompressed_size (lz4io->cbuf, csize);
+  if (size < 0 || size > max_size)
+    return 0;
+
+  block->usize = size;
+  return 1;
+}
+
+/* Walk the frame headers and the block headers to find the blocks.  Any
+   block may be shorter than the maximum size of its frame, so the size of
+   each one is found from its sequences, and checked against the size of
+   the frame if it is recorded.  */
+static int
+scan_frames (grub_file_t file)
+{
+  grub_lz4io_t lz4io = file->data;
+  grub_file_t io = lz4io->file;
+  grub_off_t pos = 0;
+  grub_uint64_t total = 0;
+  grub_size_t alloc = 0;
+  grub_size_t i;
+
+  while (pos < io->size)
+    {
+      grub_uint8_t desc[LZ4_DESCRIPTOR_MAX_SIZE];
+      grub_uint32_t magic, word;
+      grub_uint8_t flg;
+      grub_size_t desc_size = 3;
+      grub_uint32_t max_size;
+      grub_uint64_t content_size = 0, frame_size = 0;
+      int flags = 0;
+
+      grub_file_seek (io, pos);
+      if (grub_file_read (io, &magic, sizeof (magic)) != sizeof (magic))
+	return 0;
+      magic = grub_le_to_cpu32 (magic);
+
+      if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC)
+	{
+	  if (grub_file_read (io, &word, sizeof (word)) != sizeof (word))
+	    return 0;
+	  pos += sizeof (magic) + sizeof (word) + grub_le_to_cpu32 (word);
+	  continue;
+	}
+      if (magic != LZ4_MAGIC)
+	return 0;
+
+      if (grub_file_read (io, desc, 2) != 2)
+	return 0;
+      flg = desc[0];
+      /* Frames using a dictionary can't be decompressed.  */
+      if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION
+	  || (flg & (LZ4_FLG_RESERVED | LZ4_FLG_DICT_ID))
+	  || (desc[1] & ~LZ4_BD_MAX_SIZE_MASK)
+	  || (desc[1] >> LZ4_BD_MAX_SIZE_SHIFT) < 4)
+	return 0;
+      max_size = 1 << (2 * (desc[1] >> LZ4_BD_MAX_SIZE_SHIFT) + 8);
+      if (flg & LZ4_FLG_CONTENT_SIZE)
+	desc_size += sizeof (content_size);
+      if (grub_file_read (io, desc + 2, desc_size - 2)
+	  != (grub_ssize_t) desc_size - 2
+	  || ((xxh32 (desc, desc_size - 1) >> 8) & 0xff) != desc[desc_size - 1])
+	return 0;
+      if (flg & LZ4_FLG_CONTENT_SIZE)
+	content_size = grub_le_to_cpu64 (grub_get_unaligned64 (desc + 2));
+      pos += sizeof (magic) + desc_size;
+
+      if (flg & LZ4_FLG_BLOCK_CHECKSUM)
+	flags |= LZ4IO_CHECKSUM;
+      if (max_size > lz4io->max_block_size)
+	{
+	  grub_free (lz4io->cbuf);
+	  lz4io->max_block_size = max_size;
+	  lz4io->cbuf = grub_malloc (max_size + LZ4_CHECKSUM_SIZE);
+	  if (!lz4io->cbuf)
+	    return 0;
+	}
+
+      while (1)
+	{
+	  grub_uint32_t size;
+
+	  grub_file_seek (io, pos);
+	  if (grub_file_read (io, &word, sizeof (word)) != sizeof (word))
+	    return 0;
+	  pos += sizeof (word);
+	  word = grub_le_to_cpu32 (word);
+	  if (word == 0)
+	    break;
+
+	  size = word & ~LZ4_BLOCK_UNCOMPRESSED;
+	  if (size > max_size || !add_block (lz4io, &alloc, pos, word, flags)
+	      || !read_block_size (lz4io, &lz4io->blocks[lz4io->nblocks - 1],
+				   max_size))
+	    return 0;
+	  frame_size += lz4io->blocks[lz4io->nblocks - 1].usize;
+	  pos += size;
+	  if (flags & LZ4IO_CHECKSUM)
+	    pos += LZ4_CHECKSUM_SIZE;
+	  if (!(flg & LZ4_FLG_BLOCK_INDEP))
+	    flags |= LZ4IO_LINKED;
+	}
+      if (flg & LZ4_FLG_CONTENT_CHECKSUM)
+	pos += LZ4_CHECKSUM_SIZE;
+
+      if ((flg & LZ4_FLG_CONTENT_SIZE) && frame_size != content_size)
+	return 0;
+    }
+
+  /* Frames without blocks are fine: they hold an empty file.  */
+  if (pos != io->size)
+    return 0;
+
+  lz4io->ubuf = grub_malloc (GRUB_LZ4_WINDOW_SIZE + lz4io->max_block_size);
+  if (!lz4io->ubuf)
+    return 0;
+
+  for (i = 0; i < lz4io->nblocks; i++)
+    {
+      lz4io->blocks[i].uncompressed_offset = total;
+      total += lz4io->blocks[i].usize;
+    }
+
+  file->size = total;
+  return 1;
+}
+
+static grub_file_t
+grub_lz4io_open (grub_file_t io)
+{
+  grub_file_t file;
+  grub_lz4io_t lz4io;
+  grub_uint32_t magic;
+
+  if (grub_file_tell (io) != 0)
+    grub_file_seek (io, 0);
+
+  /* Don't bother with files which are not lz4.  */
+  if (grub_file_read (io, &magic, sizeof (magic)) != sizeof (magic)
+      || (magic != grub_cpu_to_le32_compile_time (LZ4_MAGIC)
+	  && (magic & grub_cpu_to_le32_compile_time (LZ4_SKIPPABLE_MASK))
+	  != grub_cpu_to_le32_compile_time (LZ4_SKIPPABLE_MAGIC)))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      return io;
+    }
+
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  lz4io = grub_zalloc (sizeof (*lz4io));
+  if (!lz4io)
+    {
+      grub_free (file);
+      return 0;
+    }
+
+  lz4io->file = io;
+
+  file->device = io->device;
+  file->offset = 0;
+  file->data = lz4io;
+  file->read_hook = 0;
+  file->fs = &grub_lz4io_fs;
+  file->size = GRUB_FILE_SIZE_UNKNOWN;
+  file->not_easily_seekable = 1;
+
+  if (!scan_frames (file))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      grub_free (lz4io->blocks);
+      grub_free (lz4io->cbuf);
+      grub_free (lz4io->ubuf);
+      grub_free (lz4io);
+      grub_free (file);
+
+      return io;
+    }
+
+  return file;
+}
+
+static grub_ssize_t
+grub_lz4io_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_lz4io_t lz4io = file->data;
+  grub_off_t offset = file->offset;
+  grub_ssize_t ret = 0;
+  grub_size_t i;
+
+  for (i = find_block (lz4io, offset); len > 0 && i < lz4io->nblocks; i++)
+    {
+      struct grub_lz4io_block *block = &lz4io->blocks[i];
+      grub_size_t off = offset - block->uncompressed_offset;
+      grub_size_t n = block->usize - off;
+
+      if (n > len)
+	n = len;
+
+      /* Decompress whole blocks straight into BUF, unless the next block
+	 needs this one in ubuf.  */
+      if (n == block->usize
+	  && !(block->flags & LZ4IO_LINKED)
+	  && !(i + 1 < lz4io->nblocks
+	       && (lz4io->blocks[i + 1].flags & LZ4IO_LINKED))
+	  && !(lz4io->has_block && lz4io->cur_block == i))
+	{
+	  grub_ssize_t size;
+
+	  size = decode_block (lz4io, i, (grub_uint8_t *) buf, n, 0);
+	  if (size < 0 || !check_block_size (lz4io, i, size))
+	    return -1;
+	}
+      else
+	{
+	  if (load_block (lz4io, i) < 0)
+	    return -1;
+	  grub_memcpy (buf, lz4io->ubuf + GRUB_LZ4_WINDOW_SIZE + off, n);
+	}
+
+      buf += n;
+      len -= n;
+      ret += n;
+      offset += n;
+    }
+
+  return ret;
+}
+
+/* Release everything, including the underlying file object.  */
+static grub_err_t
+grub_lz4io_close (grub_file_t file)
+{
+  grub_lz4io_t lz4io = file->data;
+
+  grub_file_close (lz4io->file);
+  grub_free (lz4io->blocks);
+  grub_free (lz4io->cbuf);
+  grub_free (lz4io->ubuf);
+  grub_free (lz4io);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  return grub_errno;
+}
+
+static struct grub_fs grub_lz4io_fs = {
+  .name = "lz4io",
+  .dir = 0,
+  .open = 0,
+  .read = grub_lz4io_read,
+  .close = grub_lz4io_close,
+  .label = 0,
+  .next = 0
+};
+
+GRUB_MOD_INIT (lz4io)
+{
+  grub_file_filter_register (GRUB_FILE_FILTER_LZ4IO, grub_lz4io_open);
+}
+
+GRUB_MOD_FINI (lz4io)
+{
+  grub_file_filter_unregister (GRUB_FILE_FILTER_LZ4IO);
+}
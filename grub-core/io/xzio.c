@@ -32,6 +32,17 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define XZBUFSIZ 0x2000
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
+/* The index marker, the number of records, padding and the CRC32.  */
+#define XZ_INDEX_MIN_SIZE 8
+
+/* Where a block starts, from the stream index.  */
+struct grub_xzio_block
+{
+  /* The offset of the block header in the file.  */
+  grub_off_t offset;
+  /* The offset of the block's data in the uncompressed data.  */
+  grub_off_t uncompressed_offset;
+};
 
 struct grub_xzio
 {
@@ -41,6 +52,9 @@ struct grub_xzio
   grub_uint8_t inbuf[XZBUFSIZ];
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
+  /* The blocks of the stream, if the index describes the whole file.  */
+  struct grub_xzio_block *blocks;
+  grub_size_t nblocks;
 };
 
 typedef struct grub_xzio *grub_xzio_t;
@@ -70,22 +84,6 @@ decode_vli (const grub_uint8_t buf[], grub_size_t size_max,
   return i;
 }
 
-static grub_ssize_t
-read_vli (grub_file_t file, grub_uint64_t *num)
-{
-  grub_uint8_t buf[VLI_MAX_DIGITS];
-  grub_ssize_t read;
-  grub_size_t dec;
-
-  read = grub_file_read (file, buf, VLI_MAX_DIGITS);
-  if (read < 0)
-    return -1;
-
-  dec = decode_vli (buf, read, num);
-  grub_file_seek (file, file->offset - (read - dec));
-  return dec;
-}
-
 /* Function xz_dec_run() should consume header and ask for more (XZ_OK)
  * else file is corrupted (or options not supported) or not xz.  */
 static int
@@ -112,17 +110,22 @@ test_header (grub_file_t file)
 }
 
 /* Try to find out size of uncompressed data,
- * also do some footer sanity checks.  */
+ * also do some footer sanity checks.  Record where the blocks are too,
+ * if the stream is all there is in the file.  */
 static int
 test_footer (grub_file_t file)
 {
   grub_xzio_t xzio = file->data;
   grub_uint8_t footer[FOOTER_MAGIC_SIZE];
-  grub_uint32_t backsize;
-  grub_uint8_t imarker;
+  grub_uint32_t backsize_field;
+  grub_uint64_t backsize;
+  grub_uint8_t *index = 0, *ptr, *end;
   grub_uint64_t uncompressed_size_total = 0;
   grub_uint64_t uncompressed_size;
-  grub_uint64_t records;
+  grub_uint64_t unpadded_size;
+  grub_uint64_t records, i;
+  grub_off_t offset = STREAM_HEADER_SIZE;
+  grub_size_t n;
 
   grub_file_seek (xzio->file, xzio->file->size - FOOTER_MAGIC_SIZE);
   if (grub_file_read (xzio->file, footer, FOOTER_MAGIC_SIZE)
@@ -131,43 +134,121 @@ test_footer (grub_file_t file)
     goto ERROR;
 
   grub_file_seek (xzio->file, xzio->file->size - 8);
-  if (grub_file_read (xzio->file, &backsize, sizeof (backsize))
-      != sizeof (backsize))
+  if (grub_file_read (xzio->file, &backsize_field, sizeof (backsize_field))
+      != sizeof (backsize_field))
     goto ERROR;
 
-  /* Calculate real backward size.  */
-  backsize = (grub_le_to_cpu32 (backsize) + 1) * 4;
+  /* Calculate real backward size.  It takes up to 34 bits.  */
+  backsize = ((grub_uint64_t) grub_le_to_cpu32 (backsize_field) + 1) * 4;
+
+  if (backsize < XZ_INDEX_MIN_SIZE
+      || backsize > xzio->file->size - XZ_STREAM_FOOTER_SIZE
+      || backsize > ~(grub_size_t) 0)
+    goto ERROR;
 
-  /* Set file to the beginning of stream index.  */
+  /* Read the whole stream index.  */
+  index = grub_malloc (backsize);
+  if (!index)
+    goto ERROR;
   grub_file_seek (xzio->file,
 		  xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize);
+  if (grub_file_read (xzio->file, index, backsize) != (grub_ssize_t) backsize)
+    goto ERROR;
+  ptr = index;
+  end = index + backsize;
 
   /* Test index marker.  */
-  if (grub_file_read (xzio->file, &imarker, sizeof (imarker))
-      != sizeof (imarker) && imarker != 0x00)
+  if (*ptr++ != 0x00)
     goto ERROR;
 
-  if (read_vli (xzio->file, &records) <= 0)
+  n = decode_vli (ptr, end - ptr, &records);
+  if (!n)
     goto ERROR;
+  ptr += n;
+
+  /* Every record takes two bytes at least.  */
+  if (records > backsize / 2
+      || records > ~(grub_size_t) 0 / sizeof (xzio->blocks[0]))
+    goto ERROR;
+
+  if (records)
+    {
+      xzio->blocks = grub_malloc (records * sizeof (xzio->blocks[0]));
+      if (!xzio->blocks)
+	goto ERROR;
+    }
 
-  for (; records != 0; records--)
+  for (i = 0; i < records; i++)
     {
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Ignore unpadded.  */
+      n = decode_vli (ptr, end - ptr, &unpadded_size);
+      if (!n)
 	goto ERROR;
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Uncompressed.  */
+      ptr += n;
+      n = decode_vli (ptr, end - ptr, &uncompressed_size);
+      if (!n)
 	goto ERROR;
+      ptr += n;
 
+      xzio->blocks[i].offset = offset;
+      xzio->blocks[i].uncompressed_offset = uncompressed_size_total;
+      offset += ALIGN_UP (unpadded_size, 4);
       uncompressed_size_total += uncompressed_size;
     }
 
+  /* Without a whole and only stream, the offsets of the blocks are
+     unknown.  */
+  if (records
+      && offset + backsize + XZ_STREAM_FOOTER_SIZE == xzio->file->size)
+    xzio->nblocks = records;
+  else
+    {
+      grub_free (xzio->blocks);
+      xzio->blocks = 0;
+    }
+
+  grub_free (index);
   file->size = uncompressed_size_total;
   grub_file_seek (xzio->file, STREAM_HEADER_SIZE);
   return 1;
 
 ERROR:
+  grub_free (index);
+  grub_free (xzio->blocks);
+  xzio->blocks = 0;
   return 0;
 }
 
+/* Continue decompressing from the start of BLOCK.  */
+static void
+seek_block (grub_xzio_t xzio, grub_size_t block)
+{
+  xz_dec_seek_block (xzio->dec);
+  xzio->saved_offset = xzio->blocks[block].uncompressed_offset;
+  xzio->buf.out_pos = 0;
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  grub_file_seek (xzio->file, xzio->blocks[block].offset);
+}
+
+/* Return the last block starting at or before OFFSET.  */
+static grub_size_t
+find_block (grub_xzio_t xzio, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = xzio->nblocks;
+
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+
+      if (xzio->blocks[mid].uncompressed_offset <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
 static grub_file_t
 grub_xzio_open (grub_file_t io)
 {
@@ -240,8 +321,18 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   grub_xzio_t xzio = file->data;
   grub_off_t current_offset;
 
-  /* If seek backward need to reset decoder and start from beginning of file.
-     TODO Possible improvement by jumping blocks.  */
+  /* Jump to the block containing the data if going backward or if it is
+     after the current one.  */
+  if (xzio->nblocks)
+    {
+      grub_size_t block = find_block (xzio, file->offset);
+
+      if (file->offset < xzio->saved_offset
+	  || xzio->blocks[block].uncompressed_offset > xzio->saved_offset)
+	seek_block (xzio, block);
+    }
+
+  /* If seek backward need to reset decoder and start from beginning of file.  */
   if (file->offset < xzio->saved_offset)
     {
       xz_dec_reset (xzio->dec);
@@ -320,6 +411,7 @@ grub_xzio_close (grub_file_t file)
   xz_dec_end (xzio->dec);
 
   grub_file_close (xzio->file);
+  grub_free (xzio->blocks);
   grub_free (xzio);
 
   /* Device must not be closed twice.  */
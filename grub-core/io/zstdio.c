@@ -0,0 +1,383 @@
+/* zstdio.c - decompression support for zstd */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include "zstd.h"
+
+#define ZSTDBUFSIZ 0x20000
+#define ZSTD_BLOCK_HEADER_SIZE 3
+#define ZSTD_CHECKSUM_SIZE 4
+
+/* Where a frame starts.  */
+struct grub_zstdio_frame
+{
+  /* The offset of the frame in the file.  */
+  grub_off_t offset;
+  /* The offset of the frame's data in the uncompressed data.  */
+  grub_off_t uncompressed_offset;
+};
+
+struct grub_zstdio
+{
+  grub_file_t file;
+  ZSTD_DStream *dstream;
+  ZSTD_inBuffer input;
+  /* Nonzero if a frame was started but not finished.  */
+  int in_frame;
+  grub_off_t saved_offset;
+  /* The frames of the file.  Only the first one if the size of some
+     frame is unknown.  */
+  struct grub_zstdio_frame *frames;
+  grub_size_t nframes;
+  grub_uint8_t inbuf[ZSTDBUFSIZ];
+  grub_uint8_t outbuf[ZSTDBUFSIZ];
+};
+
+typedef struct grub_zstdio *grub_zstdio_t;
+static struct grub_fs grub_zstdio_fs;
+
+/* Decompress LEN bytes into BUF, or throw them away if BUF is NULL.
+   Return the number of bytes decompressed, which is less than LEN at the
+   end of the file, or -1 on errors.  */
+static grub_ssize_t
+decompress (grub_zstdio_t zstdio, char *buf, grub_off_t len)
+{
+  grub_ssize_t ret = 0;
+
+  while (len > 0)
+    {
+      ZSTD_outBuffer output;
+      grub_size_t zret;
+
+      if (buf)
+	{
+	  output.dst = buf + ret;
+	  output.size = len;
+	}
+      else
+	{
+	  output.dst = zstdio->outbuf;
+	  output.size = len < ZSTDBUFSIZ ? len : ZSTDBUFSIZ;
+	}
+      output.pos = 0;
+
+      /* Feed input.  */
+      if (zstdio->input.pos == zstdio->input.size)
+	{
+	  grub_ssize_t readret;
+
+	  readret = grub_file_read (zstdio->file, zstdio->inbuf, ZSTDBUFSIZ);
+	  if (readret < 0)
+	    return -1;
+	  if (readret == 0)
+	    {
+	      if (zstdio->in_frame)
+		{
+		  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			      N_("premature end of compressed data"));
+		  return -1;
+		}
+	      break;
+	    }
+	  zstdio->input.size = readret;
+	  zstdio->input.pos = 0;
+	}
+
+      zret = ZSTD_decompressStream (zstdio->dstream, &output, &zstdio->input);
+      if (ZSTD_isError (zret))
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		      N_("zstd file corrupted: %s"), ZSTD_getErrorName (zret));
+	  return -1;
+	}
+      zstdio->in_frame = (zret != 0);
+
+      zstdio->saved_offset += output.pos;
+      ret += output.pos;
+      len -= output.pos;
+    }
+
+  return ret;
+}
+
+/* Continue decompressing from the start of FRAME.  */
+static void
+seek_frame (grub_zstdio_t zstdio, grub_size_t frame)
+{
+  ZSTD_DCtx_reset (zstdio->dstream, ZSTD_reset_session_only);
+  zstdio->in_frame = 0;
+  zstdio->input.pos = 0;
+  zstdio->input.size = 0;
+  zstdio->saved_offset = zstdio->frames[frame].uncompressed_offset;
+  grub_file_seek (zstdio->file, zstdio->frames[frame].offset);
+}
+
+/* Return the last frame starting at or before OFFSET.  */
+static grub_size_t
+find_frame (grub_zstdio_t zstdio, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = zstdio->nframes;
+
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+
+      if (zstdio->frames[mid].uncompressed_offset <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Find the frames of the file and the size of the uncompressed data, by
+   walking the headers of the frames and of their blocks.  If a frame
+   doesn't record its size, decompress the whole file to find out.  */
+static int
+scan_frames (grub_file_t file)
+{
+  grub_zstdio_t zstdio = file->data;
+  grub_file_t io = zstdio->file;
+  grub_uint8_t header[ZSTD_FRAMEHEADERSIZE_MAX];
+  grub_off_t pos = 0;
+  grub_uint64_t total = 0;
+  grub_size_t alloc = 0;
+  int known = 1;
+
+  while (pos < io->size)
+    {
+      ZSTD_FrameHeader zfh;
+      grub_ssize_t n;
+      int last;
+
+      grub_file_seek (io, pos);
+      n = grub_file_read (io, header, sizeof (header));
+      if (n <= 0 || ZSTD_getFrameHeader (&zfh, header, n) != 0)
+	return 0;
+
+      if (zfh.frameType == ZSTD_skippableFrame)
+	{
+	  pos += zfh.headerSize + zfh.frameContentSize;
+	  continue;
+	}
+
+      if (zstdio->nframes == alloc)
+	{
+	  struct grub_zstdio_frame *frames;
+
+	  alloc = alloc ? 2 * alloc : 16;
+	  frames = grub_realloc (zstdio->frames, alloc * sizeof (frames[0]));
+	  if (!frames)
+	    return 0;
+	  zstdio->frames = frames;
+	}
+      zstdio->frames[zstdio->nframes].offset = pos;
+      zstdio->frames[zstdio->nframes].uncompressed_offset = total;
+      zstdio->nframes++;
+
+      if (zfh.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+	known = 0;
+      total += zfh.frameContentSize;
+
+      /* Skip the blocks.  */
+      pos += zfh.headerSize;
+      do
+	{
+	  grub_uint8_t bh[ZSTD_BLOCK_HEADER_SIZE];
+	  grub_uint32_t block;
+
+	  grub_file_seek (io, pos);
+	  if (grub_file_read (io, bh, sizeof (bh)) != sizeof (bh))
+	    return 0;
+	  block = bh[0] | (bh[1] << 8) | (bh[2] << 16);
+	  last = block & 1;
+	  pos += sizeof (bh);
+	  switch ((block >> 1) & 3)
+	    {
+	      /* RLE blocks store their byte once.  */
+	    case 1:
+	      pos += 1;
+	      break;
+	    case 3:
+	      return 0;
+	    default:
+	      pos += block >> 3;
+	    }
+	}
+      while (!last);
+
+      if (zfh.checksumFlag)
+	pos += ZSTD_CHECKSUM_SIZE;
+    }
+
+  if (pos != io->size || !zstdio->nframes)
+    return 0;
+
+  if (!known)
+    {
+      grub_ssize_t size;
+
+      zstdio->nframes = 1;
+      seek_frame (zstdio, 0);
+      size = decompress (zstdio, 0, GRUB_FILE_SIZE_UNKNOWN);
+      if (size < 0)
+	return 0;
+      total = size;
+    }
+
+  file->size = total;
+  seek_frame (zstdio, 0);
+  return 1;
+}
+
+static grub_file_t
+grub_zstdio_open (grub_file_t io)
+{
+  grub_file_t file;
+  grub_zstdio_t zstdio;
+  grub_uint8_t magic[4];
+
+  if (grub_file_tell (io) != 0)
+    grub_file_seek (io, 0);
+
+  /* Don't bother with files which are not zstd.  */
+  if (grub_file_read (io, magic, sizeof (magic)) != sizeof (magic)
+      || (grub_get_unaligned32 (magic)
+	  != grub_cpu_to_le32_compile_time (ZSTD_MAGICNUMBER)
+	  && (grub_get_unaligned32 (magic)
+	      & grub_cpu_to_le32_compile_time (ZSTD_MAGIC_SKIPPABLE_MASK))
+	  != grub_cpu_to_le32_compile_time (ZSTD_MAGIC_SKIPPABLE_START)))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      return io;
+    }
+
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  zstdio = grub_zalloc (sizeof (*zstdio));
+  if (!zstdio)
+    {
+      grub_free (file);
+      return 0;
+    }
+
+  zstdio->file = io;
+  zstdio->input.src = zstdio->inbuf;
+
+  file->device = io->device;
+  file->offset = 0;
+  file->data = zstdio;
+  file->read_hook = 0;
+  file->fs = &grub_zstdio_fs;
+  file->size = GRUB_FILE_SIZE_UNKNOWN;
+  file->not_easily_seekable = 1;
+
+  zstdio->dstream = ZSTD_createDStream ();
+  if (!zstdio->dstream)
+    {
+      grub_free (zstdio);
+      grub_free (file);
+      return 0;
+    }
+
+  if (!scan_frames (file))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      ZSTD_freeDStream (zstdio->dstream);
+      grub_free (zstdio->frames);
+      grub_free (zstdio);
+      grub_free (file);
+
+      return io;
+    }
+
+  return file;
+}
+
+static grub_ssize_t
+grub_zstdio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_zstdio_t zstdio = file->data;
+  grub_size_t frame;
+
+  /* Jump to the frame containing the data if going backward or if it is
+     after the current one.  */
+  frame = find_frame (zstdio, file->offset);
+  if (file->offset < zstdio->saved_offset
+      || zstdio->frames[frame].uncompressed_offset > zstdio->saved_offset)
+    seek_frame (zstdio, frame);
+
+  if (file->offset > zstdio->saved_offset
+      && decompress (zstdio, 0, file->offset - zstdio->saved_offset) < 0)
+    return -1;
+
+  return decompress (zstdio, buf, len);
+}
+
+/* Release everything, including the underlying file object.  */
+static grub_err_t
+grub_zstdio_close (grub_file_t file)
+{
+  grub_zstdio_t zstdio = file->data;
+
+  ZSTD_freeDStream (zstdio->dstream);
+
+  grub_file_close (zstdio->file);
+  grub_free (zstdio->frames);
+  grub_free (zstdio);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  return grub_errno;
+}
+
+static struct grub_fs grub_zstdio_fs = {
+  .name = "zstdio",
+  .dir = 0,
+  .open = 0,
+  .read = grub_zstdio_read,
+  .close = grub_zstdio_close,
+  .label = 0,
+  .next = 0
+};
+
+GRUB_MOD_INIT (zstdio)
+{
+  grub_file_filter_register (GRUB_FILE_FILTER_ZSTDIO, grub_zstdio_open);
+}
+
+GRUB_MOD_FINI (zstdio)
+{
+  grub_file_filter_unregister (GRUB_FILE_FILTER_ZSTDIO);
+}
@@ -0,0 +1,139 @@
+/* boottrace.c - record how long the phases of the boot take  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/boottrace.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/time.h>
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/tsc.h>
+#endif
+
+/* Allocated by the first span, so that nothing is spent on the trace
+   before there is a heap and a clock.  */
+static struct grub_boottrace_span *spans;
+static unsigned nspans, dropped, depth;
+static int next_id;
+#if defined (__i386__) || defined (__x86_64__)
+static int have_tsc;
+#endif
+
+static grub_uint64_t
+read_tsc (void)
+{
+#if defined (__i386__) || defined (__x86_64__)
+  if (have_tsc)
+    return grub_get_tsc ();
+#endif
+  return 0;
+}
+
+/* Open a span of the kind KIND about the object FMT describes.  Return
+   the handle to pass to grub_boottrace_end, or -1 if the trace is full.  */
+int
+grub_boottrace_begin (const char *kind, const char *fmt, ...)
+{
+  struct grub_boottrace_span *span;
+  va_list args;
+
+  if (! spans)
+    {
+      spans = grub_malloc (GRUB_BOOTTRACE_MAX * sizeof (spans[0]));
+      if (! spans)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  dropped++;
+	  return -1;
+	}
+#if defined (__i386__) || defined (__x86_64__)
+      have_tsc = grub_cpu_is_tsc_supported ();
+#endif
+    }
+
+  if (nspans == GRUB_BOOTTRACE_MAX)
+    {
+      dropped++;
+      return -1;
+    }
+
+  span = &spans[nspans];
+  grub_snprintf (span->kind, sizeof (span->kind), "%s", kind);
+  va_start (args, fmt);
+  grub_vsnprintf (span->arg, sizeof (span->arg), fmt, args);
+  va_end (args);
+  span->id = next_id++;
+  span->depth = depth++;
+  span->open = 1;
+  span->end_ms = span->end_tsc = 0;
+  span->start_ms = grub_get_time_ms ();
+  span->start_tsc = read_tsc ();
+
+  nspans++;
+  return span->id;
+}
+
+/* Close the span SPAN returned by grub_boottrace_begin.  The spans are
+   nested, so it's one of the last ones.  */
+void
+grub_boottrace_end (int span)
+{
+  grub_uint64_t end_tsc, end_ms;
+  unsigned i;
+
+  if (span < 0)
+    return;
+
+  end_tsc = read_tsc ();
+  end_ms = grub_get_time_ms ();
+  for (i = nspans; i > 0; i--)
+    if (spans[i - 1].id == span)
+      {
+	if (spans[i - 1].open)
+	  {
+	    spans[i - 1].end_tsc = end_tsc;
+	    spans[i - 1].end_ms = end_ms;
+	    spans[i - 1].open = 0;
+	    depth--;
+	  }
+	return;
+      }
+}
+
+/* Return the spans recorded so far, in the order they began.  */
+const struct grub_boottrace_span *
+grub_boottrace_get (unsigned *n, unsigned *ndropped)
+{
+  *n = nspans;
+  *ndropped = dropped;
+  return spans;
+}
+
+/* Forget the closed spans, to trace again from now on.  The open ones
+   are kept, since they are still going to be closed.  */
+void
+grub_boottrace_clear (void)
+{
+  unsigned i, n = 0;
+
+  for (i = 0; i < nspans; i++)
+    if (spans[i].open)
+      spans[n++] = spans[i];
+  nspans = n;
+  dropped = 0;
+}
@@ -26,64 +26,168 @@
 #include <grub/file.h>
 #include <grub/i18n.h>
 
-#define	GRUB_CACHE_TIMEOUT	2
+/* Per-device state which outlives the grub_disk_t handles.  The records
+   are never freed, so a device keeps it across opens.
+
+   The generation of a device changes whenever its contents may have
+   changed behind the cache, i.e. on writes, on media change and when a
+   virtual device is set up anew, and cache entries of older generations
+   are stale.  */
+struct grub_disk_state
+{
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  char *name;
+  unsigned long generation;
+  struct grub_disk_stats stats;
+  struct grub_disk_state *next;
+};
+
+static struct grub_disk_state *grub_disk_state_list;
+static unsigned long grub_disk_generation_counter;
 
-/* The last time the disk was used.  */
-static grub_uint64_t grub_last_time = 0;
+/* Return the state record of the device DEV_ID, DISK_ID, if any.  */
+static struct grub_disk_state *
+grub_disk_state_find (unsigned long dev_id, unsigned long disk_id)
+{
+  struct grub_disk_state *state;
+
+  for (state = grub_disk_state_list; state; state = state->next)
+    if (state->dev_id == dev_id && state->disk_id == disk_id)
+      break;
 
+  return state;
+}
 
-/* Disk cache.  */
+/* Disk cache.  The cache is set-associative: a block may live in any of
+   the GRUB_DISK_CACHE_WAYS entries of the set it hashes to, and the least
+   recently used entry of that set is replaced first.  Pinned entries hold
+   filesystem metadata and are never displaced by ordinary reads.  */
 struct grub_disk_cache
 {
   enum grub_disk_dev_id dev_id;
   unsigned long disk_id;
+  unsigned long generation;
+  /* The first device sector of the block, and the size of DATA, which
+     depends on the sector size of the device.  */
   grub_disk_addr_t sector;
+  grub_size_t size;
   char *data;
   int lock;
+  int pinned;
+  unsigned long last_use;
 };
 
-static struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
+static struct grub_disk_cache *grub_disk_cache_table;
+static unsigned grub_disk_cache_num_sets;
+static unsigned long grub_disk_cache_clock;
+
+/* The buffers of blocks of the usual size.  */
+static grub_pool_t grub_disk_cache_pool;
 
 void (*grub_disk_firmware_fini) (void);
+void (*grub_disk_trace_hook) (grub_disk_t disk, int type, int flags,
+			      grub_disk_addr_t sector, grub_off_t offset,
+			      grub_size_t size);
+
+/* Cache geometry and read-ahead tunables.  If grub_disk_cache_sets is 0,
+   the cache is sized from the heap.  */
+unsigned grub_disk_cache_sets;
+grub_size_t grub_disk_readahead_max = GRUB_DISK_READAHEAD_MAX;
 int grub_disk_firmware_is_tainted;
 
-#if DISK_CACHE_STATS
-static unsigned long grub_disk_cache_hits;
-static unsigned long grub_disk_cache_misses;
 
-void
-grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
+/* Allocate the cache table.  The number of sets depends on how much heap
+   is available, so this is done on the first open rather than at
+   startup.  */
+static void
+grub_disk_cache_init (void)
 {
-  *hits = grub_disk_cache_hits;
-  *misses = grub_disk_cache_misses;
-}
+  grub_size_t budget;
+  unsigned num_sets;
+
+#if defined (GRUB_UTIL) || defined (GRUB_MACHINE_EMU)
+  budget = ~(grub_size_t) 0;
+#else
+  /* Let the cache grow up to a quarter of the free heap.  */
+  budget = grub_mm_get_free () / 4;
 #endif
 
-/**
-* @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
-*（课题编号：2012ZX01039-004）”的资助。
-*
-* @copyright 注释添加单位：清华大学——03任务（Linux内核相关通用基础软件包分析）承担单位
-*
-* @author 注释添加人员：谢文学
-*
-* @date 注释添加日期：2013年6月8日
-*
-* @brief 获得对应磁盘设备的扇区在disk cache数组中的索引。
-*
-* @note 注释详细内容:
-*
-* 本函数实现获得对应磁盘设备的扇区在disk cache数组中的索引的功能。实际是使用参数dev_id，
-* disk_id，以及sector按照哈希表方式做映射。
-**/
-static unsigned
-grub_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
-			   grub_disk_addr_t sector)
+  for (num_sets = GRUB_DISK_CACHE_MAX_SETS;
+       num_sets > GRUB_DISK_CACHE_MIN_SETS
+	 && ((grub_size_t) num_sets * GRUB_DISK_CACHE_WAYS
+	     * (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS)) > budget;
+       num_sets >>= 1);
+
+  /* An explicit size, rounded down to a power of two.  */
+  if (grub_disk_cache_sets)
+    for (num_sets = 1; (num_sets << 1) <= grub_disk_cache_sets
+	   && (num_sets << 1) != 0; num_sets <<= 1);
+
+  grub_disk_cache_table = grub_zalloc (num_sets * GRUB_DISK_CACHE_WAYS
+				       * sizeof (grub_disk_cache_table[0]));
+  if (! grub_disk_cache_table)
+    {
+      /* Work uncached rather than fail.  */
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  grub_disk_cache_num_sets = num_sets;
+  grub_dprintf ("disk", "disk cache: %u sets of %u entries\n",
+		num_sets, GRUB_DISK_CACHE_WAYS);
+
+  if (! grub_disk_cache_pool)
+    {
+      grub_disk_cache_pool
+	= grub_pool_create (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS, 0,
+			    GRUB_DISK_CACHE_WAYS);
+      grub_errno = GRUB_ERR_NONE;
+    }
+}
+
+/* Allocate a buffer for a cache block of SIZE bytes.  */
+static char *
+grub_disk_cache_alloc (grub_size_t size)
 {
-  return ((dev_id * 524287UL + disk_id * 2606459UL
-	   + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
-	  % GRUB_DISK_CACHE_NUM);
+  if (grub_disk_cache_pool
+      && size == (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS))
+    return grub_pool_alloc (grub_disk_cache_pool);
+
+  return grub_malloc (size);
+}
+
+/* Release the buffer of CACHE.  */
+static void
+grub_disk_cache_free (struct grub_disk_cache *cache)
+{
+  if (grub_disk_cache_pool
+      && cache->size == (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS))
+    grub_pool_free (grub_disk_cache_pool, cache->data);
+  else
+    grub_free (cache->data);
+  cache->data = 0;
+}
+
+/* Return the logarithm of the size of the cache blocks of DISK in bytes.
+   Blocks hold GRUB_DISK_CACHE_SIZE 512-byte sectors, or a single sector
+   of devices with larger sectors.  */
+static inline unsigned
+grub_disk_cache_block_bits (grub_disk_t disk)
+{
+  if (disk->log_sector_size > GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS)
+    return disk->log_sector_size;
+  return GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS;
 }
+
+/* Return the logarithm of the number of device sectors in a cache block
+   of DISK.  */
+static inline unsigned
+grub_disk_cache_shift (grub_disk_t disk)
+{
+  return grub_disk_cache_block_bits (disk) - disk->log_sector_size;
+}
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -94,33 +198,69 @@ grub_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
 *
 * @date 注释添加日期：2013年6月8日
 *
-* @brief 使得对应磁盘设备的扇区的缓存数据在disk cache中无效。
+* @brief 获得对应磁盘设备的扇区在disk cache中所属的组。
 *
 * @note 注释详细内容:
 *
-* 本函数实现使得对应磁盘设备的扇区的缓存数据在disk cache中无效的功能。通过调用函数
-* grub_disk_cache_get_index()获得在disk cache数组的索引，进而获得对应的cache项，如果
-* 该cache项与参数一致（命中），那么就释放该缓存项，并使得该项数据无效。
+* 本函数实现获得对应磁盘设备的扇区在disk cache中所属的组（set）的功能。实际是使用磁盘
+* 的dev->id，id，以及sector（实际扇区大小单位）所在cache块的编号按照哈希表方式做映射，
+* 返回该组第一个cache项。
 **/
-static void
-grub_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
-			    grub_disk_addr_t sector)
+static struct grub_disk_cache *
+grub_disk_cache_get_set (grub_disk_t disk, grub_disk_addr_t sector)
 {
   unsigned index;
-  struct grub_disk_cache *cache;
 
-  sector &= ~(GRUB_DISK_CACHE_SIZE - 1);
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  index = ((disk->dev->id * 524287UL + disk->id * 2606459UL
+	    + ((unsigned) (sector >> grub_disk_cache_shift (disk))))
+	   & (grub_disk_cache_num_sets - 1));
+  return grub_disk_cache_table + index * GRUB_DISK_CACHE_WAYS;
+}
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector && cache->data)
-    {
-      cache->lock = 1;
-      grub_free (cache->data);
-      cache->data = 0;
-      cache->lock = 0;
-    }
+/* Drop the whole cache, so that the next open allocates it again
+   according to GRUB_DISK_CACHE_SETS.  */
+void
+grub_disk_cache_reset (void)
+{
+  grub_disk_cache_invalidate_all ();
+  grub_free (grub_disk_cache_table);
+  grub_disk_cache_table = 0;
+  grub_disk_cache_num_sets = 0;
+}
+
+/* Return the entry caching the block of DISK starting at device sector
+   SECTOR in the current generation of the device, if any.  */
+static struct grub_disk_cache *
+grub_disk_cache_find (grub_disk_t disk, grub_disk_addr_t sector)
+{
+  struct grub_disk_cache *set;
+  unsigned i;
+
+  if (! grub_disk_cache_num_sets)
+    return 0;
+
+  set = grub_disk_cache_get_set (disk, sector);
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+    if (set[i].data && set[i].dev_id == disk->dev->id
+	&& set[i].disk_id == disk->id
+	&& set[i].generation == disk->state->generation
+	&& set[i].sector == sector)
+      return set + i;
+
+  return 0;
+}
+
+/* Count the pinned entries in the set starting at SET.  */
+static unsigned
+grub_disk_cache_count_pinned (struct grub_disk_cache *set)
+{
+  unsigned i, n = 0;
+
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+    if (set[i].data && set[i].pinned)
+      n++;
+
+  return n;
 }
 
 /**
@@ -137,22 +277,23 @@ grub_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
 *
 * @note 注释详细内容:
 *
-* 本函数实现使得磁盘设备的扇区的所有缓存数据在disk cache中无效的功能。对总共所有
-* GRUB_DISK_CACHE_NUM项的cache项，就释放该缓存项，并使得该项数据无效。
+* 本函数实现使得磁盘设备的扇区的所有缓存数据在disk cache中无效的功能。对所有组中
+* 的所有cache项（包括被钉住的项），就释放该缓存项，并使得该项数据无效。通常大小的缓冲
+* 区通过grub_disk_cache_free()放回对象池grub_disk_cache_pool。
 **/
 void
 grub_disk_cache_invalidate_all (void)
 {
   unsigned i;
 
-  for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
+  for (i = 0; i < grub_disk_cache_num_sets * GRUB_DISK_CACHE_WAYS; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
 
       if (cache->data && ! cache->lock)
 	{
-	  grub_free (cache->data);
-	  cache->data = 0;
+	  grub_disk_cache_free (cache);
+	  cache->pinned = 0;
 	}
     }
 }
@@ -171,33 +312,30 @@ grub_disk_cache_invalidate_all (void)
 * @note 注释详细内容:
 *
 * 本函数实现获得对应磁盘设备的扇区在disk cache中的有效缓存数据的功能。通过调用函数
-* grub_disk_cache_get_index()获得在disk cache数组的索引，进而获得对应的cache项，如果
-* 该cache项与参数一致（命中），那么就返回该项的有效缓存数据，并锁定该缓存项（lock = 1）。
+* grub_disk_cache_find()在所属组中查找对应的cache项，如果找到（命中），那么就更新该项
+* 的最近使用时间，返回该项的有效缓存数据，并锁定该缓存项（lock = 1）。
 **/
 static char *
-grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
-		       grub_disk_addr_t sector)
+grub_disk_cache_fetch (grub_disk_t disk, grub_disk_addr_t sector, int pin)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  cache = grub_disk_cache_find (disk, sector);
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  if (cache)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
-      grub_disk_cache_hits++;
-#endif
+      cache->last_use = ++grub_disk_cache_clock;
+      /* Metadata found among ordinary data gets promoted, as long as the
+	 set keeps room for the latter.  */
+      if (pin && ! cache->pinned
+	  && (grub_disk_cache_count_pinned (grub_disk_cache_get_set (disk,
+								     sector))
+	      < GRUB_DISK_CACHE_MAX_PINNED))
+	cache->pinned = 1;
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
-  grub_disk_cache_misses++;
-#endif
-
   return 0;
 }
 /**
@@ -215,21 +353,16 @@ grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
 * @note 注释详细内容:
 *
 * 本函数实现解除对应磁盘设备的扇区在disk cache中的cache项的锁定的功能。通过调用函数
-* grub_disk_cache_get_index()获得在disk cache数组的索引，进而获得对应的cache项，如果
-* 该cache项与参数一致（命中），那么就解除锁定该缓存项（lock = 0）。
+* grub_disk_cache_find()在所属组中查找对应的cache项，如果找到（命中），那么就解除锁定
+* 该缓存项（lock = 0）。
 **/
 static void
-grub_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
-			grub_disk_addr_t sector)
+grub_disk_cache_unlock (grub_disk_t disk, grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
-
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_find (disk, sector);
+  if (cache)
     cache->lock = 0;
 }
 
@@ -247,39 +380,249 @@ grub_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
 *
 * @note 注释详细内容:
 *
-* 本函数实现将对应磁盘设备的扇区的数据存储在disk cache中的cache项的功能。通过调用函数
-* grub_disk_cache_get_index()获得在disk cache数组的索引，进而获得对应的cache项，释放原
-* 有cache项的数据，重新分配新的要存储的数据缓冲区，将数据拷贝进入缓冲区，并更新dev_id，
-* disk_id以及sector等信息。
+* 本函数实现将对应磁盘设备的扇区的数据存储在disk cache中的cache项的功能。在所属组中
+* 选择一个牺牲项：优先选择已有的同一扇区项或空闲项，否则选择最久未使用的未钉住项；钉
+* 住的数据只有在组中钉住项数未达到GRUB_DISK_CACHE_MAX_PINNED时才会替换未钉住项。然后
+* 将数据拷贝进入缓冲区，并更新dev_id，disk_id以及sector等信息。cache块的大小取决于设备的
+* 实际扇区大小，若牺牲项原有缓冲区大小不同则重新分配（通常大小的缓冲区取自对象池
+* grub_disk_cache_pool）；分配失败时只是不缓存该块。
 **/
-static grub_err_t
-grub_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
-		       grub_disk_addr_t sector, const char *data)
+static void
+grub_disk_cache_store (grub_disk_t disk, grub_disk_addr_t sector,
+		       const char *data, int pin)
 {
-  unsigned index;
-  struct grub_disk_cache *cache;
+  struct grub_disk_cache *set, *cache;
+  unsigned i;
+  int evict_pinned;
+  struct grub_disk_state *victim;
+  grub_size_t size = (grub_size_t) 1 << grub_disk_cache_block_bits (disk);
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  if (! grub_disk_cache_num_sets)
+    return;
 
-  cache->lock = 1;
-  grub_free (cache->data);
-  cache->data = 0;
-  cache->lock = 0;
+  set = grub_disk_cache_get_set (disk, sector);
+
+  cache = grub_disk_cache_find (disk, sector);
+  if (cache)
+    {
+      if (cache->lock)
+	return;
+      pin |= cache->pinned;
+    }
+
+  /* Free entries come first, then stale ones of the same device.  */
+  for (i = 0; ! cache && i < GRUB_DISK_CACHE_WAYS; i++)
+    if (! set[i].data && ! set[i].lock)
+      cache = set + i;
+
+  for (i = 0; ! cache && i < GRUB_DISK_CACHE_WAYS; i++)
+    if (! set[i].lock && set[i].dev_id == disk->dev->id
+	&& set[i].disk_id == disk->id
+	&& set[i].generation != disk->state->generation)
+      cache = set + i;
+
+  if (! cache)
+    {
+      /* Pinned data may displace ordinary data only while the set still
+	 has room for the latter; past that it replaces the oldest pinned
+	 entry.  Ordinary data never displaces pinned entries.  */
+      evict_pinned = (pin && (grub_disk_cache_count_pinned (set)
+			      >= GRUB_DISK_CACHE_MAX_PINNED));
+      for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+	{
+	  if (set[i].lock || set[i].pinned != evict_pinned)
+	    continue;
+	  if (! cache || set[i].last_use < cache->last_use)
+	    cache = set + i;
+	}
+      if (! cache)
+	return;
+
+      victim = grub_disk_state_find (cache->dev_id, cache->disk_id);
+      if (victim)
+	victim->stats.evictions++;
+    }
+
+  if (cache->data && cache->size != size)
+    grub_disk_cache_free (cache);
 
-  cache->data = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
   if (! cache->data)
-    return grub_errno;
+    {
+      cache->data = grub_disk_cache_alloc (size);
+      if (! cache->data)
+	{
+	  /* Not caching is no failure.  */
+	  grub_errno = GRUB_ERR_NONE;
+	  cache->pinned = 0;
+	  return;
+	}
+    }
 
-  grub_memcpy (cache->data, data,
-	       GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  cache->dev_id = dev_id;
-  cache->disk_id = disk_id;
+  grub_memcpy (cache->data, data, size);
+  cache->dev_id = disk->dev->id;
+  cache->disk_id = disk->id;
+  cache->generation = disk->state->generation;
   cache->sector = sector;
+  cache->size = size;
+  cache->pinned = pin;
+  cache->last_use = ++grub_disk_cache_clock;
+}
+
+/* Attach the state record of the device of DISK, creating it the first
+   time the device is seen.  */
+static grub_err_t
+grub_disk_state_attach (grub_disk_t disk)
+{
+  struct grub_disk_state *state;
+
+  state = grub_disk_state_find (disk->dev->id, disk->id);
+  if (! state)
+    {
+      state = grub_zalloc (sizeof (*state));
+      if (! state)
+	return grub_errno;
+      state->name = grub_strdup (disk->name);
+      if (! state->name)
+	{
+	  grub_free (state);
+	  return grub_errno;
+	}
+      state->dev_id = disk->dev->id;
+      state->disk_id = disk->id;
+      state->generation = ++grub_disk_generation_counter;
+      state->next = grub_disk_state_list;
+      grub_disk_state_list = state;
+    }
 
+  disk->state = state;
   return GRUB_ERR_NONE;
 }
 
+/* Move the device of DISK to a new generation, which makes all its cached
+   data stale.  */
+static void
+grub_disk_bump_generation (grub_disk_t disk)
+{
+  disk->state->generation = ++grub_disk_generation_counter;
+  disk->ra_next = 0;
+  disk->ra_window = 0;
+}
+
+/* Return the current generation of the device of DISK.  It changes
+   whenever the contents of the device may have changed, so it can be used
+   to validate data derived from them.  */
+unsigned long
+grub_disk_get_generation (grub_disk_t disk)
+{
+  return disk->state->generation;
+}
+
+/* Tell the disk layer that the medium in the device of DISK was changed,
+   e.g. because the firmware reported so.  */
+void
+grub_disk_media_changed (grub_disk_t disk)
+{
+  grub_dprintf ("disk", "media change on `%s'\n", disk->name);
+  grub_disk_bump_generation (disk);
+}
+
+/* Tell the disk layer that the device DEV_ID, DISK_ID now has other
+   contents or geometry, e.g. because a loopback device was replaced or
+   deleted.  Unlike grub_disk_media_changed, the device needn't be open.  */
+void
+grub_disk_device_changed (enum grub_disk_dev_id dev_id,
+			  unsigned long disk_id)
+{
+  struct grub_disk_state *state;
+
+  state = grub_disk_state_find (dev_id, disk_id);
+  if (state)
+    state->generation = ++grub_disk_generation_counter;
+}
+
+/* Account a request of SIZE bytes which the driver of DISK served in
+   ELAPSED milliseconds.  */
+static void
+grub_disk_stats_account (grub_disk_t disk, grub_size_t size,
+			 grub_uint64_t elapsed)
+{
+  struct grub_disk_stats *stats = &disk->state->stats;
+  unsigned bucket = 0;
+
+  stats->read_time += elapsed;
+  while (elapsed && bucket < GRUB_DISK_STATS_LATENCY_BUCKETS - 1)
+    {
+      elapsed >>= 1;
+      bucket++;
+    }
+
+  stats->reads++;
+  stats->bytes_read += size;
+  stats->latency[bucket]++;
+}
+
+/* Read SIZE sectors at SECTOR, in device units, from the driver of DISK
+   and account for it.  */
+static grub_err_t
+grub_disk_dev_read (grub_disk_t disk, grub_disk_addr_t sector,
+		    grub_size_t size, char *buf)
+{
+  grub_uint64_t start;
+  grub_err_t err;
+
+  if (grub_disk_trace_hook)
+    grub_disk_trace_hook (disk, GRUB_DISK_TRACE_DEVICE, 0,
+			  sector << (disk->log_sector_size
+				     - GRUB_DISK_SECTOR_BITS), 0,
+			  size << disk->log_sector_size);
+
+  start = grub_get_time_ms ();
+  err = (disk->dev->read) (disk, sector, size, buf);
+  grub_disk_stats_account (disk, size << disk->log_sector_size,
+			   grub_get_time_ms () - start);
+  return err;
+}
+
+/* Call HOOK with the name and the statistics of each device seen so far.  */
+int
+grub_disk_stats_iterate (int (*hook) (const char *name,
+				      const struct grub_disk_stats *stats))
+{
+  struct grub_disk_state *state;
+
+  for (state = grub_disk_state_list; state; state = state->next)
+    if (hook (state->name, &state->stats))
+      return 1;
+
+  return 0;
+}
+
+/* Clear the statistics of all devices.  */
+void
+grub_disk_stats_reset (void)
+{
+  struct grub_disk_state *state;
+
+  for (state = grub_disk_state_list; state; state = state->next)
+    grub_memset (&state->stats, 0, sizeof (state->stats));
+}
+
+#if DISK_CACHE_STATS
+void
+grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
+{
+  struct grub_disk_state *state;
+
+  *hits = 0;
+  *misses = 0;
+  for (state = grub_disk_state_list; state; state = state->next)
+    {
+      *hits += state->stats.cache_hits;
+      *misses += state->stats.cache_misses;
+    }
+}
+#endif
+
 /**< 全局磁盘设备列表 */
 grub_disk_dev_t grub_disk_dev_list;
 
@@ -390,8 +733,8 @@ find_part_sep (const char *name)
 * 如果没有找到设备或者磁盘扇区大小不被支持，那么就错误退出；
 * 4） 如果磁盘设备打开成功，那么看是否还指定了分区，如果又指定了分区，那么就进一步调用函数
 * grub_partition_probe()来打开分区，保存返回的分区结构到disk->partition。
-* 5） 根据上次访问该磁盘设备到当前访问之间的时间间隔，如果超过2秒钟，那么就无效磁盘cache数据。
-* 并更新最后访问该磁盘的时间为本次访问的当前时间。
+* 5） 调用grub_disk_state_attach()关联该设备的状态记录，其中包括设备的代数（generation）
+* 和I/O统计；缓存数据只有在其代数与设备当前代数一致时才有效，因此空闲时间不再导致缓存失效。
 **/
 grub_disk_t
 grub_disk_open (const char *name)
@@ -400,7 +743,6 @@ grub_disk_open (const char *name)
   grub_disk_t disk;
   grub_disk_dev_t dev;
   char *raw = (char *) name;
-  grub_uint64_t current_time;
 
   grub_dprintf ("disk", "Opening `%s'...\n", name);
 
@@ -443,7 +785,7 @@ grub_disk_open (const char *name)
 		  name);
       goto fail;
     }
-  if (disk->log_sector_size > GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS
+  if (disk->log_sector_size > GRUB_DISK_MAX_SECTOR_BITS
       || disk->log_sector_size < GRUB_DISK_SECTOR_BITS)
     {
       grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
@@ -454,6 +796,12 @@ grub_disk_open (const char *name)
 
   disk->dev = dev;
 
+  if (grub_disk_state_attach (disk))
+    goto fail;
+
+  if (! grub_disk_cache_table)
+    grub_disk_cache_init ();
+
   if (p)
     {
       disk->partition = grub_partition_probe (disk, p + 1);
@@ -466,16 +814,6 @@ grub_disk_open (const char *name)
 	}
     }
 
-  /* The cache will be invalidated about 2 seconds after a device was
-     closed.  */
-  current_time = grub_get_time_ms ();
-
-  if (current_time > (grub_last_time
-		      + GRUB_CACHE_TIMEOUT * 1000))
-    grub_disk_cache_invalidate_all ();
-
-  grub_last_time = current_time;
-
  fail:
 
   if (raw && raw != name)
@@ -511,9 +849,8 @@ grub_disk_open (const char *name)
 * 本函数实现关闭已经打开的磁盘设备的功能。该函数的大致流程如下：
 *
 * 1）首先调用该磁盘设备的close()函数；
-* 2）重置最后访问时间；
-* 3）释放该磁盘的所有分区链表的每一项。
-* 4）释放该grub_disk_t的名字和结构本身。
+* 2）释放该磁盘的所有分区链表的每一项。
+* 3）释放该grub_disk_t的名字和结构本身。
 **/
 void
 grub_disk_close (grub_disk_t disk)
@@ -524,9 +861,6 @@ grub_disk_close (grub_disk_t disk)
   if (disk->dev && disk->dev->close)
     (disk->dev->close) (disk);
 
-  /* Reset the timer.  */
-  grub_last_time = grub_get_time_ms ();
-
   while (disk->partition)
     {
       part = disk->partition->parent;
@@ -624,6 +958,95 @@ transform_sector (grub_disk_t disk, grub_disk_addr_t sector)
   return sector >> (disk->log_sector_size - GRUB_DISK_SECTOR_BITS);
 }
 
+/* Call the read hook of DISK, if any, for the SIZE bytes read at OFFSET
+   past SECTOR.  The hook gets the whole contiguous range at once; it is
+   only split so that the length fits in an unsigned.  */
+static void
+grub_disk_call_read_hook (grub_disk_t disk, grub_disk_addr_t sector,
+			  grub_off_t offset, grub_size_t size)
+{
+  if (! disk->read_hook)
+    return;
+
+  sector += offset >> GRUB_DISK_SECTOR_BITS;
+  offset &= GRUB_DISK_SECTOR_SIZE - 1;
+
+  while (size)
+    {
+      grub_size_t cl;
+      cl = GRUB_DISK_READ_HOOK_MAX - offset;
+      if (cl > size)
+	cl = size;
+      (disk->read_hook) (sector, offset, cl);
+      sector += (offset + cl) >> GRUB_DISK_SECTOR_BITS;
+      size -= cl;
+      offset = 0;
+    }
+}
+
+/* Compatibility helper for read hooks which want to see one sector at a
+   time: split the range given by SECTOR, OFFSET and LENGTH into sectors
+   and call HOOK for each of them.  */
+void
+grub_disk_read_hook_sectors (grub_disk_addr_t sector, unsigned offset,
+			     unsigned length,
+			     void NESTED_FUNC_ATTR (*hook) (grub_disk_addr_t,
+							    unsigned,
+							    unsigned))
+{
+  sector += offset >> GRUB_DISK_SECTOR_BITS;
+  offset &= GRUB_DISK_SECTOR_SIZE - 1;
+
+  while (length)
+    {
+      unsigned cl;
+      cl = GRUB_DISK_SECTOR_SIZE - offset;
+      if (cl > length)
+	cl = length;
+      hook (sector, offset, cl);
+      sector++;
+      length -= cl;
+      offset = 0;
+    }
+}
+
+/* Return the number of cache blocks to read on a cache miss at device
+   sector SECTOR, i.e. the missing block plus the read-ahead, and update
+   the sequential access detection of DISK.  */
+static unsigned
+grub_disk_readahead_blocks (grub_disk_t disk, grub_disk_addr_t sector)
+{
+  unsigned shift = grub_disk_cache_shift (disk);
+  unsigned num, i;
+
+  if (sector == disk->ra_next)
+    {
+      disk->ra_window *= 2;
+      if (disk->ra_window < GRUB_DISK_READAHEAD_MIN)
+	disk->ra_window = GRUB_DISK_READAHEAD_MIN;
+      if (disk->ra_window > grub_disk_readahead_max)
+	disk->ra_window = grub_disk_readahead_max;
+    }
+  else
+    disk->ra_window = 0;
+
+  num = 1 + (disk->ra_window >> grub_disk_cache_block_bits (disk));
+
+  /* Don't read past the end of the disk.  */
+  if (disk->total_sectors != GRUB_DISK_SIZE_UNKNOWN)
+    while (num > 1
+	   && (sector + ((grub_disk_addr_t) num << shift)
+	       >= disk->total_sectors))
+      num--;
+
+  /* Nor again what is already cached.  */
+  for (i = 1; i < num; i++)
+    if (grub_disk_cache_find (disk, sector + ((grub_disk_addr_t) i << shift)))
+      break;
+
+  return i;
+}
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -641,51 +1064,85 @@ transform_sector (grub_disk_t disk, grub_disk_addr_t sector)
 * 本函数实现读取较小的磁盘扇区数据（小于cache size并且不越过cache项边界）的功能。大致
 * 步骤如下：
 *
+* 参数sector和offset都以实际扇区大小为单位，cache块的大小由grub_disk_cache_block_bits()
+* 决定，即至少GRUB_DISK_CACHE_SIZE个512字节扇区，或者一个更大的实际扇区。
+*
 * 1）首先调用grub_disk_cache_fetch()，如果命中，那么直接返回缓存的数据。
-* 2）如果不命中，那么尝试直接实际读取cahce块大小的数据，并将之存储到缓存；
+* 2）如果不命中，那么调用grub_disk_readahead_blocks()根据是否顺序访问确定预读窗口，
+* 一次读取请求的cache块及其后的预读块，并将它们都存储到缓存；
 * 3）如果读取cache块大小数据也失败了，那么再次尝试读取请求的实际大小。
 **/
 /* Small read (less than cache size and not pass across cache unit boundaries).
-   sector is already adjusted and is divisible by cache unit size.
+   sector is already adjusted, in device sectors and divisible by cache unit
+   size.  The ends of STREAMING reads don't read ahead, since what follows
+   is read straight into the caller's buffer.
  */
 static grub_err_t
 grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
-		      grub_off_t offset, grub_size_t size, void *buf)
+		      grub_off_t offset, grub_size_t size, void *buf, int pin,
+		      int streaming)
 {
   char *data;
   char *tmp_buf;
+  unsigned nblocks = 1;
+  unsigned block_bits = grub_disk_cache_block_bits (disk);
+  unsigned shift = grub_disk_cache_shift (disk);
 
   /* Fetch the cache.  */
-  data = grub_disk_cache_fetch (disk->dev->id, disk->id, sector);
+  data = grub_disk_cache_fetch (disk, sector, pin);
   if (data)
     {
+      disk->state->stats.cache_hits++;
       /* Just copy it!  */
       grub_memcpy (buf, data + offset, size);
-      grub_disk_cache_unlock (disk->dev->id, disk->id, sector);
+      grub_disk_cache_unlock (disk, sector);
+      if (! pin)
+	disk->ra_next = sector + (1 << shift);
       return GRUB_ERR_NONE;
     }
 
+  disk->state->stats.cache_misses++;
+
+  /* Metadata accesses are scattered and would only disturb the sequential
+     access detection, so they don't take part in read-ahead.  */
+  if (! pin)
+    {
+      if (! streaming)
+	nblocks = grub_disk_readahead_blocks (disk, sector);
+      disk->ra_next = sector + (1 << shift);
+    }
+
   /* Allocate a temporary buffer.  */
-  tmp_buf = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  tmp_buf = grub_malloc ((grub_size_t) nblocks << block_bits);
+  if (! tmp_buf && nblocks > 1)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      nblocks = 1;
+      tmp_buf = grub_malloc ((grub_size_t) 1 << block_bits);
+    }
   if (! tmp_buf)
     return grub_errno;
 
   /* Otherwise read data from the disk actually.  */
   if (disk->total_sectors == GRUB_DISK_SIZE_UNKNOWN
-      || sector + GRUB_DISK_CACHE_SIZE/**< 读取一个cache块不会超过磁盘总大小末尾 */
-      < (disk->total_sectors << (disk->log_sector_size - GRUB_DISK_SECTOR_BITS)))
+      || sector + (1 << shift)/**< 读取一个cache块不会超过磁盘总大小末尾 */
+      < disk->total_sectors)
     {
       grub_err_t err;
-      err = (disk->dev->read) (disk, transform_sector (disk, sector),
-			       1 << (GRUB_DISK_CACHE_BITS
-				     + GRUB_DISK_SECTOR_BITS
-				     - disk->log_sector_size), tmp_buf);
+      err = grub_disk_dev_read (disk, sector, nblocks << shift, tmp_buf);
       if (!err)
 	{
-	  /* Copy it and store it in the disk cache.  */
+	  unsigned i;
+
+	  /* Copy it and store it in the disk cache, along with the
+	     read-ahead blocks.  */
 	  grub_memcpy (buf, tmp_buf + offset, size);
-	  grub_disk_cache_store (disk->dev->id, disk->id,
-				 sector, tmp_buf);
+	  grub_disk_cache_store (disk, sector, tmp_buf, pin);
+	  for (i = 1; i < nblocks; i++)
+	    grub_disk_cache_store (disk,
+				   sector + ((grub_disk_addr_t) i << shift),
+				   tmp_buf + ((grub_size_t) i << block_bits),
+				   0);
 	  grub_free (tmp_buf);
 	  return GRUB_ERR_NONE;
 	}
@@ -697,14 +1154,9 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
   {
     /* Uggh... Failed. Instead, just read necessary data.  */
     unsigned num;
-    grub_disk_addr_t aligned_sector;
-
-    sector += (offset >> GRUB_DISK_SECTOR_BITS);/**< 归一化磁盘sector和offset */
-    offset &= ((1 << GRUB_DISK_SECTOR_BITS) - 1);
-    aligned_sector = (sector & ~((1 << (disk->log_sector_size
-					- GRUB_DISK_SECTOR_BITS))
-				 - 1));
-    offset += ((sector - aligned_sector) << GRUB_DISK_SECTOR_BITS);
+
+    sector += (offset >> disk->log_sector_size);/**< 归一化磁盘sector和offset */
+    offset &= ((1 << disk->log_sector_size) - 1);
     num = ((size + offset + (1 << (disk->log_sector_size))
 	    - 1) >> (disk->log_sector_size));
 
@@ -712,8 +1164,7 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
     if (!tmp_buf)
       return grub_errno;
 
-    if ((disk->dev->read) (disk, transform_sector (disk, aligned_sector),
-			   num, tmp_buf))
+    if (grub_disk_dev_read (disk, sector, num, tmp_buf))
       {
 	grub_error_push ();
 	grub_dprintf ("disk", "%s read failed\n", disk->name);
@@ -742,22 +1193,26 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
 *
 * 本函数实现读取磁盘扇区数据的功能。该函数大致步骤如下：
 *
-* 1）首先调用grub_disk_adjust_range()，归一化sector和offset。
+* 1）首先调用grub_disk_adjust_range()，归一化sector和offset，然后将其转换为实际扇区
+* 大小单位，此后都以实际扇区为单位进行处理，cache块的大小也由实际扇区大小决定。
 * 2）如果起始扇区sector和偏移offset没有cache块对其，那么将最先部分没有cahce块对其的部分
 * 使用grub_disk_read_small()读取出来；
 * 3）剩余的数据分为两部分，首先对于中间的整数cache块大小的，按照cache块大小读入，并存储
 * 到cache块中。
 * 4）在最后，如果还有不足cache块大小的数据，再次调用grub_disk_read_small()读取出来。
 * 5）调用read hook钩子函数。
+* 流式读取时，首尾两部分的grub_disk_read_small()不做预读。
 **/
-/* Read data from the disk.  */
-grub_err_t
-grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
-		grub_off_t offset, grub_size_t size, void *buf)
+static grub_err_t
+grub_disk_read_real (grub_disk_t disk, grub_disk_addr_t sector,
+		     grub_off_t offset, grub_size_t size, void *buf, int pin)
 {
   grub_off_t real_offset;
   grub_disk_addr_t real_sector;
   grub_size_t real_size;
+  grub_size_t block_size;
+  unsigned shift;
+  int streaming;
 
   /* First of all, check if the region is within the disk.  */
   if (grub_disk_adjust_range (disk, &sector, &offset, size) != GRUB_ERR_NONE)
@@ -773,33 +1228,69 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
   real_offset = offset;
   real_size = size;
 
+  if (grub_disk_trace_hook)
+    grub_disk_trace_hook (disk, GRUB_DISK_TRACE_REQUEST,
+			  (pin ? GRUB_DISK_TRACE_PIN : 0)
+			  | (disk->streaming ? GRUB_DISK_TRACE_STREAMING : 0),
+			  sector, offset, size);
+
+  /* From here on, work in device sectors and in cache blocks sized for
+     them.  */
+  offset += ((sector & ((1 << (disk->log_sector_size
+			       - GRUB_DISK_SECTOR_BITS)) - 1))
+	     << GRUB_DISK_SECTOR_BITS);
+  sector = transform_sector (disk, sector);
+  shift = grub_disk_cache_shift (disk);
+  block_size = (grub_size_t) 1 << grub_disk_cache_block_bits (disk);
+
+  /* Bulk data is read straight into the caller's buffer: caching it would
+     cost a copy per block and push metadata out of the cache.  Only the
+     partial blocks at both ends go through the cache.  */
+  streaming = (! pin && (disk->streaming
+			 || size >= GRUB_DISK_STREAM_THRESHOLD));
+
   /* First read until first cache boundary.   */
-  if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
+  if (offset || (sector & ((1 << shift) - 1)))
     {
       grub_disk_addr_t start_sector;
       grub_size_t pos;
       grub_err_t err;
       grub_size_t len;
 
-      start_sector = sector & ~(GRUB_DISK_CACHE_SIZE - 1);
-      pos = (sector - start_sector) << GRUB_DISK_SECTOR_BITS;
-      len = ((GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS)
-	     - pos - offset);
+      start_sector = sector & ~(grub_disk_addr_t) ((1 << shift) - 1);
+      pos = (sector - start_sector) << disk->log_sector_size;
+      len = block_size - pos - offset;
       if (len > size)
 	len = size;
       err = grub_disk_read_small (disk, start_sector,
-				  offset + pos, len, buf);
+				  offset + pos, len, buf, pin, streaming);
       if (err)
 	return err;
       buf = (char *) buf + len;
       size -= len;
       offset += len;
-      sector += (offset >> GRUB_DISK_SECTOR_BITS);
-      offset &= ((1 << GRUB_DISK_SECTOR_BITS) - 1);
+      sector += (offset >> disk->log_sector_size);
+      offset &= ((1 << disk->log_sector_size) - 1);
+    }
+
+  if (streaming && size >= block_size)
+    {
+      grub_size_t len;
+      grub_err_t err;
+
+      len = size & ~(block_size - 1);
+      err = grub_disk_dev_read (disk, sector, len >> disk->log_sector_size,
+				buf);
+      if (err)
+	return err;
+
+      sector += len >> disk->log_sector_size;
+      size -= len;
+      buf = (char *) buf + len;
     }
 
   /* Until SIZE is zero...  */
-  while (size >= (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS))
+  while (size >= block_size)
     {
       char *data = NULL;
       grub_disk_addr_t agglomerate;
@@ -807,90 +1298,275 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 
       /* agglomerate read until we find a first cached entry.  */
       for (agglomerate = 0; agglomerate
-	     < (size >> (GRUB_DISK_SECTOR_BITS + GRUB_DISK_CACHE_BITS));
+	     < (size >> grub_disk_cache_block_bits (disk));
 	   agglomerate++)
 	{
-	  data = grub_disk_cache_fetch (disk->dev->id, disk->id,
-					sector + (agglomerate
-						  << GRUB_DISK_CACHE_BITS));
+	  data = grub_disk_cache_fetch (disk, sector + (agglomerate << shift),
+					pin);
 	  if (data)
 	    break;
 	}
 
+      disk->state->stats.cache_misses += agglomerate;
       if (data)
 	{
-	  grub_memcpy ((char *) buf
-		       + (agglomerate << (GRUB_DISK_CACHE_BITS
-					  + GRUB_DISK_SECTOR_BITS)),
-		       data, GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS);
-	  grub_disk_cache_unlock (disk->dev->id, disk->id,
-				  sector + (agglomerate
-					    << GRUB_DISK_CACHE_BITS));
+	  disk->state->stats.cache_hits++;
+	  grub_memcpy ((char *) buf + agglomerate * block_size,
+		       data, block_size);
+	  grub_disk_cache_unlock (disk, sector + (agglomerate << shift));
 	}
 
       if (agglomerate)
 	{
 	  grub_disk_addr_t i;
 
-	  err = (disk->dev->read) (disk, transform_sector (disk, sector),
-				   agglomerate << (GRUB_DISK_CACHE_BITS
-						   + GRUB_DISK_SECTOR_BITS
-						   - disk->log_sector_size),
-				   buf);
+	  err = grub_disk_dev_read (disk, sector, agglomerate << shift, buf);
 	  if (err)
 	    return err;
 
 	  for (i = 0; i < agglomerate; i ++)
-	    grub_disk_cache_store (disk->dev->id, disk->id,
-				   sector + (i << GRUB_DISK_CACHE_BITS),
-				   (char *) buf
-				   + (i << (GRUB_DISK_CACHE_BITS
-					    + GRUB_DISK_SECTOR_BITS)));
-
-	  sector += agglomerate << GRUB_DISK_CACHE_BITS;
-	  size -= agglomerate << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
-	  buf = (char *) buf
-	    + (agglomerate << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
+	    grub_disk_cache_store (disk, sector + (i << shift),
+				   (char *) buf + i * block_size, pin);
+
+	  sector += agglomerate << shift;
+	  size -= agglomerate * block_size;
+	  buf = (char *) buf + agglomerate * block_size;
 	}
 
       if (data)
 	{
-	  sector += GRUB_DISK_CACHE_SIZE;
-	  buf = (char *) buf + (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS);
-	  size -= (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS);
+	  sector += 1 << shift;
+	  buf = (char *) buf + block_size;
+	  size -= block_size;
 	}
     }
 
+  /* Whatever was read in between counts as sequential access.  */
+  if (! pin && sector != transform_sector (disk, real_sector))
+    disk->ra_next = sector;
+
   /* And now read the last part.  */
   if (size)
     {
       grub_err_t err;
-      err = grub_disk_read_small (disk, sector, 0, size, buf);
+      err = grub_disk_read_small (disk, sector, 0, size, buf, pin,
+				  streaming);
       if (err)
 	return err;
     }
 
   /* Call the read hook, if any.  */
-  if (disk->read_hook)
+  grub_disk_call_read_hook (disk, real_sector, real_offset, real_size);
+
+  return grub_errno;
+}
+
+/* Read data from the disk.  */
+grub_err_t
+grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
+		grub_off_t offset, grub_size_t size, void *buf)
+{
+  return grub_disk_read_real (disk, sector, offset, size, buf, 0);
+}
+
+/* Read filesystem metadata from the disk.  The blocks read are pinned in
+   the cache, so that reading file contents doesn't evict them.  */
+grub_err_t
+grub_disk_read_pinned (grub_disk_t disk, grub_disk_addr_t sector,
+		       grub_off_t offset, grub_size_t size, void *buf)
+{
+  return grub_disk_read_real (disk, sector, offset, size, buf, 1);
+}
+
+static inline grub_uint64_t
+grub_disk_vec_pos (const struct grub_disk_vec *vec)
+{
+  return (vec->sector << GRUB_DISK_SECTOR_BITS) + vec->offset;
+}
+
+/* Hand the segments of ORDER which cover whole device sectors to the
+   read_vec method of the device in one call, and remove them from
+   ORDER.  */
+static grub_err_t
+grub_disk_read_vec_dev (grub_disk_t disk, struct grub_disk_vec **order,
+			unsigned *nvec)
+{
+  struct grub_disk_vec *dev_vec;
+  unsigned i, n = 0, ndev = 0;
+  grub_size_t mask = (1 << disk->log_sector_size) - 1;
+  grub_err_t err;
+
+  dev_vec = grub_malloc (*nvec * sizeof (dev_vec[0]));
+  if (! dev_vec)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_NONE;
+    }
+
+  for (i = 0; i < *nvec; i++)
     {
-      grub_disk_addr_t s = real_sector;
-      grub_size_t l = real_size;
-      grub_off_t o = real_offset;
+      grub_disk_addr_t sector = order[i]->sector;
+      grub_off_t offset = order[i]->offset;
 
-      while (l)
+      if (grub_disk_adjust_range (disk, &sector, &offset, order[i]->size))
 	{
-	  grub_size_t cl;
-	  cl = GRUB_DISK_SECTOR_SIZE - o;
-	  if (cl > l)
-	    cl = l;
-	  (disk->read_hook) (s, o, cl);
-	  s++;
-	  l -= cl;
-	  o = 0;
+	  grub_free (dev_vec);
+	  return grub_errno;
 	}
+
+      if (offset || ((sector << GRUB_DISK_SECTOR_BITS) & mask)
+	  || (order[i]->size & mask) || ! order[i]->size)
+	{
+	  order[n++] = order[i];
+	  continue;
+	}
+
+      dev_vec[ndev].sector = transform_sector (disk, sector);
+      dev_vec[ndev].offset = 0;
+      dev_vec[ndev].size = order[i]->size;
+      dev_vec[ndev].buf = order[i]->buf;
+      ndev++;
     }
 
-  return grub_errno;
+  if (ndev)
+    {
+      grub_uint64_t start;
+      grub_size_t size = 0;
+
+      for (i = 0; i < ndev; i++)
+	{
+	  size += dev_vec[i].size;
+	  if (grub_disk_trace_hook)
+	    grub_disk_trace_hook (disk, GRUB_DISK_TRACE_DEVICE, 0,
+				  dev_vec[i].sector
+				  << (disk->log_sector_size
+				      - GRUB_DISK_SECTOR_BITS), 0,
+				  dev_vec[i].size);
+	}
+
+      start = grub_get_time_ms ();
+      err = (disk->dev->read_vec) (disk, dev_vec, ndev);
+      grub_disk_stats_account (disk, size, grub_get_time_ms () - start);
+    }
+  else
+    err = GRUB_ERR_NONE;
+  grub_free (dev_vec);
+  *nvec = n;
+  return err;
+}
+
+/* Read the NVEC segments VEC from DISK.  Segments which are adjacent on
+   disk are read together, and the device gets to read everything at once
+   if it can.  The read hook sees the segments in the order given.  */
+grub_err_t
+grub_disk_read_vec (grub_disk_t disk, struct grub_disk_vec *vec,
+		    unsigned nvec)
+{
+  void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+				      unsigned offset, unsigned length);
+  struct grub_disk_vec **order;
+  unsigned i, j, nleft = nvec;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (! nvec)
+    return GRUB_ERR_NONE;
+
+  order = grub_malloc (nvec * sizeof (order[0]));
+  if (! order)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      for (i = 0; i < nvec && ! err; i++)
+	err = grub_disk_read (disk, vec[i].sector, vec[i].offset,
+			      vec[i].size, vec[i].buf);
+      return err;
+    }
+
+  /* Sort by position on disk.  Block maps of files come mostly sorted
+     already, which insertion sort handles in linear time.  */
+  for (i = 0; i < nvec; i++)
+    {
+      for (j = i; j > 0
+	     && grub_disk_vec_pos (order[j - 1]) > grub_disk_vec_pos (vec + i);
+	   j--)
+	order[j] = order[j - 1];
+      order[j] = vec + i;
+    }
+
+  read_hook = disk->read_hook;
+  disk->read_hook = 0;
+
+  if (disk->dev->read_vec)
+    err = grub_disk_read_vec_dev (disk, order, &nleft);
+
+  for (i = 0; i < nleft && ! err; i = j)
+    {
+      grub_uint64_t start, end;
+      int contiguous = 1;
+      char *bounce;
+
+      start = grub_disk_vec_pos (order[i]);
+      end = start + order[i]->size;
+      for (j = i + 1; j < nleft && grub_disk_vec_pos (order[j]) == end; j++)
+	{
+	  int adjacent = (order[j]->buf
+			  == (char *) order[j - 1]->buf + order[j - 1]->size);
+
+	  /* Once the run needs the bounce buffer, it may not outgrow it.  */
+	  if ((! adjacent || ! contiguous)
+	      && end + order[j]->size - start > GRUB_DISK_VEC_BOUNCE_MAX)
+	    break;
+	  if (! adjacent)
+	    contiguous = 0;
+	  end += order[j]->size;
+	}
+
+      if (contiguous)
+	{
+	  err = grub_disk_read (disk, order[i]->sector, order[i]->offset,
+				end - start, order[i]->buf);
+	  continue;
+	}
+
+      bounce = grub_malloc (end - start);
+      if (! bounce)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  j = i + 1;
+	  err = grub_disk_read (disk, order[i]->sector, order[i]->offset,
+				order[i]->size, order[i]->buf);
+	  continue;
+	}
+
+      err = grub_disk_read (disk, order[i]->sector, order[i]->offset,
+			    end - start, bounce);
+      if (! err)
+	{
+	  unsigned k;
+	  char *ptr = bounce;
+
+	  for (k = i; k < j; k++)
+	    {
+	      grub_memcpy (order[k]->buf, ptr, order[k]->size);
+	      ptr += order[k]->size;
+	    }
+	}
+      grub_free (bounce);
+    }
+
+  grub_free (order);
+  disk->read_hook = read_hook;
+
+  if (read_hook && ! err)
+    for (i = 0; i < nvec; i++)
+      {
+	grub_disk_addr_t sector = vec[i].sector;
+	grub_off_t offset = vec[i].offset;
+
+	grub_disk_adjust_range (disk, &sector, &offset, vec[i].size);
+	grub_disk_call_read_hook (disk, sector, offset, vec[i].size);
+      }
+
+  return err;
 }
 
 /**
@@ -915,10 +1591,12 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 * 3）将要写入的数据分成3个部分，按照下面的情况，使用一个循环完成实际的写入：
 * 3.1) 如果开始部分没有与实际扇区大小对应，那么real_offset！= 0，则先调用grub_disk_read()
 * 读入一个实际扇区大小的数据，然后将前面部分要写入的但是又没有与实际扇区大小对齐的部分
-* 合并，然后再将合并后的数据写入；同事无效这部分磁盘cache；
-* 3.2）中间部分，按照整个扇区大小的整数倍，全部写入；对应的磁盘cache也被无效；
+* 合并，然后再将合并后的数据写入；由于实际扇区可能很大，该临时缓冲区从堆中分配；
+* 3.2）中间部分，按照整个扇区大小的整数倍，全部写入；
+* 传给设备write接口的扇区编号都经过transform_sector()转换为实际扇区大小单位。
 * 3.3) 剩余的部分，如果还有不足实际扇区大小的数据，也按照3.1）的办法，先读入，再合并，
-* 再无效cache，然后再将合并后的数据写入磁盘。
+* 然后再将合并后的数据写入磁盘。
+* 4）最后调用grub_disk_bump_generation()更新该设备的代数，使其所有缓存数据失效。
 **/
 grub_err_t
 grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
@@ -926,6 +1604,7 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 {
   unsigned real_offset;
   grub_disk_addr_t aligned_sector;
+  char *tmp_buf = 0;
 
   grub_dprintf ("disk", "Writing `%s'...\n", disk->name);
 
@@ -942,10 +1621,15 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
       if (real_offset != 0 || (size < (1U << disk->log_sector_size)
 			       && size != 0))
 	{
-	  char tmp_buf[1 << disk->log_sector_size];
 	  grub_size_t len;
 	  grub_partition_t part;
 
+	  /* Sectors may be too big for the stack.  */
+	  if (! tmp_buf)
+	    tmp_buf = grub_malloc (1 << disk->log_sector_size);
+	  if (! tmp_buf)
+	    goto finish;
+
 	  part = disk->partition;
 	  disk->partition = 0;
 	  if (grub_disk_read (disk, sector,
@@ -963,9 +1647,8 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 
 	  grub_memcpy (tmp_buf + real_offset, buf, len);
 
-	  grub_disk_cache_invalidate (disk->dev->id, disk->id, sector);
-
-	  if ((disk->dev->write) (disk, sector, 1, tmp_buf) != GRUB_ERR_NONE)
+	  if ((disk->dev->write) (disk, transform_sector (disk, sector),
+				  1, tmp_buf) != GRUB_ERR_NONE)
 	    goto finish;
 
 	  sector += (1 << (disk->log_sector_size - GRUB_DISK_SECTOR_BITS));
@@ -981,12 +1664,11 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 	  len = size & ~((1 << disk->log_sector_size) - 1);
 	  n = size >> disk->log_sector_size;
 
-	  if ((disk->dev->write) (disk, sector, n, buf) != GRUB_ERR_NONE)
+	  if ((disk->dev->write) (disk, transform_sector (disk, sector),
+				  n, buf) != GRUB_ERR_NONE)
 	    goto finish;
 
-	  while (n--)
-	    grub_disk_cache_invalidate (disk->dev->id, disk->id, sector++);
-
+	  sector += len >> GRUB_DISK_SECTOR_BITS;
 	  buf = (const char *) buf + len;
 	  size -= len;
 	}
@@ -994,6 +1676,11 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 
  finish:
 
+  grub_free (tmp_buf);
+
+  /* Whatever made it to the disk, the cached data may be stale now.  */
+  grub_disk_bump_generation (disk);
+
   return grub_errno;
 }
 /**
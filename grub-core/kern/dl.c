@@ -32,6 +32,7 @@
 #include <grub/env.h>
 #include <grub/cache.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 /* Platforms where modules are in a readonly area of memory.  */
 #if defined(GRUB_MACHINE_QEMU)
@@ -138,19 +139,24 @@ grub_dl_get (const char *name)
 
 struct grub_symbol
 {
+  /* The older symbols of the same name, which this one hides.  */
   struct grub_symbol *next;
   const char *name;
+  grub_uint32_t hash;
   void *addr;
   int isfunc;
   grub_dl_t mod;	/* The module to which this symbol belongs.  */
 };
 typedef struct grub_symbol *grub_symbol_t;
 
-/* The size of the symbol table.  */
-#define GRUB_SYMTAB_SIZE	509
+/* The initial size of the symbol table, a power of two.  */
+#define GRUB_SYMTAB_MIN_SIZE	1024
 
-/* The symbol table (using an open-hash).  */
-static struct grub_symbol *grub_symtab[GRUB_SYMTAB_SIZE];
+/* The symbol table, using open addressing with linear probing.  Each name
+   has one slot, holding the symbol registered last under it.  The table
+   is kept at most half full.  */
+static grub_symbol_t *grub_symtab;
+static grub_size_t grub_symtab_size, grub_symtab_count;
 
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
@@ -166,18 +172,85 @@ static struct grub_symbol *grub_symtab[GRUB_SYMTAB_SIZE];
 *
 * @note 注释详细内容:
 *
-* 本函数实现计算字符串的hash键值的功能。
+* 本函数实现计算字符串的hash键值的功能，使用32位的FNV-1a算法。返回的完整hash值保存在符号
+* 结构中，按符号表大小取模得到其在符号表中的起始位置。
 **/
-/* Simple hash function.  */
-static unsigned
+/* FNV-1a hash function.  */
+static grub_uint32_t
 grub_symbol_hash (const char *s)
 {
-  unsigned key = 0;
+  grub_uint32_t key = 2166136261U;
 
   while (*s)
-    key = key * 65599 + *s++;
+    {
+      key ^= (grub_uint8_t) *s++;
+      key *= 16777619;
+    }
+
+  return key;
+}
+
+/* Return the slot of the symbol table which holds the name NAME with the
+   hash HASH, or the empty slot where it would go.  */
+static grub_symbol_t *
+grub_symtab_find (const char *name, grub_uint32_t hash)
+{
+  grub_size_t mask = grub_symtab_size - 1;
+  grub_size_t i;
+
+  for (i = hash & mask; grub_symtab[i]; i = (i + 1) & mask)
+    if (grub_symtab[i]->hash == hash
+	&& grub_strcmp (grub_symtab[i]->name, name) == 0)
+      break;
+
+  return &grub_symtab[i];
+}
+
+/* Make the symbol table SIZE slots big.  */
+static grub_err_t
+grub_symtab_resize (grub_size_t size)
+{
+  grub_symbol_t *old = grub_symtab;
+  grub_size_t old_size = grub_symtab_size;
+  grub_size_t i;
+
+  grub_symtab = grub_zalloc (size * sizeof (grub_symtab[0]));
+  if (! grub_symtab)
+    {
+      grub_symtab = old;
+      return grub_errno;
+    }
+  grub_symtab_size = size;
+
+  for (i = 0; i < old_size; i++)
+    if (old[i])
+      *grub_symtab_find (old[i]->name, old[i]->hash) = old[i];
 
-  return (key + (key >> 5)) % GRUB_SYMTAB_SIZE;
+  grub_free (old);
+  return GRUB_ERR_NONE;
+}
+
+/* Empty the slot I of the symbol table, moving the following names of its
+   cluster back so that they can still be found.  */
+static void
+grub_symtab_delete (grub_size_t i)
+{
+  grub_size_t mask = grub_symtab_size - 1;
+  grub_size_t j, k;
+
+  for (j = (i + 1) & mask; grub_symtab[j]; j = (j + 1) & mask)
+    {
+      /* The slot where the name at J would go first.  It can fill the hole
+	 unless it lies cyclically in (I, J].  */
+      k = grub_symtab[j]->hash & mask;
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	continue;
+      grub_symtab[i] = grub_symtab[j];
+      i = j;
+    }
+
+  grub_symtab[i] = 0;
+  grub_symtab_count--;
 }
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
@@ -193,21 +266,19 @@ grub_symbol_hash (const char *s)
 *
 * @note 注释详细内容:
 *
-* 本函数实现按符号的名字查找符号的功能。通过grub_symbol_hash()先找到这个名字的符号在符
-* 号表grub_symtab中的索引，然后按名字比较，在该索引的符号链表中查找对应的符号结构并返回。
+* 本函数实现按符号的名字查找符号的功能。通过grub_symbol_hash()计算名字的hash值，再由
+* grub_symtab_find()从符号表grub_symtab中该hash值对应的位置开始线性探测，先比较缓存的hash
+* 值再比较名字，找到对应的符号结构并返回。
 **/
 /* Resolve the symbol name NAME and return the address.
    Return NULL, if not found.  */
 static grub_symbol_t
 grub_dl_resolve_symbol (const char *name)
 {
-  grub_symbol_t sym;
-
-  for (sym = grub_symtab[grub_symbol_hash (name)]; sym; sym = sym->next)
-    if (grub_strcmp (sym->name, name) == 0)
-      return sym;
+  if (! grub_symtab)
+    return 0;
 
-  return 0;
+  return *grub_symtab_find (name, grub_symbol_hash (name));
 }
 
 /**
@@ -224,8 +295,10 @@ grub_dl_resolve_symbol (const char *name)
 *
 * @note 注释详细内容:
 *
-* 本函数实现按符号的名字注册符号的功能。通过grub_symbol_hash()先找到这个名字的符号在符
-* 号表grub_symtab中的索引，然后将对应的符号结构插入到对应的符号链表的首项。
+* 本函数实现按符号的名字注册符号的功能。通过grub_symbol_hash()计算名字的hash值，再由
+* grub_symtab_find()在符号表grub_symtab中找到这个名字的位置。如果已有同名符号，新符号排在
+* 该位置的同名符号链表的首项；否则占用该空位置。符号表超过一半满时由grub_symtab_resize()
+* 扩大一倍。
 *
 * 这个函数完成了下列步骤：
 * 
@@ -233,16 +306,28 @@ grub_dl_resolve_symbol (const char *name)
 * 2）	如果导出该符号的是一个模块，那么需要复制一份该符号的名字，因为这个模块不是与核心一
 *     直同在的（可能被释放掉）；否则就直接将sym->name指向符号的名字，因为符号与核心一直同在；
 * 3）	保存符号的地址，所在模块的指针，以及该符号是否是函数等基本信息；
-* 4）	调用grub_symbol_hash()通过对符号名字进行hash处理，得到一个hash数组grub_symtab[]的索引，
-*     将该符号映射到grub_symtab[]数组的对应项中（并排在对应索引的第一个）。
+* 4）	调用grub_symbol_hash()通过对符号名字进行hash处理，并将hash值保存在符号结构中；
+* 5）	必要时扩大符号表，再将该符号放入grub_symtab[]数组中该名字的位置（并排在同名符号的
+*     第一个）。
 **/
 /* Register a symbol with the name NAME and the address ADDR.  */
 grub_err_t
 grub_dl_register_symbol (const char *name, void *addr, int isfunc,
 			 grub_dl_t mod)
 {
-  grub_symbol_t sym;
-  unsigned k;
+  grub_symbol_t sym, *slot;
+
+  if ((grub_symtab_count + 1) * 2 > grub_symtab_size)
+    {
+      grub_size_t size = grub_symtab_size ? grub_symtab_size * 2
+	: GRUB_SYMTAB_MIN_SIZE;
+
+      /* Carry on with the current table while it has room.  */
+      if (grub_symtab_resize (size)
+	  && grub_symtab_count + 1 >= grub_symtab_size)
+	return grub_errno;
+      grub_errno = GRUB_ERR_NONE;
+    }
 
   sym = (grub_symbol_t) grub_malloc (sizeof (*sym));
   if (! sym)
@@ -263,10 +348,13 @@ grub_dl_register_symbol (const char *name, void *addr, int isfunc,
   sym->addr = addr;
   sym->mod = mod;
   sym->isfunc = isfunc;
+  sym->hash = grub_symbol_hash (name);
 
-  k = grub_symbol_hash (name);
-  sym->next = grub_symtab[k];
-  grub_symtab[k] = sym;
+  slot = grub_symtab_find (name, sym->hash);
+  if (! *slot)
+    grub_symtab_count++;
+  sym->next = *slot;
+  *slot = sym;
 
   return GRUB_ERR_NONE;
 }
@@ -285,23 +373,36 @@ grub_dl_register_symbol (const char *name, void *addr, int isfunc,
 *
 * @note 注释详细内容:
 *
-* 本函数实现取消注册一个模块的所有符号的功能。扫描grub_symtab的每一个索引，每一个上面对
-* 应的符号链表都比较，如果该符号对应的模块是参数mod，那么就将该符号从链表删除并释放该符
-* 号对应的符号资源。
+* 本函数实现取消注册一个模块的所有符号的功能。从一个空位置开始扫描grub_symtab的每一个位
+* 置，每一个上面对应的同名符号链表都比较，如果该符号对应的模块是参数mod，那么就将该符号从
+* 链表删除并释放该符号对应的符号资源。链表为空时调用grub_symtab_delete()清空该位置，并把
+* 后面的符号前移，此时需重新检查该位置。
 **/
 /* Unregister all the symbols defined in the module MOD.  */
 static void
 grub_dl_unregister_symbols (grub_dl_t mod)
 {
-  unsigned i;
+  grub_size_t mask = grub_symtab_size - 1;
+  grub_size_t start, n, i;
 
   if (! mod)
     grub_fatal ("core symbols cannot be unregistered");
 
-  for (i = 0; i < GRUB_SYMTAB_SIZE; i++)
+  /* Start after an empty slot, so that deleting never moves a name to a
+     slot already scanned.  */
+  for (start = 0; grub_symtab[start]; start++);
+
+  for (n = 0, i = (start + 1) & mask; n < grub_symtab_size; )
     {
       grub_symbol_t sym, *p, q;
 
+      if (! grub_symtab[i])
+	{
+	  n++;
+	  i = (i + 1) & mask;
+	  continue;
+	}
+
       for (p = &grub_symtab[i], sym = *p; sym; sym = q)
 	{
 	  q = sym->next;
@@ -314,6 +415,16 @@ grub_dl_unregister_symbols (grub_dl_t mod)
 	  else
 	    p = &sym->next;
 	}
+
+      /* Deleting the name moves the next one of its cluster here, which
+	 must be looked at too.  */
+      if (! grub_symtab[i])
+	grub_symtab_delete (i);
+      else
+	{
+	  n++;
+	  i = (i + 1) & mask;
+	}
     }
 }
 /**
@@ -430,7 +541,7 @@ grub_dl_load_segments (grub_dl_t mod, const Elf_Ehdr *e)
 
   for (i = 0, s = (Elf_Shdr *)((char *) e + e->e_shoff);
        i < e->e_shnum;
-       i++, s = (Elf_Shdr *)((char *) s + e->e_shentsize))mod->segment
+       i++, s = (Elf_Shdr *)((char *) s + e->e_shentsize))
     {
       tsize = ALIGN_UP (tsize, s->sh_addralign) + s->sh_size;/**< section的最大大小 */
       if (talign < s->sh_addralign)
@@ -1101,6 +1212,8 @@ grub_dl_load_file (const char *filename)
 * *.mod模块，并通过grub_dl_load_file()，进而调用grub_dl_load_core()将模块加载进入
 * grub_dl_head为首的模块链表中。为了验证加载进入的模块文件与指定的模块一致，最后还通过
 * 比较加载进入的模块的名字与参数给定的名字是否一致来确认。
+*
+* 实际从文件加载模块的过程作为一个"insmod"区间记录在启动跟踪（boottrace）中。
 **/
 /* Load a module using a symbolic name.  */
 grub_dl_t
@@ -1109,6 +1222,7 @@ grub_dl_load (const char *name)
   char *filename;
   grub_dl_t mod;
   const char *grub_dl_dir = grub_env_get ("prefix");
+  int span;
 
   mod = grub_dl_get (name);
   if (mod)
@@ -1124,7 +1238,9 @@ grub_dl_load (const char *name)
   if (! filename)
     return 0;
 
+  span = grub_boottrace_begin ("insmod", "%s", name);
   mod = grub_dl_load_file (filename);
+  grub_boottrace_end (span);
   grub_free (filename);
 
   if (! mod)
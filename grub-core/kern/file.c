@@ -185,11 +185,14 @@ grub_file_open (const char *name)
 * 本函数实现读取文件内容到缓冲区的功能。首先进行一系列的参数检查，例如偏移量不能超过文件
 * 大小，读取大小不能为0，也不能超过文件剩余的大小等等，然后调用文件系统驱动的read()接口
 * 函数来实际读取文件内容。
+* 对于流式读取的文件，在调用read()期间设置磁盘的streaming标志，之后恢复原值。
 **/
 grub_ssize_t
 grub_file_read (grub_file_t file, void *buf, grub_size_t len)
 {
   grub_ssize_t res;
+  grub_disk_t disk = 0;
+  int streaming = 0;
 
   if (file->offset > file->size)
     {
@@ -210,7 +213,20 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
 
   if (len == 0)
     return 0;
+
+  /* Streaming is a property of the disk handle, which the whole device
+     shares, so only set it for the time of this read.  */
+  if (file->streaming && file->device && file->device->disk)
+    {
+      disk = file->device->disk;
+      streaming = disk->streaming;
+      disk->streaming = 1;
+    }
+
   res = (file->fs->read) (file, buf, len);
+
+  if (disk)
+    disk->streaming = streaming;
   if (res > 0)
     file->offset += res;
 
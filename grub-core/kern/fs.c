@@ -18,6 +18,7 @@
  */
 
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/net.h>
 #include <grub/fs.h>
 #include <grub/file.h>
@@ -27,10 +28,207 @@
 #include <grub/mm.h>
 #include <grub/term.h>
 #include <grub/i18n.h>
+#include <grub/boottrace.h>
 
 grub_fs_t grub_fs_list = 0;
 
 grub_fs_autoload_hook_t grub_fs_autoload_hook = 0;
+
+/* The number of idle instances kept in the mount cache.  */
+#define GRUB_FS_MOUNT_CACHE_SIZE	8
+
+/* A mounted filesystem instance.  An instance carries the state of the
+   file it was last used for, so it is lent to one user at a time: the
+   reference count is 1 while it is in use and 0 while it is idle.  */
+struct grub_fs_mount
+{
+  struct grub_fs_mount *next;
+  grub_fs_t fs;
+  /* The generation of the device, which identifies it as well, and the
+     start of the partition when the instance was mounted.  */
+  unsigned long generation;
+  grub_disk_addr_t start;
+  void *data;
+  int refcnt;
+};
+
+/* Most recently used first.  */
+static struct grub_fs_mount *grub_fs_mount_list;
+
+static void
+grub_fs_mount_free (struct grub_fs_mount *mount)
+{
+  if (mount->fs->free_mount)
+    mount->fs->free_mount (mount->data);
+  else
+    grub_free (mount->data);
+  grub_free (mount);
+}
+
+/* Take an idle instance of FS mounted on DISK out of the mount cache and
+   return it, or return null if there is none.  */
+void *
+grub_fs_mount_cache_get (grub_fs_t fs, grub_disk_t disk)
+{
+  struct grub_fs_mount *mount, **prev;
+  unsigned long generation = grub_disk_get_generation (disk);
+  grub_disk_addr_t start = grub_partition_get_start (disk->partition);
+
+  for (prev = &grub_fs_mount_list; (mount = *prev); prev = &mount->next)
+    if (mount->fs == fs && mount->refcnt == 0
+	&& mount->generation == generation && mount->start == start)
+      {
+	grub_dprintf ("fs", "reusing mounted %s\n", fs->name);
+	mount->refcnt++;
+	*prev = mount->next;
+	mount->next = grub_fs_mount_list;
+	grub_fs_mount_list = mount;
+	return mount->data;
+      }
+
+  return 0;
+}
+
+/* Register DATA, an instance of FS just mounted on DISK, as in use.  If
+   that fails, DATA is freed when it's put back.  */
+void
+grub_fs_mount_cache_add (grub_fs_t fs, grub_disk_t disk, void *data)
+{
+  struct grub_fs_mount *mount;
+
+  mount = grub_malloc (sizeof (*mount));
+  if (! mount)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  mount->fs = fs;
+  mount->generation = grub_disk_get_generation (disk);
+  mount->start = grub_partition_get_start (disk->partition);
+  mount->data = data;
+  mount->refcnt = 1;
+  mount->next = grub_fs_mount_list;
+  grub_fs_mount_list = mount;
+}
+
+/* Give DATA, an instance of FS, back to the mount cache, evicting the
+   least recently used idle instances beyond GRUB_FS_MOUNT_CACHE_SIZE.  */
+void
+grub_fs_mount_cache_put (grub_fs_t fs, void *data)
+{
+  struct grub_fs_mount *mount, **prev;
+  int idle = 0;
+
+  if (! data)
+    return;
+
+  for (mount = grub_fs_mount_list; mount; mount = mount->next)
+    if (mount->data == data)
+      break;
+
+  if (! mount)
+    {
+      if (fs->free_mount)
+	fs->free_mount (data);
+      else
+	grub_free (data);
+      return;
+    }
+
+  mount->refcnt--;
+
+  prev = &grub_fs_mount_list;
+  while ((mount = *prev))
+    {
+      if (mount->refcnt == 0 && ++idle > GRUB_FS_MOUNT_CACHE_SIZE)
+	{
+	  *prev = mount->next;
+	  grub_fs_mount_free (mount);
+	}
+      else
+	prev = &mount->next;
+    }
+}
+
+/* Free the idle instances of FS, or of all filesystems if FS is null.
+   Instances in use are left alone.  */
+void
+grub_fs_mount_cache_flush (grub_fs_t fs)
+{
+  struct grub_fs_mount *mount, **prev;
+
+  prev = &grub_fs_mount_list;
+  while ((mount = *prev))
+    {
+      if (mount->refcnt == 0 && (! fs || mount->fs == fs))
+	{
+	  *prev = mount->next;
+	  grub_fs_mount_free (mount);
+	}
+      else
+	prev = &mount->next;
+    }
+}
+
+/* Return non-zero if one of SIGNATURES matches AREA, or if that can't be
+   ruled out: there are no signatures, AREA couldn't be read or doesn't
+   reach as far as a signature.  */
+int
+grub_fs_match_signatures (const struct grub_fs_signature *signatures,
+			  const struct grub_fs_probe_area *area)
+{
+  const struct grub_fs_signature *sig;
+
+  if (! signatures || ! area)
+    return 1;
+
+  for (sig = signatures; sig->magic; sig++)
+    {
+      if (sig->offset + sig->size > area->size)
+	{
+	  if (sig->offset + sig->size <= area->total)
+	    return 1;
+	  continue;
+	}
+
+      if (grub_memcmp (area->buf + sig->offset, sig->magic, sig->size) == 0)
+	return 1;
+    }
+
+  return 0;
+}
+
+/* Read the start of DISK into AREA, with a single read which the
+   filesystem drivers will then mostly find in the disk cache.  Return
+   zero if that fails.  */
+static int
+grub_fs_read_probe_area (grub_disk_t disk, struct grub_fs_probe_area *area)
+{
+  grub_uint64_t sectors;
+  char *buf;
+
+  sectors = grub_disk_get_size (disk);
+  area->total = ~(grub_uint64_t) 0;
+  area->size = GRUB_FS_PROBE_SIZE;
+  if (sectors != GRUB_DISK_SIZE_UNKNOWN)
+    {
+      area->total = sectors << GRUB_DISK_SECTOR_BITS;
+      if (area->size > area->total)
+	area->size = area->total;
+    }
+
+  buf = grub_malloc (area->size);
+  if (! buf || grub_disk_read (disk, 0, 0, area->size, buf))
+    {
+      grub_free (buf);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  area->buf = buf;
+  return 1;
+}
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -49,9 +247,12 @@ grub_fs_autoload_hook_t grub_fs_autoload_hook = 0;
 *
 * 1） 如果是网络设备，则直接返回device->net->fs；
 * 2） 然而如果该设备是磁盘设备(device->disk非空)，则该函数首先扫描目前已经载入了的文件系
-* 统列表grub_fs_list，使用每个可支持的文件系统的p->dir()函数来测试是否可以加载该设备，如
-* 果可以（grub_errno返回GRUB_ERR_NONE），则返回该grub_fs_list文件系统项；接着如果目前支持
-* grub_fs_autoload_hook（非空），那么就循环调用grub_fs_autoload_hook()，直到该函数返回0。
+* 统列表grub_fs_list。为避免逐个试探挂载，先一次读取设备开头GRUB_FS_PROBE_SIZE字节的数据
+* （读取的数据也会留在disk cache中），对于声明了特征签名（signatures，即某偏移处的魔数）的
+* 文件系统，只有签名与之匹配时才尝试；然后使用可能的文件系统的p->dir()函数来测试是否可以加
+* 载该设备，如果可以（grub_errno返回GRUB_ERR_NONE），则返回该grub_fs_list文件系统项；接着如
+* 果目前支持grub_fs_autoload_hook（非空），那么就以读到的数据为参数循环调用
+* grub_fs_autoload_hook()，直到该函数返回0；该函数根据fs.lst中记录的签名只载入可能匹配的模块。
 * 在调用grub_fs_autoload_hook()的过程中（实际上调用的是grub-2.00/grub-core/normal/autofs.c
 * 中的autoload_fs_module()函数），会根据fs_module_list来加载文件系统支持模块，每次加入一个
 * 文件系统的支持，该支持模块就使用grub_fs_register()加入一个grub_fs_t项到grub_fs_list的首部；
@@ -60,6 +261,8 @@ grub_fs_autoload_hook_t grub_fs_autoload_hook = 0;
 * 是否可以加载该设备。也就是说，该函数在探测磁盘文件系统的时候，不但使用了已经载入到系统
 * 中的文件系统，还在已经载入的文件系统都没探测成功的时候尝试用尚未载入的文件系统支持模块
 * 来看是否可以支持，也就是说支持了文件系统的自动加载机制。
+*
+* 对磁盘设备的整个探测过程作为一个"probe"区间记录在启动跟踪（boottrace）中。
 **/
 grub_fs_t
 grub_fs_probe (grub_device_t device)
@@ -78,9 +281,19 @@ grub_fs_probe (grub_device_t device)
     {
       /* Make it sure not to have an infinite recursive calls.  */
       static int count = 0;
+      struct grub_fs_probe_area area, *parea = 0;
+      int span;
+
+      span = grub_boottrace_begin ("probe", "%s", device->disk->name);
+      if (grub_fs_read_probe_area (device->disk, &area))
+	parea = &area;
 
       for (p = grub_fs_list; p; p = p->next)
 	{
+	  /* Don't bother mounting what can't be there.  */
+	  if (! grub_fs_match_signatures (p->signatures, parea))
+	    continue;
+
 	  grub_dprintf ("fs", "Detecting %s...\n", p->name);
 
 	  /* This is evil: newly-created just mounted BtrFS after copying all
@@ -100,7 +313,7 @@ grub_fs_probe (grub_device_t device)
 #endif
 	    (p->dir) (device, "/", dummy_func);
 	  if (grub_errno == GRUB_ERR_NONE)
-	    return p;
+	    goto found;
 
 	  grub_error_push ();
 	  grub_dprintf ("fs", "%s detection failed.\n", p->name);
@@ -108,7 +321,7 @@ grub_fs_probe (grub_device_t device)
 
 	  if (grub_errno != GRUB_ERR_BAD_FS
 	      && grub_errno != GRUB_ERR_OUT_OF_RANGE)
-	    return 0;
+	    goto fail;
 
 	  grub_errno = GRUB_ERR_NONE;
 	}
@@ -118,7 +331,7 @@ grub_fs_probe (grub_device_t device)
 	{
 	  count++;
 
-	  while (grub_fs_autoload_hook ())
+	  while (grub_fs_autoload_hook (parea))
 	    {
 	      p = grub_fs_list;
 
@@ -126,14 +339,14 @@ grub_fs_probe (grub_device_t device)
 	      if (grub_errno == GRUB_ERR_NONE)
 		{
 		  count--;
-		  return p;
+		  goto found;
 		}
 
 	      if (grub_errno != GRUB_ERR_BAD_FS
 		  && grub_errno != GRUB_ERR_OUT_OF_RANGE)
 		{
 		  count--;
-		  return 0;
+		  goto fail;
 		}
 
 	      grub_errno = GRUB_ERR_NONE;
@@ -141,6 +354,24 @@ grub_fs_probe (grub_device_t device)
 
 	  count--;
 	}
+
+      if (parea)
+	grub_free ((char *) parea->buf);
+      grub_boottrace_end (span);
+      grub_error (GRUB_ERR_UNKNOWN_FS, N_("unknown filesystem"));
+      return 0;
+
+    found:
+      if (parea)
+	grub_free ((char *) parea->buf);
+      grub_boottrace_end (span);
+      return p;
+
+    fail:
+      if (parea)
+	grub_free ((char *) parea->buf);
+      grub_boottrace_end (span);
+      return 0;
     }
   else if (device->net && device->net->fs)
     return device->net->fs;
@@ -80,6 +80,17 @@ grub_gettext_dummy (const char *s)
 
 const char* (*grub_gettext) (const char *s) = grub_gettext_dummy;
 
+/* Word-at-a-time helpers.  Words are only accessed at aligned addresses,
+   as some CPUs trap on unaligned ones.  They may alias objects of any
+   type, so accesses through them aren't reordered with the caller's.  */
+typedef unsigned long __attribute__ ((may_alias)) grub_word_t;
+#define WORD_SIZE	sizeof (grub_word_t)
+#define WORD_MASK	(WORD_SIZE - 1)
+#define WORD_ONES	((unsigned long) -1 / 0xff)
+#define WORD_HIGHS	(WORD_ONES << 7)
+/* Non-zero if the word X has a zero byte.  */
+#define WORD_HAS_ZERO(x)	(((x) - WORD_ONES) & ~(x) & WORD_HIGHS)
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -105,22 +116,87 @@ const char* (*grub_gettext) (const char *s) = grub_gettext_dummy;
 * 对于库函数来说，由于没有办法知道传递给他的内存区域的情况，所以应该使用memmove()
 * 函数。通过这个函数，可以保证不会出现任何内存块重叠问题。而对于应用程序来说，
 * 因为代码“知道”两个内存块不会重叠，所以可以安全地使用memcpy()函数。
+*
+* 本实现在长度足够时按字（unsigned long）拷贝：先逐字节拷贝到目标地址按字对齐，在x86上
+* 再用rep movs指令整字拷贝，其他架构则在源和目标对齐方式相同时逐字拷贝，剩余部分逐字节
+* 拷贝。向后拷贝（区域重叠且dest在src之后）时同样按字进行。
 **/
 
 void *
 grub_memmove (void *dest, const void *src, grub_size_t n)
 {
-  char *d = (char *) dest;
-  const char *s = (const char *) src;
+  grub_uint8_t *d = (grub_uint8_t *) dest;
+  const grub_uint8_t *s = (const grub_uint8_t *) src;
+
+  if (d < s || d >= s + n)
+    {
+#if defined (__i386__) || defined (__x86_64__)
+      /* The string instructions are the fastest way to copy on x86
+	 without using the vector registers, which GRUB doesn't set up.  */
+      if (n >= 3 * WORD_SIZE)
+	{
+	  grub_size_t words;
 
-  if (d < s)
-    while (n--)
-      *d++ = *s++;
+	  while ((grub_addr_t) d & WORD_MASK)
+	    {
+	      *d++ = *s++;
+	      n--;
+	    }
+	  words = n / WORD_SIZE;
+	  n &= WORD_MASK;
+#ifdef __x86_64__
+	  asm volatile ("rep movsq" : "+D" (d), "+S" (s), "+c" (words)
+			: : "memory");
+#else
+	  asm volatile ("rep movsl" : "+D" (d), "+S" (s), "+c" (words)
+			: : "memory");
+#endif
+	}
+#else
+      if (n >= 3 * WORD_SIZE
+	  && ((grub_addr_t) d & WORD_MASK) == ((grub_addr_t) s & WORD_MASK))
+	{
+	  while ((grub_addr_t) d & WORD_MASK)
+	    {
+	      *d++ = *s++;
+	      n--;
+	    }
+	  while (n >= WORD_SIZE)
+	    {
+	      *(grub_word_t *) (void *) d
+		= *(const grub_word_t *) (const void *) s;
+	      d += WORD_SIZE;
+	      s += WORD_SIZE;
+	      n -= WORD_SIZE;
+	    }
+	}
+#endif
+      while (n--)
+	*d++ = *s++;
+    }
   else
     {
       d += n;
       s += n;
 
+      if (n >= 3 * WORD_SIZE
+	  && ((grub_addr_t) d & WORD_MASK) == ((grub_addr_t) s & WORD_MASK))
+	{
+	  while ((grub_addr_t) d & WORD_MASK)
+	    {
+	      *--d = *--s;
+	      n--;
+	    }
+	  while (n >= WORD_SIZE)
+	    {
+	      d -= WORD_SIZE;
+	      s -= WORD_SIZE;
+	      n -= WORD_SIZE;
+	      *(grub_word_t *) (void *) d
+		= *(const grub_word_t *) (const void *) s;
+	    }
+	}
+
       while (n--)
 	*--d = *--s;
     }
@@ -351,6 +427,28 @@ grub_memcmp (const void *s1, const void *s2, grub_size_t n)
   const grub_uint8_t *t1 = s1;
   const grub_uint8_t *t2 = s2;
 
+  /* Skip the equal words; the bytes of the first different one are
+     compared below.  */
+  if (n >= 3 * WORD_SIZE
+      && ((grub_addr_t) t1 & WORD_MASK) == ((grub_addr_t) t2 & WORD_MASK))
+    {
+      while (((grub_addr_t) t1 & WORD_MASK) && *t1 == *t2)
+	{
+	  t1++;
+	  t2++;
+	  n--;
+	}
+      if (! ((grub_addr_t) t1 & WORD_MASK))
+	while (n >= WORD_SIZE
+	       && *(const grub_word_t *) (const void *) t1
+	       == *(const grub_word_t *) (const void *) t2)
+	  {
+	    t1 += WORD_SIZE;
+	    t2 += WORD_SIZE;
+	    n -= WORD_SIZE;
+	  }
+    }
+
   while (n--)
     {
       if (*t1 != *t2)
@@ -745,8 +843,8 @@ grub_memset (void *s, int c, grub_size_t len)
 	}
       while (len >= sizeof (unsigned long))
 	{
-	  *(unsigned long *) p = patternl;
-	  p = (unsigned long *) p + 1;
+	  *(grub_word_t *) p = patternl;
+	  p = (grub_word_t *) p + 1;
 	  len -= sizeof (unsigned long);
 	}
     }
@@ -776,6 +874,18 @@ grub_strlen (const char *s)
 {
   const char *p = s;
 
+  /* An aligned word never crosses a page boundary, so it can be read
+     past the terminator.  */
+  while ((grub_addr_t) p & WORD_MASK)
+    {
+      if (! *p)
+	return p - s;
+      p++;
+    }
+
+  while (! WORD_HAS_ZERO (*(const grub_word_t *) (const void *) p))
+    p += WORD_SIZE;
+
   while (*p)
     p++;
 
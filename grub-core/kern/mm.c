@@ -42,8 +42,9 @@
 
   There are two types of blocks: allocated blocks and free blocks.
 
-  In allocated blocks, the header of each block has only its size. Note that
-  this size is based on cells but not on bytes. The header is located right
+  In allocated blocks, the header of each block has its size and the heap
+  profile entry the block is charged to. Note that this size is based on
+  cells but not on bytes. The header is located right
   before the returned pointer, that is, the header resides at the previous
   cell.
 
@@ -53,6 +54,19 @@
   a typical optimization against defragmentation, and makes the
   implementation a bit easier.
 
+  Small blocks are not put back into the ring when freed. They are kept on
+  quick lists, one per size in cells, and handed out again to allocations
+  of the same size without walking the ring. The quick lists are bounded,
+  and they are emptied back into the ring, merging the blocks with their
+  neighbours, when memory runs out or the relocator needs to see all the
+  free space.
+
+  The heap usage and its peak are always counted. The heap profiler,
+  started at run time, also charges each block to the address it was
+  allocated from, in a table of sites which is kept once made, as the
+  headers point into it. Blocks allocated while it is stopped are charged
+  to a single unattributed site.
+
   For safety, both allocated blocks and free ones are marked by magic
   numbers. Whenever anything unexpected is detected, GRUB aborts the
   operation.
@@ -64,6 +78,7 @@
 #include <grub/err.h>
 #include <grub/types.h>
 #include <grub/disk.h>
+#include <grub/fs.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
 #include <grub/mm_private.h>
@@ -101,6 +116,88 @@
 
 grub_mm_region_t grub_mm_base;
 
+/* The largest block, in cells, kept on the quick lists.  */
+#define GRUB_MM_QUICK_MAX	64
+
+/* The most cells kept on all the quick lists together.  */
+#define GRUB_MM_QUICK_LIMIT	8192
+
+static grub_mm_header_t quick_lists[GRUB_MM_QUICK_MAX + 1];
+static grub_size_t quick_cells;
+
+/* The size of the table of allocation sites, a power of two, and how far
+   to look for a site in it.  */
+#define GRUB_MM_SITES		1024
+#define GRUB_MM_SITE_PROBES	32
+
+/* Heap usage in bytes, headers included, and its highest point.  */
+static grub_size_t mm_in_use, mm_peak;
+
+static struct grub_mm_site *mm_sites;
+static struct grub_mm_site mm_unattributed;
+static int mm_profiling;
+
+/* Return the profile entry of the call site ADDR, or the unattributed one
+   if the table has no room for it.  */
+static struct grub_mm_site *
+find_site (const void *addr)
+{
+  unsigned i, probes;
+
+  i = (((grub_addr_t) addr >> 2) ^ ((grub_addr_t) addr >> 12))
+    & (GRUB_MM_SITES - 1);
+  for (probes = 0; probes < GRUB_MM_SITE_PROBES; probes++)
+    {
+      struct grub_mm_site *s = mm_sites + i;
+
+      if (s->addr == addr)
+	return s;
+      if (! s->addr)
+	{
+	  s->addr = addr;
+	  return s;
+	}
+      i = (i + 1) & (GRUB_MM_SITES - 1);
+    }
+
+  return &mm_unattributed;
+}
+
+/* Count the block P, just allocated from SITE, as in use.  */
+static inline void
+charge_block (grub_mm_header_t p, const void *site)
+{
+  struct grub_mm_site *s = &mm_unattributed;
+  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+
+  if (mm_profiling)
+    s = find_site (site);
+
+  p->site = s;
+  s->live += bytes;
+  s->blocks++;
+  s->allocs++;
+
+  mm_in_use += bytes;
+  if (mm_in_use > mm_peak)
+    mm_peak = mm_in_use;
+}
+
+/* Count the block P, about to be freed, as no longer in use.  */
+static inline void
+uncharge_block (grub_mm_header_t p)
+{
+  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+
+  /* Made up by the relocator.  */
+  if (! p->site)
+    return;
+
+  p->site->live -= bytes;
+  p->site->blocks--;
+  mm_in_use -= bytes;
+}
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -118,6 +215,7 @@ grub_mm_region_t grub_mm_base;
 * 本函数实现获得已分配内存对应的头部(grub_mm_header_t)和区域(grub_mm_region_t)指针的功能。
 * 函数首先判断参数ptr是否落在某个以grub_mm_base开头的grub_mm_region_t区域内(并保存在r中)；
 * 接着将ptr减去grub_mm_header_t结构大小，就得到对应的grub_mm_header_t指针(并保存在p中)。
+* 如果该头部标记为空闲（GRUB_MM_FREE_MAGIC或GRUB_MM_QUICK_MAGIC），则报告重复释放。
 **/
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
@@ -137,7 +235,7 @@ get_header_from_pointer (void *ptr, grub_mm_header_t *p, grub_mm_region_t *r)
     grub_fatal ("out of range pointer %p", ptr);
 
   *p = (grub_mm_header_t) ptr - 1;
-  if ((*p)->magic == GRUB_MM_FREE_MAGIC)
+  if ((*p)->magic == GRUB_MM_FREE_MAGIC || (*p)->magic == GRUB_MM_QUICK_MAGIC)
     grub_fatal ("double free at %p", *p);
   if ((*p)->magic != GRUB_MM_ALLOC_MAGIC)
     grub_fatal ("alloc magic is broken at %p: %lx", *p,
@@ -370,14 +468,20 @@ grub_real_malloc (grub_mm_header_t *first, grub_size_t n, grub_size_t align)
 *
 * @note 注释详细内容:
 *
-* 本函数实现按对齐要求进行内存分配的功能。参数align为要求的对齐要求，参数size为要分配的内
-* 存大小。从grub_mm_base开始，尝试用grub_real_malloc()来使用该区域第一个grub_mm_header_t
+* 本函数实现按对齐要求进行内存分配的功能，grub_memalign()、grub_malloc()、grub_zalloc()和
+* grub_realloc()都通过它分配内存。参数align为要求的对齐要求，参数size为要分配的内存大小，参
+* 数site为调用者的地址。分配成功的内存块都调用charge_block()计入堆使用量，堆剖析器运行时还
+* 计入site对应的分配点。没有对齐要求的小块分配首先从对应大小的快速链表（quick_lists）中直接取用。否则从
+* grub_mm_base开始，尝试用grub_real_malloc()来使用该区域第一个grub_mm_header_t
 * 进行分配，如果分配成功则直接返回；如果所有的区域都没法分配，则尝试无效磁盘缓冲来增加内
-* 存，这是通过调用grub_disk_cache_invalidate_all()来完成的。
+* 存，这是通过调用grub_disk_cache_invalidate_all()来完成的，同时还调用
+* grub_fs_mount_cache_flush()释放空闲的已挂载文件系统实例，调用grub_pool_shrink_all()释放
+* 各对象池中空闲的对象，并调用grub_mm_flush_quick()将快速链表中的内存块合并回空闲环。
 **/
-/* Allocate SIZE bytes with the alignment ALIGN and return the pointer.  */
-void *
-grub_memalign (grub_size_t align, grub_size_t size)
+/* Allocate SIZE bytes with the alignment ALIGN for the caller at SITE and
+   return the pointer.  */
+static void *
+memalign_from (grub_size_t align, grub_size_t size, const void *site)
 {
   grub_mm_region_t r;
   grub_size_t n = ((size + GRUB_MM_ALIGN - 1) >> GRUB_MM_ALIGN_LOG2) + 1;
@@ -390,6 +494,20 @@ grub_memalign (grub_size_t align, grub_size_t size)
   if (align == 0)
     align = 1;
 
+  if (align == 1 && n <= GRUB_MM_QUICK_MAX && quick_lists[n])
+    {
+      grub_mm_header_t p = quick_lists[n];
+
+      if (p->magic != GRUB_MM_QUICK_MAGIC)
+	grub_fatal ("quick magic is broken at %p: 0x%x", p, p->magic);
+
+      quick_lists[n] = p->next;
+      quick_cells -= n;
+      p->magic = GRUB_MM_ALLOC_MAGIC;
+      charge_block (p, site);
+      return p + 1;
+    }
+
  again:
 
   for (r = grub_mm_base; r; r = r->next)
@@ -398,15 +516,22 @@ grub_memalign (grub_size_t align, grub_size_t size)
 
       p = grub_real_malloc (&(r->first), n, align);
       if (p)
-	return p;
+	{
+	  charge_block ((grub_mm_header_t) p - 1, site);
+	  return p;
+	}
     }
 
   /* If failed, increase free memory somehow.  */
   switch (count)
     {
     case 0:
-      /* Invalidate disk caches.  */
+      /* Invalidate disk caches, drop the idle mounted filesystems and
+	 pooled objects, and merge the blocks on the quick lists back.  */
       grub_disk_cache_invalidate_all ();
+      grub_fs_mount_cache_flush (0);
+      grub_pool_shrink_all ();
+      grub_mm_flush_quick ();
       count++;
       goto again;
 
@@ -427,6 +552,13 @@ grub_memalign (grub_size_t align, grub_size_t size)
   return 0;
 }
 
+/* Allocate SIZE bytes with the alignment ALIGN and return the pointer.  */
+void *
+grub_memalign (grub_size_t align, grub_size_t size)
+{
+  return memalign_from (align, size, __builtin_return_address (0));
+}
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -442,13 +574,13 @@ grub_memalign (grub_size_t align, grub_size_t size)
 * @note 注释详细内容:
 *
 * 本函数实现无对齐要求进行内存分配的功能。参数size为要分配的内存大小。实际是调用
-* grub_memalign()来实际实现内存分配的。
+* memalign_from()来实际实现内存分配的，并传入调用者的地址作为分配点。
 **/
 /* Allocate SIZE bytes and return the pointer.  */
 void *
 grub_malloc (grub_size_t size)
 {
-  return grub_memalign (0, size);
+  return memalign_from (0, size, __builtin_return_address (0));
 }
 
 /**
@@ -466,7 +598,8 @@ grub_malloc (grub_size_t size)
 * @note 注释详细内容:
 *
 * 本函数实现无对齐要求进行内存分配并清空分配出来的内存的功能。参数size为要分配的内存大小。
-* 实际是调用grub_memalign()来实际实现内存分配的，并调用grub_memset()清空分配出来的内存。
+* 实际是调用memalign_from()来实际实现内存分配的（传入调用者的地址作为分配点），并调用
+* grub_memset()清空分配出来的内存。
 **/
 /* Allocate SIZE bytes, clear them and return the pointer.  */
 void *
@@ -474,47 +607,17 @@ grub_zalloc (grub_size_t size)
 {
   void *ret;
 
-  ret = grub_memalign (0, size);
+  ret = memalign_from (0, size, __builtin_return_address (0));
   if (ret)
     grub_memset (ret, 0, size);
 
   return ret;
 }
 
-/**
-* @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
-*（课题编号：2012ZX01039-004）”的资助。
-*
-* @copyright 注释添加单位：清华大学——03任务（Linux内核相关通用基础软件包分析）承担单位
-*
-* @author 注释添加人员：谢文学
-*
-* @date 注释添加日期：2013年6月21日
-*
-* @brief 释放已分配的内存。
-*
-* @note 注释详细内容:
-*
-* 本函数实现释放已分配的内存的内存的功能。首先调用get_header_from_pointer()获得该内存的
-* grub_mm_header_t和grub_mm_region_t地址；然后将安装两种情况处理：
-*
-* 1） 如果区域的第一个header已经被分配（GRUB_MM_ALLOC_MAGIC），则将该区域的header设为空
-* 闲，并将其设为第一个该区域的第一个header。
-* 2） 否则，就在r->first开始的列表中找到恰当的位置，并设置GRUB_MM_FREE_MAGIC，将区域插入
-* 空闲列表。
-**/
-/* Deallocate the pointer PTR.  */
-void
-grub_free (void *ptr)
+/* Put the allocated block P of the region R back into the free ring.  */
+static void
+free_block (grub_mm_header_t p, grub_mm_region_t r)
 {
-  grub_mm_header_t p;
-  grub_mm_region_t r;
-
-  if (! ptr)
-    return;
-
-  get_header_from_pointer (ptr, &p, &r);
-
   if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
     {
       p->magic = GRUB_MM_FREE_MAGIC;
@@ -572,6 +675,82 @@ grub_free (void *ptr)
       r->first = q;
     }
 }
+
+/**
+* @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
+*（课题编号：2012ZX01039-004）”的资助。
+*
+* @copyright 注释添加单位：清华大学——03任务（Linux内核相关通用基础软件包分析）承担单位
+*
+* @author 注释添加人员：谢文学
+*
+* @date 注释添加日期：2013年6月21日
+*
+* @brief 释放已分配的内存。
+*
+* @note 注释详细内容:
+*
+* 本函数实现释放已分配的内存的内存的功能。首先调用get_header_from_pointer()获得该内存的
+* grub_mm_header_t和grub_mm_region_t地址，并调用uncharge_block()从堆使用量和分配点中扣除；
+* 如果该内存块不超过GRUB_MM_QUICK_MAX个单元且
+* 快速链表未满，则将其标记为GRUB_MM_QUICK_MAGIC并挂入对应大小的快速链表（quick_lists），
+* 以便同样大小的分配直接取用；否则调用free_block()放回空闲环，此时按两种情况处理：
+*
+* 1） 如果区域的第一个header已经被分配（GRUB_MM_ALLOC_MAGIC），则将该区域的header设为空
+* 闲，并将其设为第一个该区域的第一个header。
+* 2） 否则，就在r->first开始的列表中找到恰当的位置，并设置GRUB_MM_FREE_MAGIC，将区域插入
+* 空闲列表。
+**/
+/* Deallocate the pointer PTR.  */
+void
+grub_free (void *ptr)
+{
+  grub_mm_header_t p;
+  grub_mm_region_t r;
+
+  if (! ptr)
+    return;
+
+  get_header_from_pointer (ptr, &p, &r);
+  uncharge_block (p);
+
+  if (p->size <= GRUB_MM_QUICK_MAX
+      && quick_cells + p->size <= GRUB_MM_QUICK_LIMIT)
+    {
+      p->magic = GRUB_MM_QUICK_MAGIC;
+      p->next = quick_lists[p->size];
+      quick_lists[p->size] = p;
+      quick_cells += p->size;
+      return;
+    }
+
+  free_block (p, r);
+}
+
+/* Put all the blocks on the quick lists back into the free rings.  */
+void
+grub_mm_flush_quick (void)
+{
+  grub_size_t n;
+
+  for (n = 0; n <= GRUB_MM_QUICK_MAX; n++)
+    while (quick_lists[n])
+      {
+	grub_mm_header_t p = quick_lists[n];
+	grub_mm_region_t r;
+
+	if (p->magic != GRUB_MM_QUICK_MAGIC)
+	  grub_fatal ("quick magic is broken at %p: 0x%x", p, p->magic);
+
+	quick_lists[n] = p->next;
+	p->magic = GRUB_MM_ALLOC_MAGIC;
+	get_header_from_pointer (p + 1, &p, &r);
+	free_block (p, r);
+      }
+
+  quick_cells = 0;
+}
+
 /**
 * @attention 本注释得到了"核高基"科技重大专项2012年课题“开源操作系统内核分析和安全性评估
 *（课题编号：2012ZX01039-004）”的资助。
@@ -589,7 +768,8 @@ grub_free (void *ptr)
 * 本函数实现重新分配内存的功能。如果参数ptr为空，则直接分配size大小的内存并返回；
 * 如果size为0，则直接释放ptr对应的内存；否则如果原本内存所在区域的大小比size要
 * 求的更大，则直接返回ptr；否则先重新分配size大小的内存，并将原有内存区域拷贝到
-* 新分配的内存中，再释放原有ptr对应的内存，返回新分配的内存。
+* 新分配的内存中，再释放原有ptr对应的内存，返回新分配的内存。新分配的内存计入调用者的分配
+* 点。
 **/
 /* Reallocate SIZE bytes and return the pointer. The contents will be
    the same as that of PTR.  */
@@ -602,7 +782,7 @@ grub_realloc (void *ptr, grub_size_t size)
   grub_size_t n;
 
   if (! ptr)
-    return grub_malloc (size);
+    return memalign_from (0, size, __builtin_return_address (0));
 
   if (! size)
     {
@@ -617,7 +797,7 @@ grub_realloc (void *ptr, grub_size_t size)
   if (p->size >= n)
     return ptr;
 
-  q = grub_malloc (size);
+  q = memalign_from (0, size, __builtin_return_address (0));
   if (! q)
     return q;
 
@@ -626,6 +806,143 @@ grub_realloc (void *ptr, grub_size_t size)
   return q;
 }
 
+/* Return the total size of the free blocks in all regions, in bytes.  */
+grub_size_t
+grub_mm_get_free (void)
+{
+  grub_mm_region_t r;
+  grub_size_t total = 0;
+
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_header_t p;
+
+      /* The region is full.  */
+      if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
+	continue;
+
+      p = r->first;
+      do
+	{
+	  if (p->magic != GRUB_MM_FREE_MAGIC)
+	    grub_fatal ("free magic is broken at %p: 0x%x", p, p->magic);
+	  total += p->size << GRUB_MM_ALIGN_LOG2;
+	  p = p->next;
+	}
+      while (p != r->first);
+    }
+
+  return total + (quick_cells << GRUB_MM_ALIGN_LOG2);
+}
+
+/* Count the free block of SIZE bytes in STATS.  */
+static void
+count_free (struct grub_mm_stats *stats, grub_size_t size)
+{
+  unsigned b = 0;
+
+  while (b < GRUB_MM_STATS_BUCKETS - 1 && size >= ((grub_size_t) 64 << b))
+    b++;
+
+  stats->free += size;
+  stats->free_blocks++;
+  stats->free_hist[b]++;
+  if (size > stats->largest_free)
+    stats->largest_free = size;
+}
+
+/* Fill STATS with the heap usage and the sizes of the free blocks.  */
+void
+grub_mm_get_stats (struct grub_mm_stats *stats)
+{
+  grub_mm_region_t r;
+  grub_size_t n;
+
+  grub_memset (stats, 0, sizeof (*stats));
+  stats->in_use = mm_in_use;
+  stats->peak = mm_peak;
+  stats->profiling = mm_profiling;
+
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_header_t p;
+
+      if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
+	continue;
+
+      p = r->first;
+      do
+	{
+	  if (p->magic != GRUB_MM_FREE_MAGIC)
+	    grub_fatal ("free magic is broken at %p: 0x%x", p, p->magic);
+	  count_free (stats, p->size << GRUB_MM_ALIGN_LOG2);
+	  p = p->next;
+	}
+      while (p != r->first);
+    }
+
+  for (n = 0; n <= GRUB_MM_QUICK_MAX; n++)
+    {
+      grub_mm_header_t p;
+
+      for (p = quick_lists[n]; p; p = p->next)
+	count_free (stats, n << GRUB_MM_ALIGN_LOG2);
+    }
+}
+
+/* Start charging the allocations to their call sites.  */
+grub_err_t
+grub_mm_profile_start (void)
+{
+  if (! mm_sites)
+    {
+      mm_sites = grub_zalloc (GRUB_MM_SITES * sizeof (mm_sites[0]));
+      if (! mm_sites)
+	return grub_errno;
+    }
+
+  mm_profiling = 1;
+  return GRUB_ERR_NONE;
+}
+
+void
+grub_mm_profile_stop (void)
+{
+  mm_profiling = 0;
+}
+
+/* Restart the peak and the allocation counts from now.  The blocks still
+   in use stay charged to their sites.  */
+void
+grub_mm_profile_reset (void)
+{
+  unsigned i;
+
+  mm_peak = mm_in_use;
+  mm_unattributed.allocs = 0;
+  if (mm_sites)
+    for (i = 0; i < GRUB_MM_SITES; i++)
+      mm_sites[i].allocs = 0;
+}
+
+/* Call HOOK for the unattributed site and then for every site recorded by
+   the profiler, until it returns non-zero.  */
+int
+grub_mm_profile_iterate (int (*hook) (const struct grub_mm_site *site))
+{
+  unsigned i;
+
+  if (hook (&mm_unattributed))
+    return 1;
+
+  if (mm_sites)
+    for (i = 0; i < GRUB_MM_SITES; i++)
+      if (mm_sites[i].addr && hook (&mm_sites[i]))
+	return 1;
+
+  return 0;
+}
+
 #ifdef MM_DEBUG
 int grub_mm_debug = 0;
 
@@ -679,6 +996,9 @@ grub_mm_dump (unsigned lineno)
 	    case GRUB_MM_ALLOC_MAGIC:
 	      grub_printf ("A:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
 	      break;
+	    case GRUB_MM_QUICK_MAGIC:
+	      grub_printf ("Q:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
+	      break;
 	    }
 	}
     }
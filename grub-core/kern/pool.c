@@ -0,0 +1,240 @@
+/* pool.c - object pools and arenas */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/err.h>
+
+/* An idle object on the free list of a pool.  */
+struct grub_pool_object
+{
+  struct grub_pool_object *next;
+};
+
+struct grub_pool
+{
+  struct grub_pool *next;
+  grub_size_t size;
+  grub_size_t align;
+  struct grub_pool_object *idle;
+  unsigned nidle;
+  unsigned max_idle;
+};
+
+/* All the pools, to release their idle objects when memory runs out.  */
+static struct grub_pool *grub_pool_list;
+
+/* Create a pool of objects of SIZE bytes aligned on ALIGN, 0 meaning the
+   default alignment of grub_malloc, keeping at most MAX_IDLE freed ones
+   for reuse.  */
+grub_pool_t
+grub_pool_create (grub_size_t size, grub_size_t align, unsigned max_idle)
+{
+  struct grub_pool *pool;
+
+  pool = grub_zalloc (sizeof (*pool));
+  if (! pool)
+    return 0;
+
+  if (size < sizeof (struct grub_pool_object))
+    size = sizeof (struct grub_pool_object);
+  pool->size = size;
+  pool->align = align;
+  pool->max_idle = max_idle;
+
+  pool->next = grub_pool_list;
+  grub_pool_list = pool;
+
+  return pool;
+}
+
+static void
+grub_pool_shrink (struct grub_pool *pool)
+{
+  while (pool->idle)
+    {
+      struct grub_pool_object *obj = pool->idle;
+
+      pool->idle = obj->next;
+      grub_free (obj);
+    }
+  pool->nidle = 0;
+}
+
+/* Destroy POOL.  Objects still in use must be released with grub_free.  */
+void
+grub_pool_destroy (grub_pool_t pool)
+{
+  struct grub_pool **p;
+
+  if (! pool)
+    return;
+
+  for (p = &grub_pool_list; *p; p = &(*p)->next)
+    if (*p == pool)
+      {
+	*p = pool->next;
+	break;
+      }
+
+  grub_pool_shrink (pool);
+  grub_free (pool);
+}
+
+void *
+grub_pool_alloc (grub_pool_t pool)
+{
+  struct grub_pool_object *obj = pool->idle;
+
+  if (! obj)
+    return grub_memalign (pool->align, pool->size);
+
+  pool->idle = obj->next;
+  pool->nidle--;
+  return obj;
+}
+
+void
+grub_pool_free (grub_pool_t pool, void *obj)
+{
+  struct grub_pool_object *o = obj;
+
+  if (! obj)
+    return;
+
+  if (pool->nidle >= pool->max_idle)
+    {
+      grub_free (obj);
+      return;
+    }
+
+  o->next = pool->idle;
+  pool->idle = o;
+  pool->nidle++;
+}
+
+/* Release the idle objects of all the pools.  */
+void
+grub_pool_shrink_all (void)
+{
+  struct grub_pool *pool;
+
+  for (pool = grub_pool_list; pool; pool = pool->next)
+    grub_pool_shrink (pool);
+}
+
+struct grub_arena_chunk
+{
+  struct grub_arena_chunk *next;
+  grub_size_t size;
+  grub_size_t used;
+  grub_properly_aligned_t data[0];
+};
+
+struct grub_arena
+{
+  /* The chunk being filled comes first.  */
+  struct grub_arena_chunk *chunks;
+  grub_size_t chunk_size;
+};
+
+/* Create an arena which allocates memory in chunks of CHUNK_SIZE bytes.  */
+grub_arena_t
+grub_arena_create (grub_size_t chunk_size)
+{
+  struct grub_arena *arena;
+
+  arena = grub_zalloc (sizeof (*arena));
+  if (! arena)
+    return 0;
+
+  arena->chunk_size = chunk_size;
+  return arena;
+}
+
+/* Release everything allocated from ARENA and ARENA itself.  */
+void
+grub_arena_destroy (grub_arena_t arena)
+{
+  if (! arena)
+    return;
+
+  grub_arena_reset (arena);
+  grub_free (arena->chunks);
+  grub_free (arena);
+}
+
+/* Allocate SIZE bytes from ARENA, with the alignment of grub_malloc.  */
+void *
+grub_arena_alloc (grub_arena_t arena, grub_size_t size)
+{
+  struct grub_arena_chunk *chunk = arena->chunks;
+  void *ret;
+
+  size = ALIGN_UP (size, sizeof (grub_properly_aligned_t));
+
+  if (! chunk || chunk->size - chunk->used < size)
+    {
+      grub_size_t chunk_size = arena->chunk_size;
+
+      if (chunk_size < size)
+	chunk_size = size;
+
+      chunk = grub_malloc (sizeof (*chunk) + chunk_size);
+      if (! chunk)
+	return 0;
+      chunk->size = chunk_size;
+      chunk->used = 0;
+
+      /* Keep filling the current chunk after an oversized allocation.  */
+      if (arena->chunks && chunk_size > arena->chunk_size)
+	{
+	  chunk->next = arena->chunks->next;
+	  arena->chunks->next = chunk;
+	}
+      else
+	{
+	  chunk->next = arena->chunks;
+	  arena->chunks = chunk;
+	}
+    }
+
+  ret = (char *) chunk->data + chunk->used;
+  chunk->used += size;
+  return ret;
+}
+
+/* Release everything allocated from ARENA, keeping one chunk for reuse.  */
+void
+grub_arena_reset (grub_arena_t arena)
+{
+  struct grub_arena_chunk *chunk;
+
+  if (! arena->chunks)
+    return;
+
+  while (arena->chunks->next)
+    {
+      chunk = arena->chunks->next;
+      arena->chunks->next = chunk->next;
+      grub_free (chunk);
+    }
+
+  arena->chunks->used = 0;
+}
@@ -0,0 +1,182 @@
+/* lz4.c - LZ4 block decompression */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/lib/lz4.h>
+
+/* A block is a list of sequences, each made of a token, literals and a
+   match.  The high nibble of the token is the number of literals, the
+   low one the length of the match minus 4, and a nibble of 15 is followed
+   by bytes adding to it until one isn't 255.  The match is given by a
+   16-bit offset following the literals.  The last sequence has only
+   literals.  */
+
+#define MIN_MATCH 4
+#define COPY_SIZE 8
+
+/* Copy LEN bytes 8 at a time.  The caller makes sure that up to 7 more
+   bytes may be read and written.  */
+static inline void
+wild_copy (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t len)
+{
+  grub_uint8_t *end = dst + len;
+
+  do
+    {
+      grub_set_unaligned64 (dst, grub_get_unaligned64 (src));
+      dst += COPY_SIZE;
+      src += COPY_SIZE;
+    }
+  while (dst < end);
+}
+
+/* Add the extension bytes of a length to *LEN.  */
+static inline int
+read_length (const grub_uint8_t **ip, const grub_uint8_t *iend,
+	     grub_size_t *len)
+{
+  grub_uint8_t b;
+
+  do
+    {
+      if (*ip >= iend)
+	return 0;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 0xff);
+
+  return 1;
+}
+
+grub_ssize_t
+grub_lz4_decompress (const void *src, grub_size_t srcsize,
+		     void *dst, grub_size_t dstsize, grub_size_t history)
+{
+  const grub_uint8_t *ip = src;
+  const grub_uint8_t *iend = ip + srcsize;
+  grub_uint8_t *op = dst;
+  grub_uint8_t *oend = op + dstsize;
+  const grub_uint8_t *low = op - history;
+
+  while (1)
+    {
+      grub_size_t len;
+      grub_size_t offset;
+      grub_uint8_t token;
+      const grub_uint8_t *match;
+
+      if (ip >= iend)
+	return -1;
+      token = *ip++;
+
+      /* Literals.  */
+      len = token >> 4;
+      if (len == 0xf && !read_length (&ip, iend, &len))
+	return -1;
+      if (len > (grub_size_t) (iend - ip) || len > (grub_size_t) (oend - op))
+	return -1;
+      if (len + COPY_SIZE <= (grub_size_t) (iend - ip)
+	  && len + COPY_SIZE <= (grub_size_t) (oend - op))
+	{
+	  if (len)
+	    wild_copy (op, ip, len);
+	}
+      else
+	grub_memcpy (op, ip, len);
+      ip += len;
+      op += len;
+
+      if (ip == iend)
+	break;
+
+      /* Match.  */
+      if (iend - ip < 2)
+	return -1;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (grub_size_t) (op - low))
+	return -1;
+      match = op - offset;
+
+      len = token & 0xf;
+      if (len == 0xf && !read_length (&ip, iend, &len))
+	return -1;
+      len += MIN_MATCH;
+      if (len > (grub_size_t) (oend - op))
+	return -1;
+
+      if (offset >= COPY_SIZE && len + COPY_SIZE <= (grub_size_t) (oend - op))
+	wild_copy (op, match, len);
+      else
+	{
+	  grub_size_t i;
+
+	  /* The match may overlap the data it produces.  */
+	  for (i = 0; i < len; i++)
+	    op[i] = match[i];
+	}
+      op += len;
+    }
+
+  return op - (grub_uint8_t *) dst;
+}
+
+grub_ssize_t
+grub_lz4_uncompressed_size (const void *src, grub_size_t srcsize)
+{
+  const grub_uint8_t *ip = src;
+  const grub_uint8_t *iend = ip + srcsize;
+  grub_size_t size = 0;
+
+  while (1)
+    {
+      grub_size_t len;
+      grub_uint8_t token;
+
+      if (ip >= iend)
+	return -1;
+      token = *ip++;
+
+      len = token >> 4;
+      if (len == 0xf && !read_length (&ip, iend, &len))
+	return -1;
+      if (len > (grub_size_t) (iend - ip))
+	return -1;
+      ip += len;
+      size += len;
+
+      if (ip == iend)
+	break;
+
+      if (iend - ip < 2)
+	return -1;
+      ip += 2;
+
+      len = token & 0xf;
+      if (len == 0xf && !read_length (&ip, iend, &len))
+	return -1;
+      size += len + MIN_MATCH;
+    }
+
+  if ((grub_ssize_t) size < 0)
+    return -1;
+  return size;
+}
@@ -351,6 +351,7 @@ free_subchunk (const struct grub_relocator_subchunk *subchu)
 	    grub_mm_header_t hl2, hl, g;
 	    g = (grub_mm_header_t) ((grub_addr_t) r2 + r2->size);
 	    g->size = (grub_mm_header_t) r1 - g;
+	    g->site = NULL;
 	    r2->size += r1->size;
 	    for (hl = r2->first; hl->next != r2->first; hl = hl->next);
 	    for (hl2 = r1->first; hl2->next != r1->first; hl2 = hl2->next);
@@ -371,6 +372,7 @@ free_subchunk (const struct grub_relocator_subchunk *subchu)
 	  - (subchu->start / GRUB_MM_ALIGN) - 1;
 	h->next = h;
 	h->magic = GRUB_MM_ALLOC_MAGIC;
+	h->site = NULL;
 	grub_free (h + 1);
 	break;
       }
@@ -439,6 +441,12 @@ malloc_in_range (struct grub_relocator *rel,
   if (end < start + size)
     return 0;
 
+  /* Release the idle pooled objects, as the allocator does when it runs
+     out of memory, and merge the blocks on the quick lists back, since
+     they aren't in the free rings.  */
+  grub_pool_shrink_all ();
+  grub_mm_flush_quick ();
+
   /* We have to avoid any allocations when filling scanline events. 
      Hence 2-stages.
    */
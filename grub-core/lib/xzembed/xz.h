@@ -177,6 +177,17 @@ enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b);
  */
 void xz_dec_reset(struct xz_dec *s);
 
+/**
+ * xz_dec_seek_block() - Continue decoding at the start of another Block
+ * @s:          Decoder state which has decoded the Stream Header
+ *
+ * The next input byte given to xz_dec_run() must be the first byte of a
+ * Block Header. Since the Blocks before it are skipped, the Index can't be
+ * validated anymore: xz_dec_run() returns XZ_STREAM_END where the Index
+ * starts instead.
+ */
+void xz_dec_seek_block(struct xz_dec *s);
+
 /**
  * xz_dec_end() - Free the memory allocated for the decoder state
  * @s:          Decoder state allocated using xz_dec_init(). If s is NULL,
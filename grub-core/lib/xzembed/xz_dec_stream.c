@@ -91,6 +91,9 @@ struct xz_dec {
 	 */
 	bool allow_buf_error;
 
+	/* True if Blocks were skipped with xz_dec_seek_block(). */
+	bool seeked;
+
 	/* Information stored in Block Header */
 	struct {
 		/*
@@ -756,6 +759,9 @@ static enum xz_ret dec_main(struct xz_dec *s, struct xz_buf *b)
 
 			/* See if this is the beginning of the Index field. */
 			if (b->in[b->in_pos] == 0) {
+				if (s->seeked)
+					return XZ_STREAM_END;
+
 				s->in_start = b->in_pos++;
 				s->sequence = SEQ_INDEX;
 				break;
@@ -990,6 +996,7 @@ void xz_dec_reset(struct xz_dec *s)
 {
 	s->sequence = SEQ_STREAM_HEADER;
 	s->allow_buf_error = false;
+	s->seeked = false;
 	s->pos = 0;
 
 	{
@@ -1021,6 +1028,22 @@ void xz_dec_reset(struct xz_dec *s)
 	s->have_hash_value = 0;
 }
 
+void xz_dec_seek_block(struct xz_dec *s)
+{
+	s->sequence = SEQ_BLOCK_START;
+	s->allow_buf_error = false;
+	s->seeked = true;
+	s->pos = 0;
+	s->have_hash_value = 0;
+
+#ifndef GRUB_EMBED_DECOMPRESSOR
+	if (s->hash)
+		s->hash->init(s->hash_context);
+	if (s->crc32)
+		s->crc32->init(s->crc32_context);
+#endif
+}
+
 void xz_dec_end(struct xz_dec *s)
 {
 	if (s != NULL) {
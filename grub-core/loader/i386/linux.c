@@ -34,6 +34,7 @@
 #include <grub/i386/relocator.h>
 #include <grub/i18n.h>
 #include <grub/lib/cmdline.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -742,6 +743,8 @@ grub_linux_unload (void)
 * grub_file_read (file, prot_mode_mem, len)完成的。最后，如果前面的操作都成功，则调用
 * grub_loader_set()将grub_loader_boot_func和grub_loader_unload_func分别设置为
 * grub_linux_boot()和grub_linux_unload()函数。
+*
+* 读入内核保护模式部分的过程作为一个"kernel"区间记录在启动跟踪（boottrace）中。
 **/
 static grub_err_t
 grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
@@ -753,7 +756,7 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
   grub_uint8_t setup_sects;
   grub_size_t real_size, prot_size, prot_file_size;
   grub_ssize_t len;
-  int i;
+  int i, span;
   grub_size_t align, min_align;
   int relocatable;
   grub_uint64_t preffered_address = GRUB_LINUX_BZIMAGE_ADDR;
@@ -770,6 +773,8 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
   if (! file)
     goto fail;
 
+  grub_file_set_streaming (file);
+
   if (grub_file_read (file, &lh, sizeof (lh)) != sizeof (lh))
     {
       if (!grub_errno)
@@ -1088,9 +1093,11 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
 			      - (sizeof (LINUX_IMAGE) - 1));
 
   len = prot_file_size;
+  span = grub_boottrace_begin ("kernel", "%s", argv[0]);
   if (grub_file_read (file, prot_mode_mem, len) != len && !grub_errno)
     grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
 		argv[0]);
+  grub_boottrace_end (span);
 
   if (grub_errno == GRUB_ERR_NONE)
     {
@@ -1139,6 +1146,8 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
 * 再下一步就是通过grub_file_read (files[i], ptr, cursize)将这些文件读入前面分配的内存，并
 * 设置linux_params中的重要参数ramdisk_image，ramdisk_size，以及root_dev，这主要是为了能够
 * 通知内核在哪里找到initrd，以及实际需要解析的大小；同时还有跟设备号。
+*
+* 每个initrd文件的读入过程作为一个"initrd"区间记录在启动跟踪（boottrace）中。
 **/
 static grub_err_t
 grub_cmd_initrd (grub_command_t cmd __attribute__ ((unused)),
@@ -1175,6 +1184,7 @@ grub_cmd_initrd (grub_command_t cmd __attribute__ ((unused)),
       files[i] = grub_file_open (argv[i]);
       if (! files[i])
 	goto fail;
+      grub_file_set_streaming (files[i]);
       nfiles++;
       size += ALIGN_UP (grub_file_size (files[i]), 4);
     }
@@ -1232,7 +1242,13 @@ grub_cmd_initrd (grub_command_t cmd __attribute__ ((unused)),
   for (i = 0; i < nfiles; i++)
     {
       grub_ssize_t cursize = grub_file_size (files[i]);
-      if (grub_file_read (files[i], ptr, cursize) != cursize)
+      grub_ssize_t actual;
+      int span;
+
+      span = grub_boottrace_begin ("initrd", "%s", argv[i]);
+      actual = grub_file_read (files[i], ptr, cursize);
+      grub_boottrace_end (span);
+      if (actual != cursize)
 	{
 	  if (!grub_errno)
 	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
@@ -34,6 +34,7 @@
 #include <grub/video.h>
 #include <grub/i386/floppy.h>
 #include <grub/lib/cmdline.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -88,7 +89,7 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
   grub_uint8_t setup_sects;
   grub_size_t real_size;
   grub_ssize_t len;
-  int i;
+  int i, span;
   char *grub_linux_prot_chunk;
   int grub_linux_is_bzimage;
   grub_addr_t grub_linux_prot_target;
@@ -324,10 +325,12 @@ grub_cmd_linux (grub_command_t cmd __attribute__ ((unused)),
   }
 
   len = grub_linux16_prot_size;
+  span = grub_boottrace_begin ("kernel", "%s", argv[0]);
   if (grub_file_read (file, grub_linux_prot_chunk, grub_linux16_prot_size)
       != (grub_ssize_t) grub_linux16_prot_size && !grub_errno)
     grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
 		argv[0]);
+  grub_boottrace_end (span);
 
   if (grub_errno == GRUB_ERR_NONE)
     {
@@ -441,7 +444,13 @@ grub_cmd_initrd (grub_command_t cmd __attribute__ ((unused)),
   for (i = 0; i < nfiles; i++)
     {
       grub_ssize_t cursize = grub_file_size (files[i]);
-      if (grub_file_read (files[i], ptr, cursize) != cursize)
+      grub_ssize_t actual;
+      int span;
+
+      span = grub_boottrace_begin ("initrd", "%s", argv[i]);
+      actual = grub_file_read (files[i], ptr, cursize);
+      grub_boottrace_end (span);
+      if (actual != cursize)
 	{
 	  if (!grub_errno)
 	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
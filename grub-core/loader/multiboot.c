@@ -305,6 +305,8 @@ grub_cmd_module (grub_command_t cmd __attribute__ ((unused)),
   if (! file)
     return grub_errno;
 
+  grub_file_set_streaming (file);
+
   size = grub_file_size (file);
   {
     grub_relocator_chunk_t ch;
@@ -21,6 +21,13 @@
 #include <grub/mm.h>
 #include <grub/net/netbuff.h>
 
+/* The most idle packet buffers kept for reuse.  */
+#define NETBUFF_POOL_IDLE 16
+
+/* Buffers for packets of up to NETBUFF_ALIGN bytes, which are most of
+   them.  */
+static grub_pool_t netbuff_pool;
+
 grub_err_t
 grub_netbuff_put (struct grub_net_buff *nb, grub_size_t len)
 {
@@ -83,7 +90,17 @@ grub_netbuff_alloc (grub_size_t len)
     len = NETBUFFMINLEN;
 
   len = ALIGN_UP (len, NETBUFF_ALIGN);
-  data = grub_memalign (NETBUFF_ALIGN, len + sizeof (*nb));
+  if (len == NETBUFF_ALIGN)
+    {
+      if (!netbuff_pool)
+	netbuff_pool = grub_pool_create (NETBUFF_ALIGN + sizeof (*nb),
+					 NETBUFF_ALIGN, NETBUFF_POOL_IDLE);
+      if (!netbuff_pool)
+	return NULL;
+      data = grub_pool_alloc (netbuff_pool);
+    }
+  else
+    data = grub_memalign (NETBUFF_ALIGN, len + sizeof (*nb));
   if (!data)
     return NULL;
   nb = (struct grub_net_buff *) ((grub_properly_aligned_t *) data
@@ -98,7 +115,17 @@ grub_netbuff_free (struct grub_net_buff *nb)
 {
   if (!nb)
     return;
-  grub_free (nb->head);
+  if (netbuff_pool && nb->end - nb->head == NETBUFF_ALIGN)
+    grub_pool_free (netbuff_pool, nb->head);
+  else
+    grub_free (nb->head);
+}
+
+void
+grub_netbuff_fini (void)
+{
+  grub_pool_destroy (netbuff_pool);
+  netbuff_pool = NULL;
 }
 
 grub_err_t
@@ -24,31 +24,125 @@
 #include <grub/fs.h>
 #include <grub/normal.h>
 
+/* A filesystem module from fs.lst, with the signatures of the filesystems
+   it provides.  */
+struct fs_module
+{
+  struct fs_module *next;
+  char *name;
+  /* Null if the module didn't declare any.  */
+  struct grub_fs_signature *signatures;
+  /* The line of fs.lst, which holds the decoded magics.  */
+  char *line;
+};
+
 /* This is used to store the names of filesystem modules for auto-loading.  */
-static grub_named_list_t fs_module_list;
+static struct fs_module *fs_module_list;
+
+static void
+free_fs_module (struct fs_module *mod)
+{
+  grub_free (mod->signatures);
+  grub_free (mod->line);
+  grub_free (mod);
+}
 
-/* The auto-loading hook for filesystems.  */
+/* The auto-loading hook for filesystems.  Load the next module which may
+   provide the filesystem found in AREA.  Modules which can't are kept for
+   other devices.  */
 static int
-autoload_fs_module (void)
+autoload_fs_module (const struct grub_fs_probe_area *area)
 {
-  grub_named_list_t p;
+  struct fs_module *p, **prev = &fs_module_list;
 
-  while ((p = fs_module_list) != NULL)
+  while ((p = *prev) != NULL)
     {
-      if (! grub_dl_get (p->name) && grub_dl_load (p->name))
-	return 1;
+      if (! grub_dl_get (p->name))
+	{
+	  if (! grub_fs_match_signatures (p->signatures, area))
+	    {
+	      prev = &p->next;
+	      continue;
+	    }
 
-      if (grub_errno)
-	grub_print_error ();
+	  if (grub_dl_load (p->name))
+	    return 1;
 
-      fs_module_list = p->next;
-      grub_free (p->name);
-      grub_free (p);
+	  if (grub_errno)
+	    grub_print_error ();
+	}
+
+      *prev = p->next;
+      free_fs_module (p);
     }
 
   return 0;
 }
 
+/* Decode the signatures "OFFSET:MAGIC ..." following the module name in
+   P, in place.  MAGIC may contain \xHH and \\ escapes.  */
+static struct grub_fs_signature *
+parse_signatures (char *p)
+{
+  struct grub_fs_signature *signatures;
+  unsigned n = 0, i;
+  char *q;
+
+  for (q = p; *q; q++)
+    if (*q == ':')
+      n++;
+  if (n == 0)
+    return NULL;
+
+  signatures = grub_zalloc ((n + 1) * sizeof (signatures[0]));
+  if (! signatures)
+    return NULL;
+
+  for (i = 0; i < n; i++)
+    {
+      char *magic, *out;
+
+      while (grub_isspace (*p))
+	p++;
+      signatures[i].offset = grub_strtoull (p, &p, 10);
+      if (grub_errno || *p != ':')
+	goto fail;
+
+      magic = out = ++p;
+      while (*p && ! grub_isspace (*p))
+	{
+	  if (p[0] == '\\' && p[1] == 'x'
+	      && grub_isxdigit (p[2]) && grub_isxdigit (p[3]))
+	    {
+	      char hex[3] = { p[2], p[3], 0 };
+	      *out++ = grub_strtoul (hex, 0, 16);
+	      p += 4;
+	    }
+	  else if (p[0] == '\\' && p[1] == '\\')
+	    {
+	      *out++ = '\\';
+	      p += 2;
+	    }
+	  else
+	    *out++ = *p++;
+	}
+      if (*p)
+	p++;
+
+      signatures[i].magic = magic;
+      signatures[i].size = out - magic;
+      if (signatures[i].size == 0)
+	goto fail;
+    }
+
+  return signatures;
+
+ fail:
+  grub_free (signatures);
+  grub_errno = GRUB_ERR_NONE;
+  return NULL;
+}
+
 /* Read the file fs.lst for auto-loading.  */
 void
 read_fs_list (const char *prefix)
@@ -75,9 +169,9 @@ read_fs_list (const char *prefix)
 	      /* Override previous fs.lst.  */
 	      while (fs_module_list)
 		{
-		  grub_named_list_t tmp;
+		  struct fs_module *tmp;
 		  tmp = fs_module_list->next;
-		  grub_free (fs_module_list);
+		  free_fs_module (fs_module_list);
 		  fs_module_list = tmp;
 		}
 
@@ -86,7 +180,7 @@ read_fs_list (const char *prefix)
 		  char *buf;
 		  char *p;
 		  char *q;
-		  grub_named_list_t fs_mod;
+		  struct fs_module *fs_mod;
 
 		  buf = grub_file_getline (file);
 		  if (! buf)
@@ -116,13 +210,14 @@ read_fs_list (const char *prefix)
 		      continue;
 		    }
 
-		  fs_mod->name = grub_strdup (p);
-		  grub_free (buf);
-		  if (! fs_mod->name)
-		    {
-		      grub_free (fs_mod);
-		      continue;
-		    }
+		  /* The module name, then its signatures if any.  */
+		  fs_mod->name = p;
+		  fs_mod->line = buf;
+		  while (*p && ! grub_isspace (*p))
+		    p++;
+		  if (*p)
+		    *p++ = '\0';
+		  fs_mod->signatures = parse_signatures (p);
 
 		  fs_mod->next = fs_module_list;
 		  fs_module_list = fs_mod;
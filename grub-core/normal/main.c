@@ -32,6 +32,7 @@
 #include <grub/i18n.h>
 #include <grub/charset.h>
 #include <grub/script_sh.h>
+#include <grub/boottrace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -140,6 +141,7 @@ read_config_file (const char *config)
   grub_file_t file;
   const char *old_file, *old_dir;
   char *config_dir, *ptr = 0;
+  int config_span;
 
   auto grub_err_t getline (char **line, int cont);
   grub_err_t getline (char **line, int cont __attribute__ ((unused)))
@@ -191,9 +193,11 @@ read_config_file (const char *config)
   grub_env_export ("config_file");
   grub_env_export ("config_directory");
 
+  config_span = grub_boottrace_begin ("config", "%s", config);
   while (1)
     {
       char *line;
+      int span;
 
       /* Print an error, if any.  */
       grub_print_error ();
@@ -202,9 +206,13 @@ read_config_file (const char *config)
       if ((getline (&line, 0)) || (! line))
 	break;
 
+      /* A block may span several lines, the first one names it.  */
+      span = grub_boottrace_begin ("script", "%s", line);
       grub_normal_parse_line (line, getline);
+      grub_boottrace_end (span);
       grub_free (line);
     }
+  grub_boottrace_end (config_span);
 
   if (old_file)
     grub_env_set ("config_file", old_file);
@@ -32,6 +32,7 @@
 #include <grub/script_sh.h>
 #include <grub/gfxterm.h>
 #include <grub/dl.h>
+#include <grub/boottrace.h>
 
 /* Time to delay after displaying an error message about a default/fallback
    entry failing to boot.  */
@@ -161,6 +162,7 @@ grub_menu_execute_entry(grub_menu_entry_t entry, int auto_boot)
   char *optr, *buf, *oldchosen = NULL, *olddefault = NULL;
   const char *ptr, *chosen, *def;
   grub_size_t sz = 0;
+  int span;
 
   if (entry->restricted)
     err = grub_auth_check_authentication (entry->users);
@@ -245,7 +247,9 @@ grub_menu_execute_entry(grub_menu_entry_t entry, int auto_boot)
   else
     grub_env_unset ("default");
 
+  span = grub_boottrace_begin ("menuentry", "%s", entry->title);
   grub_script_execute_sourcecode (entry->sourcecode, entry->argc, entry->args);
+  grub_boottrace_end (span);
 
   if (errs_before != grub_err_printed_errors)
     grub_wait_after_message ();
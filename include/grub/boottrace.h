@@ -0,0 +1,72 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_BOOTTRACE_HEADER
+#define GRUB_BOOTTRACE_HEADER	1
+
+#include <grub/types.h>
+#include <grub/symbol.h>
+
+/* The boot trace records how long the phases of the boot take as named
+   spans, shown and exported by the boottrace command.  */
+
+#define GRUB_BOOTTRACE_MAX	1024
+#define GRUB_BOOTTRACE_KIND_SIZE	16
+#define GRUB_BOOTTRACE_ARG_SIZE	48
+
+struct grub_boottrace_span
+{
+  /* What the span covers, like "insmod" or "mount".  It's copied since
+     the caller's module may be unloaded while the trace is kept.  */
+  char kind[GRUB_BOOTTRACE_KIND_SIZE];
+  /* What it was done to, like the module name.  */
+  char arg[GRUB_BOOTTRACE_ARG_SIZE];
+  grub_uint64_t start_ms;
+  grub_uint64_t end_ms;
+  /* The CPU cycle counter, or 0 if there is none.  */
+  grub_uint64_t start_tsc;
+  grub_uint64_t end_tsc;
+  /* The number of spans open when this one began.  */
+  unsigned depth;
+  int id;
+  int open;
+};
+
+#ifndef GRUB_UTIL
+int EXPORT_FUNC(grub_boottrace_begin) (const char *kind, const char *fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+void EXPORT_FUNC(grub_boottrace_end) (int span);
+const struct grub_boottrace_span *
+EXPORT_FUNC(grub_boottrace_get) (unsigned *nspans, unsigned *dropped);
+void EXPORT_FUNC(grub_boottrace_clear) (void);
+#else
+/* The utilities don't trace.  */
+static inline int
+grub_boottrace_begin (const char *kind __attribute__ ((unused)),
+		      const char *fmt __attribute__ ((unused)), ...)
+{
+  return -1;
+}
+
+static inline void
+grub_boottrace_end (int span __attribute__ ((unused)))
+{
+}
+#endif
+
+#endif /* ! GRUB_BOOTTRACE_HEADER */
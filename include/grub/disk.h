@@ -56,6 +56,16 @@ typedef enum
     GRUB_DISK_PULL_MAX
   } grub_disk_pull_t;
 
+/* A segment of a vectored read: SIZE bytes at OFFSET bytes past the
+   sector SECTOR go to BUF.  */
+struct grub_disk_vec
+{
+  grub_disk_addr_t sector;
+  grub_off_t offset;
+  grub_size_t size;
+  void *buf;
+};
+
 /* Disk device.  */
 struct grub_disk_dev
 {
@@ -83,6 +93,12 @@ struct grub_disk_dev
   grub_err_t (*write) (struct grub_disk *disk, grub_disk_addr_t sector,
 		       grub_size_t size, const char *buf);
 
+  /* Read the NVEC segments VEC of the disk DISK at once.  Sectors are in
+     the units of the disk, offsets are 0 and sizes are multiples of the
+     sector size.  Optional.  */
+  grub_err_t (*read_vec) (struct grub_disk *disk, struct grub_disk_vec *vec,
+			  unsigned nvec);
+
 #ifdef GRUB_UTIL
   struct grub_disk_memberlist *(*memberlist) (struct grub_disk *disk);
   const char * (*raidname) (struct grub_disk *disk);
@@ -96,6 +112,29 @@ typedef struct grub_disk_dev *grub_disk_dev_t;
 extern grub_disk_dev_t EXPORT_VAR (grub_disk_dev_list);
 
 struct grub_partition;
+struct grub_disk_state;
+
+/* The number of buckets of the latency histogram.  */
+#define GRUB_DISK_STATS_LATENCY_BUCKETS	8
+
+/* I/O statistics of a disk device.  */
+struct grub_disk_stats
+{
+  /* Requests passed to the driver, and the bytes they transferred.  */
+  grub_uint64_t reads;
+  grub_uint64_t bytes_read;
+
+  /* Cache lookups, and cached blocks displaced by other data.  */
+  grub_uint64_t cache_hits;
+  grub_uint64_t cache_misses;
+  grub_uint64_t evictions;
+
+  /* Milliseconds spent in the driver.  Bucket 0 of the histogram counts
+     requests which took less than 1 ms, bucket N those which took less
+     than 2^N ms, and the last bucket all the slower ones.  */
+  grub_uint64_t read_time;
+  grub_uint64_t latency[GRUB_DISK_STATS_LATENCY_BUCKETS];
+};
 
 /* Disk.  */
 struct grub_disk
@@ -115,11 +154,26 @@ struct grub_disk
   /* The id used by the disk cache manager.  */
   unsigned long id;
 
+  /* The state kept for the device across opens: its generation, see
+     grub_disk_get_generation, and its statistics.  */
+  struct grub_disk_state *state;
+
   /* The partition information. This is machine-specific.  */
   struct grub_partition *partition;
 
-  /* Called when a sector was read. OFFSET is between 0 and
-     the sector size minus 1, and LENGTH is between 0 and the sector size.  */
+  /* If non-zero, don't keep the data of multi-block reads in the cache.  */
+  int streaming;
+
+  /* Read-ahead state: the device sector of the cache block expected next
+     if the access is sequential, and the current read-ahead window in
+     bytes.  */
+  grub_disk_addr_t ra_next;
+  grub_size_t ra_window;
+
+  /* Called once for each contiguous range that was read. OFFSET is
+     between 0 and the sector size minus 1, and LENGTH may span several
+     sectors.  Use grub_disk_read_hook_sectors to get one call per
+     sector.  */
   void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
 		     unsigned offset, unsigned length);
 
@@ -141,14 +195,44 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 #define GRUB_DISK_SECTOR_SIZE	0x200
 #define GRUB_DISK_SECTOR_BITS	9
 
-/* The maximum number of disk caches.  */
-#define GRUB_DISK_CACHE_NUM	1021
+/* The number of entries in each set of the disk cache.  */
+#define GRUB_DISK_CACHE_WAYS	8
+
+/* The bounds of the number of disk cache sets.  The actual number is
+   chosen at runtime from the heap size and must be a power of two.  */
+#define GRUB_DISK_CACHE_MIN_SETS	16
+#define GRUB_DISK_CACHE_MAX_SETS	1024
+
+/* The maximum number of pinned entries in a set, so that there's always
+   room left for ordinary data.  */
+#define GRUB_DISK_CACHE_MAX_PINNED	(GRUB_DISK_CACHE_WAYS - 2)
 
-/* The size of a disk cache in 512B units. Must be at least as big as the
-   largest supported sector size, currently 16K.  */
+/* The size of a disk cache block in 512B units.  Devices with larger
+   sectors cache one sector per block.  */
 #define GRUB_DISK_CACHE_BITS	6
 #define GRUB_DISK_CACHE_SIZE	(1 << GRUB_DISK_CACHE_BITS)
 
+/* Logarithm of the largest supported sector size, 64K.  */
+#define GRUB_DISK_MAX_SECTOR_BITS	16
+
+/* Reads of at least this many bytes bypass the disk cache, except for
+   their partial first and last cache blocks.  */
+#define GRUB_DISK_STREAM_THRESHOLD	(1 << 20)
+
+/* The bounds of the read-ahead window.  It starts at the minimum on the
+   first sequential cache miss and doubles on each further one.  The upper
+   bound is the default of grub_disk_readahead_max.  */
+#define GRUB_DISK_READAHEAD_MIN		(32 << 10)
+#define GRUB_DISK_READAHEAD_MAX		(1 << 20)
+
+/* The largest bounce buffer grub_disk_read_vec uses to read segments that
+   are adjacent on disk but not in memory with one read.  */
+#define GRUB_DISK_VEC_BOUNCE_MAX	(1 << 20)
+
+/* The largest range passed to a read hook at once.  Longer reads are
+   reported as several consecutive ranges.  */
+#define GRUB_DISK_READ_HOOK_MAX		(1U << 30)
+
 /* Return value of grub_disk_get_size() in case disk size is unknown. */
 #define GRUB_DISK_SIZE_UNKNOWN	 0xffffffffffffffffULL
 
@@ -178,6 +262,20 @@ grub_err_t EXPORT_FUNC(grub_disk_read) (grub_disk_t disk,
 					grub_off_t offset,
 					grub_size_t size,
 					void *buf);
+grub_err_t EXPORT_FUNC(grub_disk_read_pinned) (grub_disk_t disk,
+					       grub_disk_addr_t sector,
+					       grub_off_t offset,
+					       grub_size_t size,
+					       void *buf);
+grub_err_t EXPORT_FUNC(grub_disk_read_vec) (grub_disk_t disk,
+					    struct grub_disk_vec *vec,
+					    unsigned nvec);
+void EXPORT_FUNC(grub_disk_read_hook_sectors) (grub_disk_addr_t sector,
+					       unsigned offset,
+					       unsigned length,
+					       void NESTED_FUNC_ATTR (*hook) (grub_disk_addr_t,
+									      unsigned,
+									      unsigned));
 grub_err_t EXPORT_FUNC(grub_disk_write) (grub_disk_t disk,
 					 grub_disk_addr_t sector,
 					 grub_off_t offset,
@@ -185,6 +283,13 @@ grub_err_t EXPORT_FUNC(grub_disk_write) (grub_disk_t disk,
 					 const void *buf);
 
 grub_uint64_t EXPORT_FUNC(grub_disk_get_size) (grub_disk_t disk);
+unsigned long EXPORT_FUNC(grub_disk_get_generation) (grub_disk_t disk);
+void EXPORT_FUNC(grub_disk_media_changed) (grub_disk_t disk);
+void EXPORT_FUNC(grub_disk_device_changed) (enum grub_disk_dev_id dev_id,
+						unsigned long disk_id);
+int EXPORT_FUNC(grub_disk_stats_iterate) (int (*hook) (const char *name,
+						       const struct grub_disk_stats *stats));
+void EXPORT_FUNC(grub_disk_stats_reset) (void);
 
 #if DISK_CACHE_STATS
 void
@@ -194,6 +299,27 @@ EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits, unsigned long
 extern void (* EXPORT_VAR(grub_disk_firmware_fini)) (void);
 extern int EXPORT_VAR(grub_disk_firmware_is_tainted);
 
+/* Events passed to grub_disk_trace_hook: a read requested from the disk
+   layer, and a read issued to the driver.  */
+#define GRUB_DISK_TRACE_REQUEST		0
+#define GRUB_DISK_TRACE_DEVICE		1
+
+/* Flags of requests.  */
+#define GRUB_DISK_TRACE_PIN		1
+#define GRUB_DISK_TRACE_STREAMING	2
+
+/* If set, called for every read.  SECTOR is absolute on the device and in
+   512-byte units, whatever the sector size of the device.  */
+extern void (* EXPORT_VAR(grub_disk_trace_hook)) (grub_disk_t disk, int type,
+						  int flags,
+						  grub_disk_addr_t sector,
+						  grub_off_t offset,
+						  grub_size_t size);
+
+extern unsigned EXPORT_VAR(grub_disk_cache_sets);
+extern grub_size_t EXPORT_VAR(grub_disk_readahead_max);
+void EXPORT_FUNC(grub_disk_cache_reset) (void);
+
 #if defined (GRUB_UTIL)
 void grub_lvm_init (void);
 void grub_ldm_init (void);
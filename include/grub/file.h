@@ -22,6 +22,7 @@
 #include <grub/types.h>
 #include <grub/err.h>
 #include <grub/device.h>
+#include <grub/disk.h>
 #include <grub/fs.h>
 
 /* File description.  */
@@ -42,10 +43,15 @@ struct grub_file
   /* If file is not easily seekable. Should be set by underlying layer.  */
   int not_easily_seekable;
 
+  /* If non-zero, the reads of the file's data don't go through the disk
+     cache.  See grub_file_set_streaming.  */
+  int streaming;
+
   /* Filesystem-specific data.  */
   void *data;
 
-  /* This is called when a sector is read. Used only for a disk device.  */
+  /* This is called for each contiguous range of sectors read. Used only
+     for a disk device.  */
   void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
 		     unsigned offset, unsigned length);
 };
@@ -57,9 +63,11 @@ typedef enum grub_file_filter_id
     GRUB_FILE_FILTER_GZIO,
     GRUB_FILE_FILTER_XZIO,
     GRUB_FILE_FILTER_LZOPIO,
+    GRUB_FILE_FILTER_ZSTDIO,
+    GRUB_FILE_FILTER_LZ4IO,
     GRUB_FILE_FILTER_MAX,
     GRUB_FILE_FILTER_COMPRESSION_FIRST = GRUB_FILE_FILTER_GZIO,
-    GRUB_FILE_FILTER_COMPRESSION_LAST = GRUB_FILE_FILTER_LZOPIO,
+    GRUB_FILE_FILTER_COMPRESSION_LAST = GRUB_FILE_FILTER_LZ4IO,
   } grub_file_filter_id_t;
 
 typedef grub_file_t (*grub_file_filter_t) (grub_file_t in);
@@ -127,4 +135,13 @@ grub_file_seekable (const grub_file_t file)
   return !file->not_easily_seekable;
 }
 
+/* Tell the disk layer that FILE is read once, in large chunks, so that its
+   contents aren't worth caching.  This only applies while reading FILE,
+   other reads from the same disk are cached as usual.  */
+static inline void
+grub_file_set_streaming (grub_file_t file)
+{
+  file->streaming = 1;
+}
+
 #endif /* ! GRUB_FILE_HEADER */
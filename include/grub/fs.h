@@ -33,6 +33,38 @@
 /* Forward declaration is required, because of mutual reference.  */
 struct grub_file;
 
+/* A magic number identifying a filesystem: SIZE bytes MAGIC at byte OFFSET
+   of the device.  */
+struct grub_fs_signature
+{
+  grub_off_t offset;
+  grub_size_t size;
+  const char *magic;
+};
+
+/* Signatures are declared with GRUB_FS_SIGNATURE, one per line, so that
+   they are copied to fs.lst as well.  OFFSET must be a decimal number and
+   MAGIC a string literal without spaces or quotes; use \x escapes for
+   those and for anything unprintable.  */
+#ifdef GRUB_LST_GENERATOR
+#define GRUB_FS_SIGNATURE(offset, magic) FS_SIGNATURE_MARKER (offset, magic)
+#else
+#define GRUB_FS_SIGNATURE(offset, magic) { (offset), sizeof (magic) - 1, (magic) }
+#endif
+
+/* How much of the start of a device is read to look for signatures.  */
+#define GRUB_FS_PROBE_SIZE	(260 << 10)
+
+/* The start of a device as read by grub_fs_probe.  */
+struct grub_fs_probe_area
+{
+  const char *buf;
+  /* The number of bytes in BUF.  */
+  grub_size_t size;
+  /* The size of the device in bytes, or all ones if unknown.  */
+  grub_uint64_t total;
+};
+
 struct grub_dirhook_info
 {
   unsigned dir:1;
@@ -51,6 +83,11 @@ struct grub_fs
   /* My name.  */
   const char *name;
 
+  /* The signatures of the filesystem, terminated by an entry with a null
+     MAGIC.  A device is only tried if one of them matches.  If null, all
+     devices are tried.  */
+  const struct grub_fs_signature *signatures;
+
   /* Call HOOK with each file under DIR.  */
   grub_err_t (*dir) (grub_device_t device, const char *path,
 		     int (*hook) (const char *filename,
@@ -78,6 +115,10 @@ struct grub_fs
   /* Get writing time of filesystem. */
   grub_err_t (*mtime) (grub_device_t device, grub_int32_t *timebuf);
 
+  /* Free DATA, a mounted instance kept in the mount cache.  If null,
+     grub_free is used.  */
+  void (*free_mount) (void *data);
+
 #ifdef GRUB_UTIL
   /* Determine sectors available for embedding.  */
   grub_err_t (*embed) (grub_device_t device, unsigned int *nsectors,
@@ -100,8 +141,10 @@ extern struct grub_fs grub_fs_blocklist;
 /* This hook is used to automatically load filesystem modules.
    If this hook loads a module, return non-zero. Otherwise return zero.
    The newly loaded filesystem is assumed to be inserted into the head of
-   the linked list GRUB_FS_LIST through the function grub_fs_register.  */
-typedef int (*grub_fs_autoload_hook_t) (void);
+   the linked list GRUB_FS_LIST through the function grub_fs_register.
+   AREA is the start of the device being probed, if it could be read, so
+   that only modules whose signatures match need to be loaded.  */
+typedef int (*grub_fs_autoload_hook_t) (const struct grub_fs_probe_area *area);
 extern grub_fs_autoload_hook_t EXPORT_VAR(grub_fs_autoload_hook);
 extern grub_fs_t EXPORT_VAR (grub_fs_list);
 
@@ -113,14 +156,31 @@ grub_fs_register (grub_fs_t fs)
 }
 #endif
 
+void EXPORT_FUNC(grub_fs_mount_cache_flush) (grub_fs_t fs);
+
 static inline void
 grub_fs_unregister (grub_fs_t fs)
 {
   grub_list_remove (GRUB_AS_LIST (fs));
+  grub_fs_mount_cache_flush (fs);
 }
 
 #define FOR_FILESYSTEMS(var) FOR_LIST_ELEMENTS((var), (grub_fs_list))
 
 grub_fs_t EXPORT_FUNC(grub_fs_probe) (grub_device_t device);
+int EXPORT_FUNC(grub_fs_match_signatures) (const struct grub_fs_signature *signatures,
+					   const struct grub_fs_probe_area *area);
+
+/* The mount cache keeps the instances of mounted filesystems, as built by
+   the drivers from the superblock and the like, across opens.  A driver
+   takes an idle instance with grub_fs_mount_cache_get, registers a fresh
+   one with grub_fs_mount_cache_add and gives either back when done with
+   grub_fs_mount_cache_put.  Instances are only valid as long as the
+   generation of their device doesn't change.  */
+void *EXPORT_FUNC(grub_fs_mount_cache_get) (grub_fs_t fs,
+					     struct grub_disk *disk);
+void EXPORT_FUNC(grub_fs_mount_cache_add) (grub_fs_t fs,
+					   struct grub_disk *disk, void *data);
+void EXPORT_FUNC(grub_fs_mount_cache_put) (grub_fs_t fs, void *data);
 
 #endif /* ! GRUB_FS_HEADER */
@@ -59,6 +59,34 @@ EXPORT_FUNC(grub_fshelp_find_file) (const char *path,
 				    char *(*read_symlink) (grub_fshelp_node_t node),
 				    enum grub_fshelp_filetype expect);
 
+/* A cache of the directory entries looked up by grub_fshelp_find_file_cached
+   in one filesystem instance.  The nodes are copied with NODESIZE bytes and
+   must stay valid as long as the cache, so they can't point to memory owned
+   by other nodes.  */
+struct grub_fshelp_dcache;
+
+struct grub_fshelp_dcache *
+EXPORT_FUNC(grub_fshelp_dcache_new) (grub_size_t nodesize);
+
+void
+EXPORT_FUNC(grub_fshelp_dcache_free) (struct grub_fshelp_dcache *dcache);
+
+/* Like grub_fshelp_find_file, but remember the directory entries looked
+   up, including the names which don't exist, in DCACHE and look them up
+   there first.  DCACHE may be 0.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_cached) (struct grub_fshelp_dcache *dcache,
+					   const char *path,
+					   grub_fshelp_node_t rootnode,
+					   grub_fshelp_node_t *foundnode,
+					   int (*iterate_dir) (grub_fshelp_node_t dir,
+							       int NESTED_FUNC_ATTR
+							       (*hook) (const char *filename,
+									enum grub_fshelp_filetype filetype,
+									grub_fshelp_node_t node)),
+					   char *(*read_symlink) (grub_fshelp_node_t node),
+					   enum grub_fshelp_filetype expect);
+
 
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
@@ -76,6 +104,25 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Like grub_fshelp_read_file, but GET_EXTENT translates a file block to
+   the disk block it is stored in and stores the number of blocks of the
+   file that follow contiguously on disk, including this one, in *LEN.
+   A disk block of 0 stands for a run of sparse blocks.  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_extents) (grub_disk_t disk,
+					    grub_fshelp_node_t node,
+					    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+										unsigned offset,
+										unsigned length),
+					    grub_off_t pos, grub_size_t len,
+					    char *buf,
+					    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+									    grub_disk_addr_t block,
+									    grub_disk_addr_t *len),
+					    grub_off_t filesize,
+					    int log2blocksize,
+					    grub_disk_addr_t blocks_start);
+
 unsigned int
 EXPORT_FUNC(grub_fshelp_log2blksize) (unsigned int blksize,
 				      unsigned int *pow);
@@ -25,6 +25,9 @@
 #define GRUB_BIOSDISK_FLAG_LBA	1
 #define GRUB_BIOSDISK_FLAG_CDROM 2
 
+/* INT 13 status returned when the medium was changed.  */
+#define GRUB_BIOSDISK_STATUS_MEDIA_CHANGED	0x06
+
 #define GRUB_BIOSDISK_CDTYPE_NO_EMUL	0
 #define GRUB_BIOSDISK_CDTYPE_1_2_M	1
 #define GRUB_BIOSDISK_CDTYPE_1_44_M	2
@@ -0,0 +1,65 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_IOTRACE_HEADER
+#define GRUB_IOTRACE_HEADER	1
+
+#include <grub/types.h>
+
+/* The format of the disk I/O traces written by iotrace_save and replayed
+   by grub-fstest.  A header is followed by NDEVICES device entries and
+   NRECORDS records.  All numbers are little-endian.  */
+
+#define GRUB_IOTRACE_MAGIC	"GRUBIOTR"
+#define GRUB_IOTRACE_VERSION	1
+
+#define GRUB_IOTRACE_NAME_SIZE	32
+
+struct grub_iotrace_header
+{
+  char magic[8];
+  grub_uint32_t version;
+  grub_uint32_t ndevices;
+  grub_uint32_t nrecords;
+  /* Records which didn't fit in the trace buffer.  */
+  grub_uint32_t dropped;
+} __attribute__ ((packed));
+
+struct grub_iotrace_device
+{
+  char name[GRUB_IOTRACE_NAME_SIZE];
+} __attribute__ ((packed));
+
+struct grub_iotrace_record
+{
+  /* Absolute, in 512-byte units.  */
+  grub_uint64_t sector;
+  grub_uint32_t size;
+  /* Milliseconds since the trace was started.  */
+  grub_uint32_t time;
+  /* Index of the device entry.  */
+  grub_uint16_t device;
+  grub_uint16_t offset;
+  /* GRUB_DISK_TRACE_REQUEST or GRUB_DISK_TRACE_DEVICE, and the
+     GRUB_DISK_TRACE_* flags of requests.  */
+  grub_uint8_t type;
+  grub_uint8_t flags;
+  grub_uint16_t reserved;
+} __attribute__ ((packed));
+
+#endif /* ! GRUB_IOTRACE_HEADER */
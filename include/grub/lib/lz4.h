@@ -0,0 +1,40 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_LZ4_H
+#define GRUB_LZ4_H	1
+
+#include <grub/types.h>
+
+/* Matches of an LZ4 block reach at most this far back.  */
+#define GRUB_LZ4_WINDOW_SIZE 0x10000
+
+/* Decompress the LZ4 block SRC of SRCSIZE bytes into DST, which has room
+   for DSTSIZE bytes.  The HISTORY bytes before DST hold the data preceding
+   the block, for blocks depending on the previous ones.  Return the size
+   of the decompressed data, or -1 if the block is corrupted or doesn't
+   fit.  */
+grub_ssize_t grub_lz4_decompress (const void *src, grub_size_t srcsize,
+				  void *dst, grub_size_t dstsize,
+				  grub_size_t history);
+
+/* Return the size of the data of the LZ4 block SRC of SRCSIZE bytes,
+   without decompressing it, or -1 if the block is corrupted.  */
+grub_ssize_t grub_lz4_uncompressed_size (const void *src, grub_size_t srcsize);
+
+#endif /* ! GRUB_LZ4_H */
@@ -68,7 +68,6 @@ grub_stpcpy (char *dest, const char *src)
   return d - 1;
 }
 
-/* XXX: If grub_memmove is too slow, we must implement grub_memcpy.  */
 static inline void *
 grub_memcpy (void *dest, const void *src, grub_size_t n)
 {
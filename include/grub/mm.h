@@ -22,6 +22,7 @@
 
 #include <grub/types.h>
 #include <grub/symbol.h>
+#include <grub/err.h>
 #include <config.h>
 
 #ifndef NULL
@@ -34,6 +35,66 @@ void *EXPORT_FUNC(grub_zalloc) (grub_size_t size);
 void EXPORT_FUNC(grub_free) (void *ptr);
 void *EXPORT_FUNC(grub_realloc) (void *ptr, grub_size_t size);
 void *EXPORT_FUNC(grub_memalign) (grub_size_t align, grub_size_t size);
+grub_size_t grub_mm_get_free (void);
+
+#ifndef GRUB_MACHINE_EMU
+/* The number of buckets of the free block histogram.  Bucket 0 counts the
+   blocks smaller than 64 bytes, bucket I the blocks of at least 32 << I
+   bytes and the last one everything bigger.  */
+#define GRUB_MM_STATS_BUCKETS	20
+
+struct grub_mm_stats
+{
+  /* In bytes, headers included.  */
+  grub_size_t in_use;
+  grub_size_t peak;
+  grub_size_t free;
+  grub_size_t free_blocks;
+  grub_size_t largest_free;
+  grub_size_t free_hist[GRUB_MM_STATS_BUCKETS];
+  int profiling;
+};
+
+/* The blocks allocated from one call site while the heap profiler runs.
+   The site with the null address stands for all the blocks allocated
+   while it didn't.  */
+struct grub_mm_site
+{
+  const void *addr;
+  grub_size_t live;
+  grub_size_t blocks;
+  grub_size_t allocs;
+};
+
+void EXPORT_FUNC(grub_mm_get_stats) (struct grub_mm_stats *stats);
+grub_err_t EXPORT_FUNC(grub_mm_profile_start) (void);
+void EXPORT_FUNC(grub_mm_profile_stop) (void);
+void EXPORT_FUNC(grub_mm_profile_reset) (void);
+int EXPORT_FUNC(grub_mm_profile_iterate) (int (*hook)
+					  (const struct grub_mm_site *site));
+#endif
+
+/* Pools keep freed objects of one size on a free list to hand them out
+   again in constant time.  The objects are ordinary heap blocks, so they
+   may also be released with grub_free.  */
+typedef struct grub_pool *grub_pool_t;
+
+grub_pool_t EXPORT_FUNC(grub_pool_create) (grub_size_t size,
+					   grub_size_t align,
+					   unsigned max_idle);
+void EXPORT_FUNC(grub_pool_destroy) (grub_pool_t pool);
+void *EXPORT_FUNC(grub_pool_alloc) (grub_pool_t pool);
+void EXPORT_FUNC(grub_pool_free) (grub_pool_t pool, void *obj);
+void EXPORT_FUNC(grub_pool_shrink_all) (void);
+
+/* Arenas hand out memory by bumping a pointer in large chunks, and release
+   everything allocated from them at once.  */
+typedef struct grub_arena *grub_arena_t;
+
+grub_arena_t EXPORT_FUNC(grub_arena_create) (grub_size_t chunk_size);
+void EXPORT_FUNC(grub_arena_destroy) (grub_arena_t arena);
+void *EXPORT_FUNC(grub_arena_alloc) (grub_arena_t arena, grub_size_t size);
+void EXPORT_FUNC(grub_arena_reset) (grub_arena_t arena);
 
 void grub_mm_check_real (char *file, int line);
 #define grub_mm_check() grub_mm_check_real (GRUB_FILE, __LINE__);
@@ -72,8 +133,6 @@ void *EXPORT_FUNC(grub_debug_memalign) (const char *file, int line,
 					grub_size_t align, grub_size_t size);
 #endif /* MM_DEBUG && ! GRUB_UTIL */
 
-#include <grub/err.h>
-
 static inline grub_err_t 
 grub_extend_alloc (grub_size_t sz, grub_size_t *allocated, void **ptr)
 {
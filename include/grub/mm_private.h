@@ -24,19 +24,17 @@
 /* Magic words.  */
 #define GRUB_MM_FREE_MAGIC	0x2d3c2808
 #define GRUB_MM_ALLOC_MAGIC	0x6db08fa4
+/* A freed block kept on a quick list.  */
+#define GRUB_MM_QUICK_MAGIC	0x5b1e9c37
 
 typedef struct grub_mm_header
 {
   struct grub_mm_header *next;
   grub_size_t size;
   grub_size_t magic;
-#if GRUB_CPU_SIZEOF_VOID_P == 4
-  char padding[4];
-#elif GRUB_CPU_SIZEOF_VOID_P == 8
-  char padding[8];
-#else
-# error "unknown word size"
-#endif
+  /* The profile entry charged for an allocated block, or NULL if the block
+     wasn't allocated by grub_memalign.  */
+  struct grub_mm_site *site;
 }
 *grub_mm_header_t;
 
@@ -44,6 +42,8 @@ typedef struct grub_mm_header
 # define GRUB_MM_ALIGN_LOG2	4
 #elif GRUB_CPU_SIZEOF_VOID_P == 8
 # define GRUB_MM_ALIGN_LOG2	5
+#else
+# error "unknown word size"
 #endif
 
 #define GRUB_MM_ALIGN	(1 << GRUB_MM_ALIGN_LOG2)
@@ -59,6 +59,10 @@ typedef struct grub_mm_region
 
 #ifndef GRUB_MACHINE_EMU
 extern grub_mm_region_t EXPORT_VAR (grub_mm_base);
+
+/* Put the freed blocks kept on the quick lists back into the free rings
+   of their regions.  */
+void EXPORT_FUNC (grub_mm_flush_quick) (void);
 #endif
 
 #endif
@@ -0,0 +1,52 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_MODBUNDLE_HEADER
+#define GRUB_MODBUNDLE_HEADER	1
+
+#include <grub/types.h>
+
+/* The format of the module bundles written by grub-mkimage --bundle and
+   loaded by load_bundle.  A header is followed by NMODULES entries and the
+   module images, each aligned to GRUB_MODBUNDLE_ALIGN bytes.  The modules
+   are stored in dependency order, so that every module comes after the
+   modules it needs.  All numbers are little-endian.  */
+
+#define GRUB_MODBUNDLE_MAGIC	"GRUBMODB"
+#define GRUB_MODBUNDLE_VERSION	1
+
+#define GRUB_MODBUNDLE_NAME_SIZE	32
+#define GRUB_MODBUNDLE_ALIGN	8
+
+struct grub_modbundle_header
+{
+  char magic[8];
+  grub_uint32_t version;
+  grub_uint32_t nmodules;
+} __attribute__ ((packed));
+
+struct grub_modbundle_entry
+{
+  /* Null-terminated.  */
+  char name[GRUB_MODBUNDLE_NAME_SIZE];
+  /* From the start of the bundle.  */
+  grub_uint32_t offset;
+  grub_uint32_t size;
+} __attribute__ ((packed));
+
+#endif /* ! GRUB_MODBUNDLE_HEADER */
@@ -26,5 +26,6 @@ grub_err_t grub_netbuff_reserve (struct grub_net_buff *net_buff, grub_size_t len
 grub_err_t grub_netbuff_clear (struct grub_net_buff *net_buff);
 struct grub_net_buff * grub_netbuff_alloc (grub_size_t len);
 void grub_netbuff_free (struct grub_net_buff *net_buff);
+void grub_netbuff_fini (void);
 
 #endif
@@ -34,6 +34,7 @@
 #include <grub/command.h>
 #include <grub/i18n.h>
 #include <grub/zfs/zfs.h>
+#include <grub/iotrace.h>
 
 #include <stdio.h>
 #include <unistd.h>
@@ -71,7 +72,8 @@ enum {
   CMD_BLOCKLIST,
   CMD_TESTLOAD,
   CMD_ZFSINFO,
-  CMD_XNU_UUID
+  CMD_XNU_UUID,
+  CMD_REPLAY
 };
 #define BUF_SIZE  32256
 
@@ -352,6 +354,138 @@ cmd_crc (char *pathname)
 	  grub_be_to_cpu32 (grub_get_unaligned32 (GRUB_MD_CRC32->read (crc32_context))));
 }
 
+static unsigned cache_sets = 0;
+static long readahead = -1;
+static char *trace_device = NULL;
+static char *sector_size = NULL;
+
+/* Replay the requests of one device of the trace in PATHNAME on the first
+   image, and compare the driver reads they cause with the recorded ones.  */
+static void
+cmd_replay (char *pathname)
+{
+  FILE *fp;
+  struct grub_iotrace_header header;
+  struct grub_iotrace_device *devices;
+  struct grub_iotrace_record *records;
+  grub_uint32_t ndevices, nrecords, dev, i;
+  grub_uint64_t *counts;
+  grub_uint64_t requests = 0, traced_reads = 0, traced_bytes = 0, failed = 0;
+  grub_disk_t disk;
+  char *buf = NULL;
+  grub_size_t buf_size = 0;
+
+  auto int print_stats (const char *name,
+			const struct grub_disk_stats *stats);
+  int print_stats (const char *name, const struct grub_disk_stats *stats)
+  {
+    if (strcmp (name, disk->name) != 0)
+      return 0;
+    printf ("replay: %llu driver reads, %llu bytes, "
+	    "cache %llu hits, %llu misses, %llu evictions\n",
+	    (unsigned long long) stats->reads,
+	    (unsigned long long) stats->bytes_read,
+	    (unsigned long long) stats->cache_hits,
+	    (unsigned long long) stats->cache_misses,
+	    (unsigned long long) stats->evictions);
+    return 1;
+  }
+
+  fp = fopen (pathname, "rb");
+  if (! fp)
+    grub_util_error (_("cannot open `%s': %s"), pathname, strerror (errno));
+
+  if (fread (&header, sizeof (header), 1, fp) != 1
+      || memcmp (header.magic, GRUB_IOTRACE_MAGIC, sizeof (header.magic)) != 0
+      || grub_le_to_cpu32 (header.version) != GRUB_IOTRACE_VERSION)
+    grub_util_error (_("`%s' is not a disk trace"), pathname);
+
+  ndevices = grub_le_to_cpu32 (header.ndevices);
+  nrecords = grub_le_to_cpu32 (header.nrecords);
+  devices = xmalloc (ndevices * sizeof (devices[0]) + 1);
+  records = xmalloc (nrecords * sizeof (records[0]) + 1);
+  counts = xmalloc (ndevices * sizeof (counts[0]) + 1);
+  if (fread (devices, sizeof (devices[0]), ndevices, fp) != ndevices
+      || fread (records, sizeof (records[0]), nrecords, fp) != nrecords)
+    grub_util_error (_("`%s' is truncated"), pathname);
+  fclose (fp);
+
+  /* Replay the given device, or the one with the most requests.  */
+  memset (counts, 0, ndevices * sizeof (counts[0]));
+  for (i = 0; i < nrecords; i++)
+    if (records[i].type == GRUB_DISK_TRACE_REQUEST
+	&& grub_le_to_cpu16 (records[i].device) < ndevices)
+      counts[grub_le_to_cpu16 (records[i].device)]++;
+
+  dev = ndevices;
+  for (i = 0; i < ndevices; i++)
+    {
+      devices[i].name[GRUB_IOTRACE_NAME_SIZE - 1] = 0;
+      if (trace_device ? strcmp (devices[i].name, trace_device) == 0
+	  : (dev == ndevices || counts[i] > counts[dev]))
+	dev = i;
+    }
+  if (dev == ndevices)
+    grub_util_error ("%s", _("no such device in the trace"));
+
+  grub_disk_cache_sets = cache_sets;
+  if (readahead >= 0)
+    grub_disk_readahead_max = readahead;
+  grub_disk_cache_reset ();
+
+  disk = grub_disk_open ("loop0");
+  if (! disk)
+    grub_util_error ("%s", grub_errmsg);
+  grub_disk_stats_reset ();
+
+  for (i = 0; i < nrecords; i++)
+    {
+      struct grub_iotrace_record *rec = records + i;
+      grub_size_t size = grub_le_to_cpu32 (rec->size);
+
+      if (grub_le_to_cpu16 (rec->device) != dev)
+	continue;
+
+      if (rec->type == GRUB_DISK_TRACE_DEVICE)
+	{
+	  traced_reads++;
+	  traced_bytes += size;
+	  continue;
+	}
+
+      requests++;
+      if (size > buf_size)
+	{
+	  buf_size = size;
+	  buf = xrealloc (buf, buf_size);
+	}
+
+      disk->streaming = !! (rec->flags & GRUB_DISK_TRACE_STREAMING);
+      if (((rec->flags & GRUB_DISK_TRACE_PIN)
+	   ? grub_disk_read_pinned : grub_disk_read)
+	  (disk, grub_le_to_cpu64 (rec->sector),
+	   grub_le_to_cpu16 (rec->offset), size, buf))
+	{
+	  failed++;
+	  grub_errno = GRUB_ERR_NONE;
+	}
+    }
+
+  printf ("trace: %s, %llu requests, %llu driver reads, %llu bytes\n",
+	  devices[dev].name, (unsigned long long) requests,
+	  (unsigned long long) traced_reads,
+	  (unsigned long long) traced_bytes);
+  grub_disk_stats_iterate (print_stats);
+  if (failed)
+    printf ("%llu requests failed\n", (unsigned long long) failed);
+
+  grub_disk_close (disk);
+  free (buf);
+  free (counts);
+  free (records);
+  free (devices);
+}
+
 static const char *root = NULL;
 static int args_count = 0;
 static int nparm = 0;
@@ -361,6 +495,33 @@ static int cmd = 0;
 static char *debug_str = NULL;
 static char **args = NULL;
 static int mount_crypt = 0;
+static int show_iostat = 0;
+
+static void
+print_iostat (void)
+{
+  auto int print_stats (const char *name,
+			const struct grub_disk_stats *stats);
+  int print_stats (const char *name, const struct grub_disk_stats *stats)
+  {
+    unsigned i;
+
+    fprintf (stderr, "%s: %llu reads, %llu bytes, %llu ms, "
+	     "cache %llu hits, %llu misses, %llu evictions, latency",
+	     name, (unsigned long long) stats->reads,
+	     (unsigned long long) stats->bytes_read,
+	     (unsigned long long) stats->read_time,
+	     (unsigned long long) stats->cache_hits,
+	     (unsigned long long) stats->cache_misses,
+	     (unsigned long long) stats->evictions);
+    for (i = 0; i < GRUB_DISK_STATS_LATENCY_BUCKETS; i++)
+      fprintf (stderr, " %llu", (unsigned long long) stats->latency[i]);
+    fprintf (stderr, "\n");
+    return 0;
+  }
+
+  grub_disk_stats_iterate (print_stats);
+}
 
 static void
 fstest (int n)
@@ -371,7 +532,9 @@ fstest (int n)
 
   for (i = 0; i < num_disks; i++)
     {
-      char *argv[2];
+      char *argv[4];
+      int argc = 0;
+
       loop_name = grub_xasprintf ("loop%d", i);
       if (!loop_name)
 	grub_util_error ("%s", grub_errmsg);
@@ -380,12 +543,19 @@ fstest (int n)
       if (!host_file)
 	grub_util_error ("%s", grub_errmsg);
 
-      argv[0] = loop_name;
-      argv[1] = host_file;
+      if (sector_size)
+	{
+	  argv[argc++] = xstrdup ("-s");
+	  argv[argc++] = sector_size;
+	}
+      argv[argc++] = loop_name;
+      argv[argc++] = host_file;
 
-      if (execute_command ("loopback", 2, argv))
+      if (execute_command ("loopback", argc, argv))
         grub_util_error (_("`loopback' command fails: %s"), grub_errmsg);
 
+      if (sector_size)
+	free (argv[0]);
       grub_free (loop_name);
       grub_free (host_file);
     }
@@ -467,7 +637,14 @@ fstest (int n)
 	grub_free (uuid);
 	grub_device_close (dev);
       }
+      break;
+    case CMD_REPLAY:
+      cmd_replay (args[0]);
+      break;
     }
+
+  if (show_iostat)
+    print_iostat ();
     
   for (i = 0; i < num_disks; i++)
     {
@@ -497,6 +674,7 @@ static struct argp_option options[] = {
   {N_("crc FILE"), 0, 0     , OPTION_DOC, N_("Get crc32 checksum of FILE."), 1},
   {N_("blocklist FILE"), 0, 0, OPTION_DOC, N_("Display blocklist of FILE."), 1},
   {N_("xnu_uuid DEVICE"), 0, 0, OPTION_DOC, N_("Compute XNU UUID of the device."), 1},
+  {N_("replay TRACE"), 0, 0, OPTION_DOC, N_("Replay the disk trace in local file TRACE on the first image."), 1},
   
   {"root",      'r', N_("DEVICE_NAME"), 0, N_("Set root device."),                 2},
   {"skip",      's', N_("NUM"),           0, N_("Skip N bytes from output file."),   2},
@@ -509,6 +687,11 @@ static struct argp_option options[] = {
    N_("FILE|prompt"), 0, N_("Load zfs crypto key."),                 2},
   {"verbose",   'v', NULL, 0, N_("print verbose messages."), 2},
   {"uncompress", 'u', NULL, 0, N_("Uncompress data."), 2},
+  {"iostat", 'I', NULL, 0, N_("Print disk I/O statistics to stderr."), 2},
+  {"sector-size", 'b', N_("NUM"), 0, N_("Use sectors of NUM bytes for the images."), 2},
+  {"cache-sets", 'S', N_("NUM"), 0, N_("Use NUM disk cache sets when replaying."), 2},
+  {"readahead", 'A', N_("NUM"), 0, N_("Read ahead at most NUM bytes when replaying."), 2},
+  {"trace-device", 'D', N_("NAME"), 0, N_("Replay the requests of device NAME."), 2},
   {0, 0, 0, 0, 0, 0}
 };
 
@@ -612,6 +795,26 @@ argp_parser (int key, char *arg, struct argp_state *state)
       uncompress = 1;
       return 0;
 
+    case 'I':
+      show_iostat = 1;
+      return 0;
+
+    case 'b':
+      sector_size = arg;
+      return 0;
+
+    case 'S':
+      cache_sets = strtoul (arg, NULL, 0);
+      return 0;
+
+    case 'A':
+      readahead = strtol (arg, NULL, 0);
+      return 0;
+
+    case 'D':
+      trace_device = arg;
+      return 0;
+
     case ARGP_KEY_END:
       if (args_count < num_disks)
 	{
@@ -691,6 +894,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
 	  cmd = CMD_XNU_UUID;
 	  nparm = 0;
 	}
+      else if (grub_strcmp (arg, "replay") == 0)
+	{
+	  cmd = CMD_REPLAY;
+	  nparm = 1;
+	}
       else
 	{
 	  fprintf (stderr, _("Invalid command %s.\n"), arg);
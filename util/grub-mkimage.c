@@ -31,6 +31,7 @@
 #include <grub/offsets.h>
 #include <grub/crypto.h>
 #include <grub/dl.h>
+#include <grub/modbundle.h>
 #include <time.h>
 #include <multiboot.h>
 
@@ -1643,6 +1644,79 @@ generate_image (const char *dir, const char *prefix,
 
 
 
+/* Write the modules MODS and their dependencies under DIR to OUT as a
+   bundle for load_bundle, in the order they must be loaded.  */
+static void
+generate_bundle (const char *dir, FILE *out, const char *outname,
+		 char *mods[])
+{
+  struct grub_util_path_list *path_list, *p, *next;
+  struct grub_modbundle_header *header;
+  struct grub_modbundle_entry *entry;
+  size_t nmodules = 0, offset, total_size;
+  char *bundle_img;
+
+  path_list = grub_util_resolve_dependencies (dir, "moddep.lst", mods);
+
+  for (p = path_list; p; p = p->next)
+    nmodules++;
+
+  offset = ALIGN_UP (sizeof (*header) + nmodules * sizeof (*entry),
+		     GRUB_MODBUNDLE_ALIGN);
+  total_size = offset;
+  for (p = path_list; p; p = p->next)
+    total_size += ALIGN_UP (grub_util_get_image_size (p->name),
+			    GRUB_MODBUNDLE_ALIGN);
+
+  grub_util_info ("the total bundle size is 0x%llx",
+		  (unsigned long long) total_size);
+  if (total_size != (grub_uint32_t) total_size)
+    grub_util_error ("%s", _("the module bundle is too big"));
+
+  bundle_img = xmalloc (total_size);
+  memset (bundle_img, 0, total_size);
+
+  header = (struct grub_modbundle_header *) bundle_img;
+  memcpy (header->magic, GRUB_MODBUNDLE_MAGIC, sizeof (header->magic));
+  header->version = grub_cpu_to_le32 (GRUB_MODBUNDLE_VERSION);
+  header->nmodules = grub_cpu_to_le32 (nmodules);
+
+  entry = (struct grub_modbundle_entry *) (header + 1);
+  for (p = path_list; p; p = p->next, entry++)
+    {
+      const char *base, *ext;
+      size_t mod_size;
+
+      base = strrchr (p->name, '/');
+      base = base ? base + 1 : p->name;
+      ext = strrchr (base, '.');
+      if (! ext)
+	ext = base + strlen (base);
+      if (ext - base >= GRUB_MODBUNDLE_NAME_SIZE)
+	grub_util_error (_("module name `%s' is too long"), base);
+      memcpy (entry->name, base, ext - base);
+
+      mod_size = grub_util_get_image_size (p->name);
+      entry->offset = grub_cpu_to_le32 (offset);
+      entry->size = grub_cpu_to_le32 (mod_size);
+      grub_util_load_image (p->name, bundle_img + offset);
+      offset += ALIGN_UP (mod_size, GRUB_MODBUNDLE_ALIGN);
+    }
+
+  grub_util_write_image (bundle_img, total_size, out, outname);
+  free (bundle_img);
+
+  while (path_list)
+    {
+      next = path_list->next;
+      free ((void *) path_list->name);
+      free (path_list);
+      path_list = next;
+    }
+}
+
+
+
 static struct argp_option options[] = {
   {"directory",  'd', N_("DIR"), 0,
    /* TRANSLATORS: platform here isn't identifier. It can be translated.  */
@@ -1659,6 +1733,7 @@ static struct argp_option options[] = {
   {"output",  'o', N_("FILE"), 0, N_("output a generated image to FILE [default=stdout]"), 0},
   {"format",  'O', N_("FORMAT"), 0, 0, 0},
   {"compression",  'C', "(xz|none|auto)", 0, N_("choose the compression to use"), 0},
+  {"bundle",  'b', 0, 0, N_("write a module bundle for load_bundle instead of an image"), 0},
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
   { 0, 0, 0, 0, 0, 0 }
 };
@@ -1712,6 +1787,7 @@ struct arguments
   char *font;
   char *config;
   int note;
+  int bundle;
   struct image_target_desc *image_target;
   grub_compression_t comp;
 };
@@ -1759,6 +1835,10 @@ argp_parser (int key, char *arg, struct argp_state *state)
       arguments->note = 1;
       break;
 
+    case 'b':
+      arguments->bundle = 1;
+      break;
+
     case 'm':
       if (arguments->memdisk)
 	free (arguments->memdisk);
@@ -1877,10 +1957,13 @@ main (int argc, char *argv[])
 	      arguments.image_target->dirname);
     }
 
-  generate_image (arguments.dir, arguments.prefix ? : DEFAULT_DIRECTORY, fp,
-		  arguments.output,
-		  arguments.modules, arguments.memdisk, arguments.config,
-		  arguments.image_target, arguments.note, arguments.comp);
+  if (arguments.bundle)
+    generate_bundle (arguments.dir, fp, arguments.output, arguments.modules);
+  else
+    generate_image (arguments.dir, arguments.prefix ? : DEFAULT_DIRECTORY, fp,
+		    arguments.output,
+		    arguments.modules, arguments.memdisk, arguments.config,
+		    arguments.image_target, arguments.note, arguments.comp);
 
   fflush (fp);
   fsync (fileno (fp));
@@ -157,7 +157,7 @@ setup (const char *dir,
   grub_uint16_t current_segment
     = GRUB_BOOT_I386_PC_KERNEL_SEG + (GRUB_DISK_SECTOR_SIZE >> 4);
 #endif
-  grub_uint16_t last_length = GRUB_DISK_SECTOR_SIZE;
+  unsigned last_length = GRUB_DISK_SECTOR_SIZE;
   FILE *fp;
 
   auto void NESTED_FUNC_ATTR save_first_sector (grub_disk_addr_t sector,
@@ -185,24 +185,27 @@ setup (const char *dir,
 					 unsigned length)
     {
       struct grub_boot_blocklist *prev = block + 1;
+      unsigned num = ((length + GRUB_DISK_SECTOR_SIZE - 1)
+		      >> GRUB_DISK_SECTOR_BITS);
 
       grub_util_info ("saving <%" PRIuGRUB_UINT64_T ",%u,%u>",
 		      sector, offset, length);
 
-      if (offset != 0 || last_length != GRUB_DISK_SECTOR_SIZE)
+      /* Only the last range may end in the middle of a sector.  */
+      if (offset != 0 || (last_length & (GRUB_DISK_SECTOR_SIZE - 1)))
 	grub_util_error ("%s", _("non-sector-aligned data is found in the core file"));
 
       if (block != first_block
 	  && (grub_target_to_host64 (prev->start)
 	      + grub_target_to_host16 (prev->len)) == sector)
 	{
-	  grub_uint16_t t = grub_target_to_host16 (prev->len) + 1;
+	  grub_uint16_t t = grub_target_to_host16 (prev->len) + num;
 	  prev->len = grub_host_to_target16 (t);
 	}
       else
 	{
 	  block->start = grub_host_to_target64 (sector);
-	  block->len = grub_host_to_target16 (1);
+	  block->len = grub_host_to_target16 (num);
 #ifdef GRUB_SETUP_BIOS
 	  block->segment = grub_host_to_target16 (current_segment);
 #endif
@@ -214,7 +217,7 @@ setup (const char *dir,
 
       last_length = length;
 #ifdef GRUB_SETUP_BIOS
-      current_segment += GRUB_DISK_SECTOR_SIZE >> 4;
+      current_segment += num * (GRUB_DISK_SECTOR_SIZE >> 4);
 #endif
     }
 